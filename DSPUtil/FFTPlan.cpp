@@ -0,0 +1,336 @@
+#include "FFTPlan.h"
+#include <math.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSPUTIL_FFT_SSE
+#include <emmintrin.h>
+#endif
+
+static const unsigned s_maxLog2Size = 31;
+static std::atomic<FFTPlan*> s_plans[s_maxLog2Size + 1];
+static std::mutex s_plansMutex;
+
+static thread_local std::vector<DComp> t_complexScratch;
+static thread_local std::vector<double> t_realScratch;
+static thread_local std::vector<DComp> t_internalScratch;
+
+const FFTPlan& FFTPlan::Get(unsigned l)
+{
+	FFTPlan* plan = s_plans[l].load(std::memory_order_acquire);
+	if (plan == nullptr)
+	{
+		// a plan uses the plan of half its size, which is created first, outside of the lock
+		if (l > 0) Get(l - 1);
+
+		std::lock_guard<std::mutex> lock(s_plansMutex);
+		plan = s_plans[l].load(std::memory_order_relaxed);
+		if (plan == nullptr)
+		{
+			plan = new FFTPlan(l);
+			s_plans[l].store(plan, std::memory_order_release);
+		}
+	}
+	return *plan;
+}
+
+DComp* FFTPlan::ComplexScratch(unsigned count)
+{
+	if (t_complexScratch.size() < count) t_complexScratch.resize(count);
+	return t_complexScratch.data();
+}
+
+double* FFTPlan::RealScratch(unsigned count)
+{
+	if (t_realScratch.size() < count) t_realScratch.resize(count);
+	return t_realScratch.data();
+}
+
+FFTPlan::FFTPlan(unsigned l) : m_l(l), m_n(1u << l)
+{
+	unsigned n = m_n;
+
+	// same sequence as the swap loop of fft()
+	m_bitrev = new unsigned[n];
+	unsigned j = 0;
+	for (unsigned i = 0; i < n; i++)
+	{
+		m_bitrev[i] = j;
+		unsigned k = n >> 1;
+		while (k >= 1 && k <= j)
+		{
+			j -= k;
+			k >>= 1;
+		}
+		j += k;
+	}
+
+	// the twiddles of each stage are generated by the same recurrence as in fft(),
+	// which keeps Forward() and Inverse() bit-identical to fft() and ifft()
+	m_twiddles = new DComp[n > 1 ? n - 1 : 1];
+	for (unsigned le = 1; le < n; le <<= 1)
+	{
+		DComp u, w;
+		u.Re = 1.0; u.Im = 0.0;
+		double tmp = PI / le;
+		w.Re = cos(tmp); w.Im = -sin(tmp);
+		for (unsigned j = 0; j < le; j++)
+		{
+			m_twiddles[le - 1 + j] = u;
+			DCMul(&u, &u, &w);
+		}
+	}
+
+	unsigned numReal = n / 4 + 1;
+	m_realTwiddles = new DComp[numReal];
+	for (unsigned k = 0; k < numReal; k++)
+	{
+		double angle = 2.0*PI*(double)k / (double)n;
+		m_realTwiddles[k].Re = cos(angle);
+		m_realTwiddles[k].Im = -sin(angle);
+	}
+
+	m_half = l > 0 ? &Get(l - 1) : nullptr;
+}
+
+FFTPlan::~FFTPlan()
+{
+	delete[] m_realTwiddles;
+	delete[] m_twiddles;
+	delete[] m_bitrev;
+}
+
+void FFTPlan::_bitReverse(DComp* a) const
+{
+	for (unsigned i = 0; i < m_n; i++)
+	{
+		unsigned j = m_bitrev[i];
+		if (i < j)
+		{
+			DComp t = a[j];
+			a[j] = a[i];
+			a[i] = t;
+		}
+	}
+}
+
+/*
+	Butterflies of one stage, with w the twiddle (conjugated for the inverse):
+		t = w*a[ip]; a[ip] = a[i] - t; a[i] = a[i] + t
+	The products and sums are done in the same order as DCMul(), DCSub() and DCAdd(),
+	the SSE2 path only negates exactly, so both paths give the same bits.
+*/
+template <bool Inverse>
+static inline void Butterflies(DComp* a, const DComp* tw, unsigned n, unsigned lei)
+{
+	unsigned le = lei << 1;
+#ifdef DSPUTIL_FFT_SSE
+	const __m128d sign = Inverse ? _mm_set_pd(-0.0, 0.0) : _mm_set_pd(0.0, -0.0);
+	for (unsigned i = 0; i < n; i += le)
+	{
+		double* p0 = (double*)(a + i);
+		double* p1 = (double*)(a + i + lei);
+		for (unsigned j = 0; j < lei; j++)
+		{
+			__m128d x = _mm_loadu_pd(p1 + 2 * j);
+			__m128d xs = _mm_shuffle_pd(x, x, 1);
+			__m128d ur = _mm_set1_pd(tw[j].Re);
+			__m128d ui = _mm_set1_pd(tw[j].Im);
+			// forward: (ur*xr - ui*xi, ur*xi + ui*xr)
+			// inverse: (ur*xr + ui*xi, ur*xi - ui*xr)
+			__m128d t = _mm_add_pd(_mm_mul_pd(ur, x), _mm_xor_pd(_mm_mul_pd(ui, xs), sign));
+			__m128d y = _mm_loadu_pd(p0 + 2 * j);
+			_mm_storeu_pd(p1 + 2 * j, _mm_sub_pd(y, t));
+			_mm_storeu_pd(p0 + 2 * j, _mm_add_pd(y, t));
+		}
+	}
+#else
+	for (unsigned i = 0; i < n; i += le)
+	{
+		for (unsigned j = 0; j < lei; j++)
+		{
+			DComp& x0 = a[i + j];
+			DComp& x1 = a[i + j + lei];
+			DComp t;
+			if (Inverse)
+			{
+				t.Re = tw[j].Re*x1.Re + tw[j].Im*x1.Im;
+				t.Im = tw[j].Re*x1.Im - tw[j].Im*x1.Re;
+			}
+			else
+			{
+				t.Re = tw[j].Re*x1.Re - tw[j].Im*x1.Im;
+				t.Im = tw[j].Re*x1.Im + tw[j].Im*x1.Re;
+			}
+			x1.Re = x0.Re - t.Re;
+			x1.Im = x0.Im - t.Im;
+			x0.Re = x0.Re + t.Re;
+			x0.Im = x0.Im + t.Im;
+		}
+	}
+#endif
+}
+
+void FFTPlan::Forward(DComp* a) const
+{
+	_bitReverse(a);
+	for (unsigned lei = 1; lei < m_n; lei <<= 1)
+		Butterflies<false>(a, m_twiddles + lei - 1, m_n, lei);
+}
+
+void FFTPlan::Inverse(DComp* a) const
+{
+	_bitReverse(a);
+	for (unsigned lei = 1; lei < m_n; lei <<= 1)
+		Butterflies<true>(a, m_twiddles + lei - 1, m_n, lei);
+
+	// ifft() halves in every stage, which only differs from this by exact powers of 2
+	double scale = 1.0 / (double)m_n;
+	for (unsigned i = 0; i < m_n; i++)
+	{
+		a[i].Re *= scale;
+		a[i].Im *= scale;
+	}
+}
+
+// z holds the transform of the even samples in Re and the odd samples in Im, out may be z
+void FFTPlan::_realForward(DComp* z, DComp* out) const
+{
+	unsigned h = m_n / 2;
+	DComp z0 = z[0];
+	out[0].Re = z0.Re + z0.Im;
+	out[0].Im = 0.0;
+	out[h].Re = z0.Re - z0.Im;
+	out[h].Im = 0.0;
+
+	for (unsigned k = 1; k <= h / 2; k++)
+	{
+		DComp a = z[k];
+		DComp b = z[h - k];
+		// even part e = (a + conj(b))/2, odd part o = (a - conj(b))/(2i)
+		double er = 0.5*(a.Re + b.Re);
+		double ei = 0.5*(a.Im - b.Im);
+		double or_ = 0.5*(a.Im + b.Im);
+		double oi = -0.5*(a.Re - b.Re);
+		const DComp& w = m_realTwiddles[k];
+		double tr = w.Re*or_ - w.Im*oi;
+		double ti = w.Re*oi + w.Im*or_;
+		// X[k] = e + w*o, X[h - k] = conj(e - w*o)
+		out[k].Re = er + tr;
+		out[k].Im = ei + ti;
+		out[h - k].Re = er - tr;
+		out[h - k].Im = -(ei - ti);
+	}
+}
+
+// z receives the half-size spectrum whose inverse holds the even samples in Re and the odd samples in Im
+void FFTPlan::_realInverse(const DComp* in, DComp* z) const
+{
+	unsigned h = m_n / 2;
+	{
+		DComp a = in[0];
+		DComp b = in[h];
+		// e = (a + conj(b))/2, o = (a - conj(b))/2, z = e + i*o
+		double er = 0.5*(a.Re + b.Re);
+		double ei = 0.5*(a.Im - b.Im);
+		double or_ = 0.5*(a.Re - b.Re);
+		double oi = 0.5*(a.Im + b.Im);
+		z[0].Re = er - oi;
+		z[0].Im = ei + or_;
+	}
+
+	for (unsigned k = 1; k <= h / 2; k++)
+	{
+		DComp a = in[k];
+		DComp b = in[h - k];
+		double er = 0.5*(a.Re + b.Re);
+		double ei = 0.5*(a.Im - b.Im);
+		double dr = 0.5*(a.Re - b.Re);
+		double di = 0.5*(a.Im + b.Im);
+		// o = d*conj(w)
+		const DComp& w = m_realTwiddles[k];
+		double or_ = dr*w.Re + di*w.Im;
+		double oi = di*w.Re - dr*w.Im;
+		// z[k] = e + i*o, z[h - k] = conj(e) + i*conj(o)
+		z[k].Re = er - oi;
+		z[k].Im = ei + or_;
+		z[h - k].Re = er + oi;
+		z[h - k].Im = -ei + or_;
+	}
+}
+
+void FFTPlan::RealForward(const double* in, DComp* out) const
+{
+	if (m_l == 0)
+	{
+		out[0].Re = in[0];
+		out[0].Im = 0.0;
+		return;
+	}
+	unsigned h = m_n / 2;
+	for (unsigned k = 0; k < h; k++)
+	{
+		out[k].Re = in[2 * k];
+		out[k].Im = in[2 * k + 1];
+	}
+	m_half->Forward(out);
+	_realForward(out, out);
+}
+
+void FFTPlan::RealForward(const float* in, DComp* out) const
+{
+	if (m_l == 0)
+	{
+		out[0].Re = (double)in[0];
+		out[0].Im = 0.0;
+		return;
+	}
+	unsigned h = m_n / 2;
+	for (unsigned k = 0; k < h; k++)
+	{
+		out[k].Re = (double)in[2 * k];
+		out[k].Im = (double)in[2 * k + 1];
+	}
+	m_half->Forward(out);
+	_realForward(out, out);
+}
+
+void FFTPlan::RealInverse(const DComp* in, double* out) const
+{
+	if (m_l == 0)
+	{
+		out[0] = in[0].Re;
+		return;
+	}
+	unsigned h = m_n / 2;
+	if (t_internalScratch.size() < h) t_internalScratch.resize(h);
+	DComp* z = t_internalScratch.data();
+	_realInverse(in, z);
+	m_half->Inverse(z);
+	for (unsigned k = 0; k < h; k++)
+	{
+		out[2 * k] = z[k].Re;
+		out[2 * k + 1] = z[k].Im;
+	}
+}
+
+void FFTPlan::RealInverse(const DComp* in, float* out) const
+{
+	if (m_l == 0)
+	{
+		out[0] = (float)in[0].Re;
+		return;
+	}
+	unsigned h = m_n / 2;
+	if (t_internalScratch.size() < h) t_internalScratch.resize(h);
+	DComp* z = t_internalScratch.data();
+	_realInverse(in, z);
+	m_half->Inverse(z);
+	for (unsigned k = 0; k < h; k++)
+	{
+		out[2 * k] = (float)z[k].Re;
+		out[2 * k + 1] = (float)z[k].Im;
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef _FFTPlan_h
+#define _FFTPlan_h
+
+#include "fft.h"
+
+/*
+	Radix-2 FFT of 2^l points with its twiddle factors and bit-reversal table
+	computed once. Plans are created on first use and shared by all threads.
+
+	Forward()/Inverse() give the same results as fft()/ifft(). The real transforms
+	run a complex transform of half the size, so they are about twice as fast, but
+	round slightly differently.
+*/
+class FFTPlan
+{
+public:
+	static const FFTPlan& Get(unsigned l);
+
+	unsigned Log2Size() const { return m_l; }
+	unsigned Size() const { return m_n; }
+
+	// in-place complex transforms, Inverse() includes the 1/Size() scaling
+	void Forward(DComp* a) const;
+	void Inverse(DComp* a) const;
+
+	// Size() real samples to the Size()/2 + 1 non-redundant bins
+	void RealForward(const double* in, DComp* out) const;
+	void RealForward(const float* in, DComp* out) const;
+
+	// Size()/2 + 1 bins of a hermitian spectrum to Size() real samples, with the 1/Size() scaling
+	void RealInverse(const DComp* in, double* out) const;
+	void RealInverse(const DComp* in, float* out) const;
+
+	// per-thread buffers for the callers, so they don't allocate for each transform
+	// each stays valid until it is requested again on the same thread
+	static DComp* ComplexScratch(unsigned count);
+	static double* RealScratch(unsigned count);
+
+	~FFTPlan();
+
+private:
+	FFTPlan(unsigned l);
+
+	void _bitReverse(DComp* a) const;
+	void _realForward(DComp* z, DComp* out) const;
+	void _realInverse(const DComp* in, DComp* z) const;
+
+	unsigned m_l;
+	unsigned m_n;
+	unsigned* m_bitrev;
+	DComp* m_twiddles;		// twiddles of the stage of half-length le are at [le - 1, 2*le - 1)
+	DComp* m_realTwiddles;	// exp(-2*PI*i*k/Size()), k in [0, Size()/4]
+	const FFTPlan* m_half;
+
+	FFTPlan(const FFTPlan &);
+	FFTPlan &operator=(const FFTPlan &);
+};
+
+#endif
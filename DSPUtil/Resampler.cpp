@@ -0,0 +1,313 @@
+#include "Resampler.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DSPUTIL_RESAMPLER_SSE
+#include <emmintrin.h>
+#endif
+
+// frames rendered before the gains of the block are applied
+static const unsigned s_blockSize = 256;
+
+Resampler::Resampler(const float* samples, unsigned length, unsigned chn)
+	: m_samples(samples), m_pcm(nullptr), m_length(length), m_chn(chn)
+{
+}
+
+Resampler::Resampler(const short* samples, unsigned length, unsigned chn)
+	: m_samples(nullptr), m_pcm(samples), m_length(length), m_chn(chn)
+{
+}
+
+unsigned Resampler::MaxFrames(double step) const
+{
+	return (unsigned)((double)m_length / step);
+}
+
+/*
+	Catmull-Rom interpolation of p1..p2 at frac, in Horner form
+*/
+static inline float Cubic(float p0, float p1, float p2, float p3, float frac)
+{
+	float a = -0.5f*p0 + 1.5f*p1 - 1.5f*p2 + 0.5f*p3;
+	float b = p0 - 2.5f*p1 + 2.0f*p2 - 0.5f*p3;
+	float c = -0.5f*p0 + 0.5f*p2;
+	return ((a*frac + b)*frac + c)*frac + p1;
+}
+
+#ifdef DSPUTIL_RESAMPLER_SSE
+static inline __m128 Cubic(__m128 p0, __m128 p1, __m128 p2, __m128 p3, __m128 frac)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 one_half = _mm_set1_ps(1.5f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 two_half = _mm_set1_ps(2.5f);
+
+	__m128 h0 = _mm_mul_ps(half, p0);
+	__m128 h3 = _mm_mul_ps(half, p3);
+	__m128 a = _mm_add_ps(_mm_sub_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), h0), _mm_mul_ps(one_half, p1)), _mm_mul_ps(one_half, p2)), h3);
+	__m128 b = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(p0, _mm_mul_ps(two_half, p1)), _mm_mul_ps(two, p2)), h3);
+	__m128 c = _mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), h0), _mm_mul_ps(half, p2));
+	__m128 v = _mm_add_ps(_mm_mul_ps(a, frac), b);
+	v = _mm_add_ps(_mm_mul_ps(v, frac), c);
+	return _mm_add_ps(_mm_mul_ps(v, frac), p1);
+}
+#endif
+
+struct CubicTaps
+{
+	int ipos[4];
+	float frac;
+};
+
+static inline void GetTaps(double pos, int length, CubicTaps& taps)
+{
+	int ipos1 = (int)pos;
+	if (ipos1 > length - 1) ipos1 = length - 1;
+	taps.frac = (float)(pos - (double)ipos1);
+	taps.ipos[0] = ipos1 > 0 ? ipos1 - 1 : 0;
+	taps.ipos[1] = ipos1;
+	taps.ipos[2] = ipos1 + 1 < length ? ipos1 + 1 : length - 1;
+	taps.ipos[3] = ipos1 + 2 < length ? ipos1 + 2 : length - 1;
+}
+
+/*
+	Kernels writing frames [start, start+count) unscaled, "Chn" is 0 for a channel count
+	only known at run-time. "T" is float or short, shorts are scaled with the gains.
+*/
+template <unsigned Chn, class T>
+static void Interpolate(const T* src, int length, unsigned chnArg, double step, float* dst, unsigned start, unsigned count)
+{
+	const unsigned chn = Chn > 0 ? Chn : chnArg;
+	unsigned j = 0;
+
+#ifdef DSPUTIL_RESAMPLER_SSE
+	if (Chn == 1)
+	{
+		for (; j + 4 <= count; j += 4)
+		{
+			CubicTaps t[4];
+			for (unsigned k = 0; k < 4; k++)
+				GetTaps((double)(start + j + k)*step, length, t[k]);
+
+			__m128 p0 = _mm_setr_ps(src[t[0].ipos[0]], src[t[1].ipos[0]], src[t[2].ipos[0]], src[t[3].ipos[0]]);
+			__m128 p1 = _mm_setr_ps(src[t[0].ipos[1]], src[t[1].ipos[1]], src[t[2].ipos[1]], src[t[3].ipos[1]]);
+			__m128 p2 = _mm_setr_ps(src[t[0].ipos[2]], src[t[1].ipos[2]], src[t[2].ipos[2]], src[t[3].ipos[2]]);
+			__m128 p3 = _mm_setr_ps(src[t[0].ipos[3]], src[t[1].ipos[3]], src[t[2].ipos[3]], src[t[3].ipos[3]]);
+			__m128 frac = _mm_setr_ps(t[0].frac, t[1].frac, t[2].frac, t[3].frac);
+			_mm_storeu_ps(dst + j, Cubic(p0, p1, p2, p3, frac));
+		}
+	}
+	else if (Chn == 2)
+	{
+		for (; j + 2 <= count; j += 2)
+		{
+			CubicTaps t[2];
+			GetTaps((double)(start + j)*step, length, t[0]);
+			GetTaps((double)(start + j + 1)*step, length, t[1]);
+
+			__m128 p[4];
+			for (unsigned i = 0; i < 4; i++)
+			{
+				const T* f0 = src + t[0].ipos[i] * 2;
+				const T* f1 = src + t[1].ipos[i] * 2;
+				p[i] = _mm_setr_ps((float)f0[0], (float)f0[1], (float)f1[0], (float)f1[1]);
+			}
+			__m128 frac = _mm_setr_ps(t[0].frac, t[0].frac, t[1].frac, t[1].frac);
+			_mm_storeu_ps(dst + j * 2, Cubic(p[0], p[1], p[2], p[3], frac));
+		}
+	}
+#endif
+
+	for (; j < count; j++)
+	{
+		CubicTaps t;
+		GetTaps((double)(start + j)*step, length, t);
+		for (unsigned c = 0; c < chn; c++)
+		{
+			dst[j*chn + c] = Cubic(src[t.ipos[0] * chn + c], src[t.ipos[1] * chn + c],
+				src[t.ipos[2] * chn + c], src[t.ipos[3] * chn + c], t.frac);
+		}
+	}
+}
+
+template <unsigned Chn, class T>
+static void Decimate(const T* src, int length, unsigned chnArg, double step, float* dst, unsigned start, unsigned count)
+{
+	const unsigned chn = Chn > 0 ? Chn : chnArg;
+	for (unsigned j = 0; j < count; j++)
+	{
+		double center = (double)(start + j);
+		int ipos1 = (int)ceil((center - 0.5)*step);
+		int ipos2 = (int)floor((center + 0.5)*step);
+		if (ipos1 < 0) ipos1 = 0;
+		if (ipos2 > length - 1) ipos2 = length - 1;
+		if (ipos1 > ipos2) ipos1 = ipos2;
+		float scale = 1.0f / (float)(ipos2 - ipos1 + 1);
+
+		for (unsigned c = 0; c < chn; c++)
+		{
+			float sum = 0.0f;
+			for (int ipos = ipos1; ipos <= ipos2; ipos++)
+				sum += (float)src[ipos*chn + c];
+			dst[j*chn + c] = sum*scale;
+		}
+	}
+}
+
+/*
+	Gains of frames [start, start+count): gain*(1 - exp((j/releaseLength - 1)*10)).
+	exp((j/releaseLength - 1)*10) is a geometric series in j, so it is stepped in double
+	instead of calling exp() for every frame.
+*/
+class ReleaseGains
+{
+public:
+	ReleaseGains(float gain, float releaseLength) : m_gain(gain), m_enabled(releaseLength > 0.0f)
+	{
+		if (m_enabled)
+		{
+			m_decay = exp(-10.0);
+			m_ratio = exp(10.0 / (double)releaseLength);
+		}
+	}
+
+	void Next(float* gains, unsigned count)
+	{
+		if (!m_enabled)
+		{
+			for (unsigned j = 0; j < count; j++) gains[j] = m_gain;
+			return;
+		}
+		for (unsigned j = 0; j < count; j++)
+		{
+			gains[j] = m_gain*(float)(1.0 - m_decay);
+			m_decay *= m_ratio;
+		}
+	}
+
+private:
+	float m_gain;
+	bool m_enabled;
+	double m_decay;
+	double m_ratio;
+};
+
+template <unsigned Chn>
+static void Scale(float* data, unsigned chnArg, const float* gains, unsigned count)
+{
+	const unsigned chn = Chn > 0 ? Chn : chnArg;
+	unsigned j = 0;
+#ifdef DSPUTIL_RESAMPLER_SSE
+	if (Chn == 1)
+	{
+		for (; j + 4 <= count; j += 4)
+			_mm_storeu_ps(data + j, _mm_mul_ps(_mm_loadu_ps(data + j), _mm_loadu_ps(gains + j)));
+	}
+	else if (Chn == 2)
+	{
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128 g = _mm_loadu_ps(gains + j);
+			float* d = data + j * 2;
+			_mm_storeu_ps(d, _mm_mul_ps(_mm_loadu_ps(d), _mm_unpacklo_ps(g, g)));
+			_mm_storeu_ps(d + 4, _mm_mul_ps(_mm_loadu_ps(d + 4), _mm_unpackhi_ps(g, g)));
+		}
+	}
+#endif
+	for (; j < count; j++)
+		for (unsigned c = 0; c < chn; c++)
+			data[j*chn + c] *= gains[j];
+}
+
+enum ResampleMode
+{
+	Copy,
+	CubicInterpolation,
+	BoxDecimation
+};
+
+template <unsigned Chn, ResampleMode Mode, class T>
+static void Render(const T* src, int length, unsigned chnArg, double step, float* dst, unsigned count, float gain, float releaseLength)
+{
+	const unsigned chn = Chn > 0 ? Chn : chnArg;
+	ReleaseGains release(gain, releaseLength);
+	float gains[s_blockSize];
+
+	for (unsigned start = 0; start < count; start += s_blockSize)
+	{
+		unsigned n = count - start < s_blockSize ? count - start : s_blockSize;
+		float* block = dst + start*chn;
+
+		if (Mode == Copy)
+		{
+			unsigned copy = start >= (unsigned)length ? 0 : ((unsigned)length - start < n ? (unsigned)length - start : n);
+			const T* from = src + start*chn;
+			for (unsigned i = 0; i < copy*chn; i++)
+				block[i] = (float)from[i];
+			memset(block + copy*chn, 0, sizeof(float)*(n - copy)*chn);
+		}
+		else if (Mode == CubicInterpolation)
+			Interpolate<Chn, T>(src, length, chn, step, block, start, n);
+		else
+			Decimate<Chn, T>(src, length, chn, step, block, start, n);
+
+		release.Next(gains, n);
+		Scale<Chn>(block, chn, gains, n);
+	}
+}
+
+template <ResampleMode Mode, class T>
+static void Render(const T* src, int length, unsigned chn, double step, float* dst, unsigned count, float gain, float releaseLength)
+{
+	if (chn == 1)
+		Render<1, Mode, T>(src, length, chn, step, dst, count, gain, releaseLength);
+	else if (chn == 2)
+		Render<2, Mode, T>(src, length, chn, step, dst, count, gain, releaseLength);
+	else
+		Render<0, Mode, T>(src, length, chn, step, dst, count, gain, releaseLength);
+}
+
+template <class T>
+static void Render(const T* src, int length, unsigned chn, double step, float* dst, unsigned count, float gain, float releaseLength)
+{
+	if (step == 1.0)
+		Render<Copy, T>(src, length, chn, step, dst, count, gain, releaseLength);
+	else if (step < 1.0)
+		Render<CubicInterpolation, T>(src, length, chn, step, dst, count, gain, releaseLength);
+	else
+		Render<BoxDecimation, T>(src, length, chn, step, dst, count, gain, releaseLength);
+}
+
+void Resampler::Render(float* dst, unsigned count, double step, float gain, float releaseLength) const
+{
+	if (m_length == 0 || m_chn == 0)
+	{
+		memset(dst, 0, sizeof(float)*count*m_chn);
+		return;
+	}
+
+	if (m_pcm != nullptr)
+		::Render(m_pcm, (int)m_length, m_chn, step, dst, count, gain / 32767.0f, releaseLength);
+	else
+		::Render(m_samples, (int)m_length, m_chn, step, dst, count, gain, releaseLength);
+}
+
+void Resampler::ApplyRelease(float* data, unsigned count, unsigned chn, float releaseLength)
+{
+	ReleaseGains release(1.0f, releaseLength);
+	float gains[s_blockSize];
+
+	for (unsigned start = 0; start < count; start += s_blockSize)
+	{
+		unsigned n = count - start < s_blockSize ? count - start : s_blockSize;
+		release.Next(gains, n);
+		if (chn == 1)
+			Scale<1>(data + start, chn, gains, n);
+		else if (chn == 2)
+			Scale<2>(data + start * 2, chn, gains, n);
+		else
+			Scale<0>(data + start*chn, chn, gains, n);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef _Resampler_h
+#define _Resampler_h
+
+/*
+	Resampling of the instrument and percussion samples, with the kernels specialized
+	for mono and stereo and written with SSE2 where available.
+
+	Frame j of the output reads the source at position j*step: below a step of 1
+	(the note is lower than the sample, or the output rate higher) the source is
+	interpolated with a Catmull-Rom cubic, above it each frame is the average of
+	the source frames it covers, and a step of exactly 1 copies the source.
+*/
+class Resampler
+{
+public:
+	// "length" frames of "chn" interleaved channels, not copied
+	Resampler(const float* samples, unsigned length, unsigned chn);
+
+	// 16-bit PCM, read as samples/32767, converted only where it is read
+	Resampler(const short* samples, unsigned length, unsigned chn);
+
+	// number of output frames before the end of the source is reached
+	unsigned MaxFrames(double step) const;
+
+	/*
+		Writes "count" frames to dst, each scaled by "gain" and, when releaseLength > 0,
+		by the release envelope of the samplers: 1 - exp((j/releaseLength - 1)*10)
+	*/
+	void Render(float* dst, unsigned count, double step, float gain, float releaseLength = 0.0f) const;
+
+	// multiplies "count" frames of "chn" channels by the release envelope above
+	static void ApplyRelease(float* data, unsigned count, unsigned chn, float releaseLength);
+
+private:
+	const float* m_samples;
+	const short* m_pcm;
+	unsigned m_length;
+	unsigned m_chn;
+};
+
+#endif
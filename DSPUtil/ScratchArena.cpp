@@ -0,0 +1,168 @@
+#include "ScratchArena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <new>
+
+static const unsigned s_minClass = 6;	// 64 bytes
+static const unsigned s_maxClass = 20;	// 1MB, larger blocks come from the heap
+static const size_t s_chunkSize = (size_t)1 << s_maxClass;
+static const size_t s_maxKeptChunks = 64; // memory kept for the next sentence
+
+struct ArenaState;
+
+// precedes every block, keeps the payload 16-byte aligned
+struct BlockHeader
+{
+	ArenaState* owner;	// nullptr for heap blocks
+	uint32_t sizeClass;
+	uint32_t generation;
+};
+
+static_assert(sizeof(BlockHeader) <= 16, "BlockHeader must fit in 16 bytes");
+static const size_t s_headerSize = 16;
+
+struct ArenaState
+{
+	unsigned depth;
+	unsigned suspended;
+	uint32_t generation;
+
+	std::vector<char*> chunks;
+	unsigned curChunk;
+	size_t chunkUsed;
+	void* freeLists[s_maxClass + 1];
+
+	ArenaState() : depth(0), suspended(0), generation(0), curChunk(0), chunkUsed(0)
+	{
+		_clearFreeLists();
+	}
+
+	~ArenaState()
+	{
+		for (size_t i = 0; i < chunks.size(); i++)
+			free(chunks[i]);
+	}
+
+	void Reset()
+	{
+		generation++;
+		_clearFreeLists();
+		while (chunks.size() > s_maxKeptChunks)
+		{
+			free(chunks.back());
+			chunks.pop_back();
+		}
+		curChunk = 0;
+		chunkUsed = 0;
+	}
+
+	char* Carve(size_t blockSize)
+	{
+		while (curChunk < (unsigned)chunks.size() && chunkUsed + blockSize > s_chunkSize)
+		{
+			curChunk++;
+			chunkUsed = 0;
+		}
+		if (curChunk == (unsigned)chunks.size())
+		{
+			char* chunk = (char*)malloc(s_chunkSize);
+			if (chunk == nullptr) return nullptr;
+			chunks.push_back(chunk);
+			chunkUsed = 0;
+		}
+		char* block = chunks[curChunk] + chunkUsed;
+		chunkUsed += blockSize;
+		return block;
+	}
+
+private:
+	void _clearFreeLists()
+	{
+		for (unsigned i = 0; i <= s_maxClass; i++)
+			freeLists[i] = nullptr;
+	}
+};
+
+static thread_local ArenaState t_arena;
+
+ScratchArena::Scope::Scope()
+{
+	t_arena.depth++;
+}
+
+ScratchArena::Scope::~Scope()
+{
+	if (--t_arena.depth == 0) t_arena.Reset();
+}
+
+ScratchArena::Suspend::Suspend()
+{
+	t_arena.suspended++;
+}
+
+ScratchArena::Suspend::~Suspend()
+{
+	t_arena.suspended--;
+}
+
+bool ScratchArena::IsActive()
+{
+	return t_arena.depth > 0 && t_arena.suspended == 0;
+}
+
+static void* HeapAllocate(size_t size)
+{
+	char* block = (char*)malloc(s_headerSize + size);
+	if (block == nullptr) throw std::bad_alloc();
+	BlockHeader* header = (BlockHeader*)block;
+	header->owner = nullptr;
+	header->sizeClass = 0;
+	header->generation = 0;
+	return block + s_headerSize;
+}
+
+void* ScratchArena::Allocate(size_t size)
+{
+	ArenaState& arena = t_arena;
+	if (arena.depth == 0 || arena.suspended > 0 || s_headerSize + size > s_chunkSize)
+		return HeapAllocate(size);
+
+	unsigned sizeClass = s_minClass;
+	while (((size_t)1 << sizeClass) < s_headerSize + size) sizeClass++;
+
+	char* block = (char*)arena.freeLists[sizeClass];
+	if (block != nullptr)
+	{
+		arena.freeLists[sizeClass] = *(void**)(block + s_headerSize);
+	}
+	else
+	{
+		block = arena.Carve((size_t)1 << sizeClass);
+		if (block == nullptr) throw std::bad_alloc();
+	}
+
+	BlockHeader* header = (BlockHeader*)block;
+	header->owner = &arena;
+	header->sizeClass = sizeClass;
+	header->generation = arena.generation;
+	return block + s_headerSize;
+}
+
+void ScratchArena::Free(void* p)
+{
+	if (p == nullptr) return;
+	char* block = (char*)p - s_headerSize;
+	BlockHeader* header = (BlockHeader*)block;
+	if (header->owner == nullptr)
+	{
+		free(block);
+		return;
+	}
+
+	// blocks of another thread are dropped, their memory comes back when the owning pool is reset
+	ArenaState& arena = t_arena;
+	if (header->owner != &arena || header->generation != arena.generation) return;
+	*(void**)p = arena.freeLists[header->sizeClass];
+	arena.freeLists[header->sizeClass] = block;
+}
@@ -0,0 +1,73 @@
+#ifndef _ScratchArena_h
+#define _ScratchArena_h
+
+#include <stddef.h>
+
+/*
+	Per-thread pool for the short-lived DSP objects of a sentence.
+	While a Scope is alive on a thread, ScratchAllocator allocations of that thread are
+	carved from chunks owned by the thread, and freed blocks are kept on per-size free
+	lists for the next allocation. When the outermost Scope ends, the whole pool is reset
+	in one step and its chunks are kept for the next sentence.
+	Outside of any Scope, or inside a Suspend, the allocations come from the heap.
+
+	Everything allocated inside a Scope must be released before the Scope ends. Objects
+	that outlive it, like cached analyses, have to be created inside a Suspend.
+*/
+class ScratchArena
+{
+public:
+	class Scope
+	{
+	public:
+		Scope();
+		~Scope();
+	private:
+		Scope(const Scope &);
+		Scope &operator=(const Scope &);
+	};
+
+	class Suspend
+	{
+	public:
+		Suspend();
+		~Suspend();
+	private:
+		Suspend(const Suspend &);
+		Suspend &operator=(const Suspend &);
+	};
+
+	static void* Allocate(size_t size);
+	static void Free(void* p);
+
+	// whether allocations of the calling thread currently come from the pool
+	static bool IsActive();
+};
+
+template <class T>
+class ScratchAllocator
+{
+public:
+	typedef T value_type;
+
+	ScratchAllocator() {}
+	template <class U> ScratchAllocator(const ScratchAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		return (T*)ScratchArena::Allocate(n*sizeof(T));
+	}
+
+	void deallocate(T* p, size_t)
+	{
+		ScratchArena::Free(p);
+	}
+};
+
+template <class T, class U>
+inline bool operator==(const ScratchAllocator<T>&, const ScratchAllocator<U>&) { return true; }
+
+template <class T, class U>
+inline bool operator!=(const ScratchAllocator<T>&, const ScratchAllocator<U>&) { return false; }
+
+#endif
@@ -9,8 +9,10 @@
 #include <vector>
 #include <ReadWav.h>
 #include <WriteWav.h>
-#include "fft.h"
+#include "FFTPlan.h"
+#include "ScratchArena.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <memory.h>
 #include <cmath>
 #include <float.h>
@@ -37,6 +39,34 @@ inline float randGauss(float sd)
 	return sd*sqrtf(-2.0f*logf(rand01()))*cosf(rand01()*(float)PI);
 }
 
+// Deterministic replacement of rand01(), a generator is seeded for each grain, so a grain
+// doesn't depend on what was synthesized before it, or on which thread it is made.
+class NoiseRandom
+{
+public:
+	NoiseRandom(uint32_t seed, uint32_t stream)
+	{
+		// murmur3 finalizer, so that neighbouring streams start far apart
+		uint32_t h = seed ^ (stream * 0x9E3779B9u);
+		h ^= h >> 16; h *= 0x85EBCA6Bu;
+		h ^= h >> 13; h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		m_state = h;
+	}
+
+	float Rand01()
+	{
+		m_state = m_state * 1664525u + 1013904223u;
+		float f = (float)(m_state >> 8) / 16777216.0f;
+		if (f < 0.0000001f) f = 0.0000001f;
+		if (f > 0.9999999f) f = 0.9999999f;
+		return f;
+	}
+
+private:
+	uint32_t m_state;
+};
+
 
 
 namespace VoiceUtil
@@ -117,12 +147,15 @@ namespace VoiceUtil
 		writer.WriteSamples(buf.m_data.data(), numSamples, volume);
 	}
 
+	// storage of windows and spectra, from the ScratchArena of the thread when one is active
+	typedef std::vector<float, ScratchAllocator<float> > ScratchVector;
+
 	class AmpSpectrum;
 	class Window
 	{
 	public:
 		float m_halfWidth;
-		std::vector<float> m_data;
+		ScratchVector m_data;
 
 		void Allocate(float halfWidth)
 		{
@@ -163,7 +196,7 @@ namespace VoiceUtil
 			}
 		}
 
-		void MergeToBuffer(Buffer& buf, float pos)
+		void MergeToBuffer(Buffer& buf, float pos) const
 		{
 			int ipos = (int)floorf(pos);
 			unsigned u_halfWidth = GetHalfWidthOfData();
@@ -288,7 +321,8 @@ namespace VoiceUtil
 			}
 		}
 
-		inline void CreateFromAmpSpec_noise(const AmpSpectrum& src, float targetHalfWidth=-1.0f);
+		// random phases from rng when given, otherwise from rand01()
+		inline void CreateFromAmpSpec_noise(const AmpSpectrum& src, float targetHalfWidth = -1.0f, NoiseRandom* rng = nullptr);
 
 	};
 
@@ -296,7 +330,7 @@ namespace VoiceUtil
 	{
 	public:
 		float m_halfWidth;
-		std::vector<float> m_data;
+		ScratchVector m_data;
 
 		void Allocate(float halfWidth)
 		{
@@ -312,7 +346,7 @@ namespace VoiceUtil
 			memset(m_data.data(), 0, sizeof(float)*m_data.size());
 		}
 
-		bool NonZero()
+		bool NonZero() const
 		{
 			for (unsigned i = 1; i < (unsigned)m_data.size(); i++)
 				if (m_data[i] != 0.0f) return true;
@@ -343,26 +377,27 @@ namespace VoiceUtil
 				l_scaled.Scale(src, fLen);
 			}
 
-			DComp* fftBuf = new DComp[fftLen];
-			memset(fftBuf, 0, sizeof(DComp)*fftLen);
+			const FFTPlan& plan = FFTPlan::Get(l);
+			double* fftIn = FFTPlan::RealScratch(fftLen);
+			DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
 
 			for (unsigned i = 0; i < fftLen; i++)
 			{
-				fftBuf[i].Re = (double)scaled->GetSample((int)i) + (double)scaled->GetSample((int)i - (int)fftLen);
+				fftIn[i] = (double)scaled->GetSample((int)i) + (double)scaled->GetSample((int)i - (int)fftLen);
 			}
 
-			fft(fftBuf, l);
+			plan.RealForward(fftIn, fftBuf);
 
 			float rate = m_halfWidth / fLen;
 			m_data.resize((unsigned)ceilf(m_halfWidth*0.5f));
 			for (unsigned i = 0; i < (unsigned)m_data.size(); i++)
 			{
+				// bins above fftLen/2 mirror the lower ones
 				if (i >= fftLen)
 					m_data[i] = 0.0f;
 				else
-					m_data[i] = (float)DCAbs(&fftBuf[i])*rate;
+					m_data[i] = (float)DCAbs(&fftBuf[i <= fftLen / 2 ? i : fftLen - i])*rate;
 			}
-			delete[] fftBuf;
 		}
 
 		void Interpolate(const AmpSpectrum& spec0, const AmpSpectrum& spec1, float k, float targetHalfWidth)
@@ -438,7 +473,7 @@ namespace VoiceUtil
 
 	};
 
-	void Window::CreateFromAmpSpec_noise(const AmpSpectrum& src, float targetHalfWidth)
+	void Window::CreateFromAmpSpec_noise(const AmpSpectrum& src, float targetHalfWidth, NoiseRandom* rng)
 	{
 		unsigned l = 0;
 		unsigned fftLen = 1;
@@ -448,8 +483,9 @@ namespace VoiceUtil
 			fftLen <<= 1;
 		}
 
-		DComp* fftBuf = new DComp[fftLen];
-		memset(fftBuf, 0, sizeof(DComp)*fftLen);
+		const FFTPlan& plan = FFTPlan::Get(l);
+		DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
+		memset(fftBuf, 0, sizeof(DComp)*(fftLen / 2 + 1));
 
 		float rate = (float)fftLen / src.m_halfWidth;
 
@@ -457,20 +493,17 @@ namespace VoiceUtil
 		{
 			if (i < fftLen / 2)
 			{
-				float angle = (float)rand01()*(float)PI*2.0f;
+				float angle = (rng != nullptr ? rng->Rand01() : rand01())*(float)PI*2.0f;
 				float re = src.m_data[i] * cosf(angle) * rate;
 				float im = src.m_data[i] * sinf(angle) * rate;
 
 				fftBuf[i].Re = (double)re;
 				fftBuf[i].Im = (double)im;
-
-				fftBuf[fftLen - i].Re = (double)re;
-				fftBuf[fftLen - i].Im = -(double)im;
-				
 			}
 		}
 
-		ifft(fftBuf, l);
+		double* fftOut = FFTPlan::RealScratch(fftLen);
+		plan.RealInverse(fftBuf, fftOut);
 
 		Window tempWin;
 		tempWin.m_halfWidth = (float)fftLen;
@@ -479,11 +512,10 @@ namespace VoiceUtil
 		for (unsigned i = 0; i < fftLen; i++)
 		{
 			float window = (cosf((float)i * (float)PI / tempWin.m_halfWidth) + 1.0f)*0.5f;
-			tempWin.m_data[i] = window*(float)fftBuf[i].Re;
+			tempWin.m_data[i] = window*(float)fftOut[i];
 			if (i>0)
-				tempWin.m_data[fftLen * 2 - i] = window*(float)fftBuf[fftLen - i].Re;
+				tempWin.m_data[fftLen * 2 - i] = window*(float)fftOut[fftLen - i];
 		}
-		delete[] fftBuf;
 
 		this->Scale(tempWin, targetHalfWidth>0.0f ? targetHalfWidth: src.m_halfWidth);
 
@@ -492,7 +524,7 @@ namespace VoiceUtil
 	class SymmetricWindow_Base : public Window
 	{
 	public:
-		bool NonZero()
+		bool NonZero() const
 		{
 			for (unsigned i = 0; i < (unsigned)m_data.size(); i++)
 				if (m_data[i] != 0.0f) return true;
@@ -612,15 +644,16 @@ namespace VoiceUtil
 				fftLen <<= 1;
 			}
 
-			DComp* fftBuf = new DComp[fftLen];
-			memset(fftBuf, 0, sizeof(DComp)*fftLen);
+			const FFTPlan& plan = FFTPlan::Get(l);
+			double* fftIn = FFTPlan::RealScratch(fftLen);
+			DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
 
 			for (unsigned i = 0; i < fftLen; i++)
 			{
-				fftBuf[i].Re = (double)src.GetSample((int)i) + (double)src.GetSample((int)i - (int)fftLen);
+				fftIn[i] = (double)src.GetSample((int)i) + (double)src.GetSample((int)i - (int)fftLen);
 			}
 
-			fft(fftBuf, l);
+			plan.RealForward(fftIn, fftBuf);
 
 			fftBuf[0].Re = 0.0f;
 			fftBuf[0].Im = 0.0f;
@@ -633,18 +666,17 @@ namespace VoiceUtil
 
 				fftBuf[i].Re = absv;
 				fftBuf[i].Im = 0.0f;
-				fftBuf[fftLen-i].Re = absv;
-				fftBuf[fftLen-i].Im = 0.0f;
 			}
 
-			ifft(fftBuf, l);
+			// the input is no longer needed, so the scratch is reused for the output
+			plan.RealInverse(fftBuf, fftIn);
 
 			m_data.resize(fftLen);
 			m_halfWidth = (float)(fftLen);
 			float rate = m_halfWidth /  src.m_halfWidth;
 
 			for (unsigned i = 0; i < fftLen; i++)
-				m_data[i] = (float)fftBuf[i].Re;
+				m_data[i] = (float)fftIn[i];
 
 		
 			// rewindow
@@ -655,18 +687,20 @@ namespace VoiceUtil
 				m_data[i] *= window*amplitude;
 			}
 
-			delete[] fftBuf;
-
 		}
 
 		void Repitch_FormantPreserved(const SymmetricWindow_Axis& src, float targetHalfWidth)
+		{
+			Repitch_FormantPreserved(src.m_data.data(), src.GetHalfWidthOfData(), src.m_halfWidth, targetHalfWidth);
+		}
+
+		// same, from the samples of a window stored elsewhere
+		void Repitch_FormantPreserved(const float* srcData, unsigned uSrcHalfWidth, float srcHalfWidth, float targetHalfWidth)
 		{
 			m_halfWidth = targetHalfWidth;
 			unsigned u_TargetHalfWidth = (unsigned)ceilf(targetHalfWidth);
 			m_data.resize(u_TargetHalfWidth);
 
-			float srcHalfWidth = src.m_halfWidth;
-			unsigned uSrcHalfWidth = src.GetHalfWidthOfData();
 			float rate = targetHalfWidth / srcHalfWidth;
 
 			float targetWidth = targetHalfWidth*2.0f;
@@ -680,7 +714,7 @@ namespace VoiceUtil
 
 				while (uSrcPos < uSrcHalfWidth)
 				{
-					m_data[i] += src.m_data[uSrcPos];
+					m_data[i] += srcData[uSrcPos];
 					srcPos += targetHalfWidth;
 					uSrcPos = (unsigned)(srcPos + 0.5f);
 				}
@@ -690,7 +724,7 @@ namespace VoiceUtil
 
 				while (uSrcPos < uSrcHalfWidth)
 				{
-					m_data[i] += src.m_data[uSrcPos];	
+					m_data[i] += srcData[uSrcPos];	
 					srcPos += targetHalfWidth;
 					uSrcPos = (unsigned)(srcPos + 0.5f);
 				}
@@ -715,8 +749,9 @@ namespace VoiceUtil
 				fftLen <<= 1;
 			}
 
-			DComp* fftBuf = new DComp[fftLen];
-			memset(fftBuf, 0, sizeof(DComp)*fftLen);
+			const FFTPlan& plan = FFTPlan::Get(l);
+			DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
+			memset(fftBuf, 0, sizeof(DComp)*(fftLen / 2 + 1));
 
 			float rate = (float)fftLen / src.m_halfWidth;
 
@@ -725,12 +760,11 @@ namespace VoiceUtil
 				if (i < fftLen / 2)
 				{
 					fftBuf[i].Re = src.m_data[i] * rate;
-					if (i>0)
-						fftBuf[fftLen - i].Re = src.m_data[i] * rate;
 				}
 			}
 
-			ifft(fftBuf, l);
+			double* fftOut = FFTPlan::RealScratch(fftLen);
+			plan.RealInverse(fftBuf, fftOut);
 
 			SymmetricWindow_Axis tempWin;
 			tempWin.m_halfWidth = (float)fftLen;
@@ -739,9 +773,8 @@ namespace VoiceUtil
 			for (unsigned i = 0; i < fftLen; i++)
 			{
 				float window = (cosf((float)i * (float)PI / tempWin.m_halfWidth) + 1.0f)*0.5f;
-				tempWin.m_data[i] = window*(float)fftBuf[i].Re;
+				tempWin.m_data[i] = window*(float)fftOut[i];
 			}
-			delete[] fftBuf;
 
 			this->Scale(tempWin, targetHalfWidth>0.0f ? targetHalfWidth: src.m_halfWidth);
 
@@ -792,15 +825,16 @@ namespace VoiceUtil
 				fftLen <<= 1;
 			}
 
-			DComp* fftBuf = new DComp[fftLen];
-			memset(fftBuf, 0, sizeof(DComp)*fftLen);
+			const FFTPlan& plan = FFTPlan::Get(l);
+			double* fftIn = FFTPlan::RealScratch(fftLen);
+			DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
 
 			for (unsigned i = 0; i < fftLen; i++)
 			{
-				fftBuf[i].Re = (double)src.GetSample((int)i) + (double)src.GetSample((int)i - (int)fftLen);
+				fftIn[i] = (double)src.GetSample((int)i) + (double)src.GetSample((int)i - (int)fftLen);
 			}
 
-			fft(fftBuf, l);
+			plan.RealForward(fftIn, fftBuf);
 
 			fftBuf[0].Re = 0.0f;
 			fftBuf[0].Im = 0.0f;
@@ -812,18 +846,17 @@ namespace VoiceUtil
 				double absv = DCAbs(&fftBuf[i]);
 				fftBuf[i].Re = 0.0f;
 				fftBuf[i].Im = absv;
-				fftBuf[fftLen - i].Re = 0.0f;
-				fftBuf[fftLen - i].Im = -absv;
 			}
 
-			ifft(fftBuf, l);
+			// the input is no longer needed, so the scratch is reused for the output
+			plan.RealInverse(fftBuf, fftIn);
 
 			m_data.resize(fftLen);
 			m_halfWidth = (float)(fftLen);
 			float rate = m_halfWidth / src.m_halfWidth;
 
 			for (unsigned i = 0; i < fftLen; i++)
-				m_data[i] = (float)fftBuf[i].Re;
+				m_data[i] = (float)fftIn[i];
 
 
 			// rewindow
@@ -834,18 +867,20 @@ namespace VoiceUtil
 				m_data[i] *= window*amplitude;
 			}
 
-			delete[] fftBuf;
-
 		}
 
 		void Repitch_FormantPreserved(const SymmetricWindow_Center& src, float targetHalfWidth)
+		{
+			Repitch_FormantPreserved(src.m_data.data(), src.GetHalfWidthOfData(), src.m_halfWidth, targetHalfWidth);
+		}
+
+		// same, from the samples of a window stored elsewhere
+		void Repitch_FormantPreserved(const float* srcData, unsigned uSrcHalfWidth, float srcHalfWidth, float targetHalfWidth)
 		{
 			m_halfWidth = targetHalfWidth;
 			unsigned u_TargetHalfWidth = (unsigned)ceilf(targetHalfWidth);
 			m_data.resize(u_TargetHalfWidth);
 
-			float srcHalfWidth = src.m_halfWidth;
-			unsigned uSrcHalfWidth = src.GetHalfWidthOfData();
 			float rate = targetHalfWidth / srcHalfWidth;
 
 			float targetWidth = targetHalfWidth*2.0f;
@@ -859,7 +894,7 @@ namespace VoiceUtil
 
 				while (uSrcPos < uSrcHalfWidth)
 				{
-					m_data[i] += src.m_data[uSrcPos];
+					m_data[i] += srcData[uSrcPos];
 					srcPos += targetHalfWidth;
 					uSrcPos = (unsigned)(srcPos + 0.5f);
 				}
@@ -869,7 +904,7 @@ namespace VoiceUtil
 
 				while (uSrcPos < uSrcHalfWidth)
 				{
-					m_data[i] -= src.m_data[uSrcPos];
+					m_data[i] -= srcData[uSrcPos];
 					srcPos += targetHalfWidth;
 					uSrcPos = (unsigned)(srcPos + 0.5f);
 				}
@@ -894,8 +929,9 @@ namespace VoiceUtil
 				fftLen <<= 1;
 			}
 
-			DComp* fftBuf = new DComp[fftLen];
-			memset(fftBuf, 0, sizeof(DComp)*fftLen);
+			const FFTPlan& plan = FFTPlan::Get(l);
+			DComp* fftBuf = FFTPlan::ComplexScratch(fftLen / 2 + 1);
+			memset(fftBuf, 0, sizeof(DComp)*(fftLen / 2 + 1));
 
 			float rate = (float)fftLen / src.m_halfWidth;
 
@@ -904,11 +940,11 @@ namespace VoiceUtil
 				if (i < fftLen / 2)
 				{
 					fftBuf[i].Im = src.m_data[i] * rate;
-					fftBuf[fftLen - i].Im = -src.m_data[i] * rate;
 				}
 			}
 
-			ifft(fftBuf, l);
+			double* fftOut = FFTPlan::RealScratch(fftLen);
+			plan.RealInverse(fftBuf, fftOut);
 
 			SymmetricWindow_Center tempWin;
 			tempWin.m_halfWidth = (float)fftLen;
@@ -917,9 +953,8 @@ namespace VoiceUtil
 			for (unsigned i = 0; i < fftLen; i++)
 			{
 				float window = (cosf((float)i * (float)PI / tempWin.m_halfWidth) + 1.0f)*0.5f;
-				tempWin.m_data[i] = window*(float)fftBuf[i].Re;
+				tempWin.m_data[i] = window*(float)fftOut[i];
 			}
-			delete[] fftBuf;
 
 			this->Scale(tempWin, targetHalfWidth>0.0f ? targetHalfWidth:src.m_halfWidth);
 
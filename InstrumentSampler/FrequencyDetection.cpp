@@ -1,5 +1,5 @@
 #include "FrequencyDetection.h"
-#include "fft.h"
+#include "FFTPlan.h"
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -20,32 +20,33 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 	}
 	len = 1 << l;
 
-	DComp* fftData = new DComp[len];
+	const FFTPlan& plan = FFTPlan::Get(l);
+	double* corr = FFTPlan::RealScratch(len);
+	DComp* fftData = FFTPlan::ComplexScratch(len / 2 + 1);
 
 	for (unsigned i = 0; i<len; i++)
 	{
-		fftData[i].Re = (double)samples[i];
-		fftData[i].Im = 0.0;
+		corr[i] = (double)samples[i];
 	}
-	fft(fftData, l);
+	plan.RealForward(corr, fftData);
 
 	// self-correlation
-	for (unsigned i = 0; i<len; i++)
+	for (unsigned i = 0; i<=len / 2; i++)
 	{
 		DComp c = fftData[i];
 		fftData[i].Re = c.Re*c.Re + c.Im*c.Im;
 		fftData[i].Im = 0.0;
 	}
 
-	ifft(fftData, l);
+	plan.RealInverse(fftData, corr);
 
-	double thresh = fftData[0].Re*0.7;
-	double lastV = fftData[0].Re;
+	double thresh = corr[0]*0.7;
+	double lastV = corr[0];
 	bool ascending = false;
 	unsigned maxi = 0;
 	for (unsigned i = sampleRate / 2000; i < min(sampleRate / 30, len); i++)
 	{
-		double v = fftData[i].Re;
+		double v = corr[i];
 		if (v > thresh)
 		{
 			if (!ascending)
@@ -65,7 +66,6 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 	}
 
 	float freq = (float)sampleRate / (float)maxi;
-	delete[] fftData;
 
 	return freq;
 }
@@ -5,10 +5,7 @@
 #include <vector>
 
 #include "InstrumentSample.h"
-
-#include <Deferred.h>
-
-typedef Deferred<InstrumentSample> InstrumentSample_deferred;
+#include "InstrumentSampleBank.h"
 
 class InstrumentMultiSampler : public Instrument
 {
@@ -16,23 +13,24 @@ public:
 	InstrumentMultiSampler();
 	~InstrumentMultiSampler();
 
-	void SetSampleList(std::vector<InstrumentSample_deferred>* sampleWavList)
+	// "bank" is used for the notes within its range when it isn't empty
+	void SetSampleList(std::vector<InstrumentSample_deferred>* sampleWavList, const InstrumentSampleBank_deferred& bank)
 	{
 		m_chn = (*sampleWavList)[0]->m_chn;
 		for (unsigned i = 1; i < (unsigned)sampleWavList->size(); i++)
 			if ((*sampleWavList)[i]->m_chn != m_chn) return;
 		m_SampleWavList = sampleWavList;
+		m_bank = bank;
 	}
 
 private:
 	void _generateNoteWave(unsigned index, float fNumOfSamples, float sampleFreq, NoteBuffer* noteBuf);
 
-	void _interpolateBuffers(const float* src1, const float* src2, float* dst, unsigned length, float freq1, float freq2, float freq);
-
 	virtual void GenerateNoteWave(float fNumOfSamples, float sampleFreq, NoteBuffer* noteBuf);
 
 	unsigned m_chn;
 	std::vector<InstrumentSample_deferred>* m_SampleWavList;
+	InstrumentSampleBank_deferred m_bank;
 
 };
 
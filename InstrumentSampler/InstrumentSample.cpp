@@ -1,16 +1,19 @@
 #include "InstrumentSample.h"
+#include <stdio.h>
+#include <string.h>
 #include <ReadWav.h>
 #include "FrequencyDetection.h"
 
 InstrumentSample::InstrumentSample()
 {
 	m_wav_length = 0;
+	m_chn = 1;
 	m_wav_samples = nullptr;
+	m_max_v = 1.0f;
 }
 
 InstrumentSample::~InstrumentSample()
 {
-	delete[] m_wav_samples;
 }
 
 bool InstrumentSample::LoadWav(const char* root, const char* name, const char* instrumentName)
@@ -21,27 +24,64 @@ bool InstrumentSample::LoadWav(const char* root, const char* name, const char* i
 	else
 		sprintf(filename, "%s/InstrumentSamples/%s/%s.wav", root, instrumentName, name);
 
-	delete[] m_wav_samples;
+	m_file.Close();
+	m_unaligned.clear();
 	m_wav_length = 0;
 	m_chn = 1;
 	m_wav_samples = nullptr;
 
-	ReadWav reader;
-	reader.OpenFile(filename);
-	if (!reader.ReadHeader(m_origin_sample_rate, m_wav_length, m_chn)) return false;
+	unsigned offset;
+	{
+		ReadWav reader;
+		if (!reader.OpenFile(filename)) return false;
+		if (!reader.ReadHeader(m_origin_sample_rate, m_wav_length, m_chn))
+		{
+			m_wav_length = 0;
+			return false;
+		}
+		offset = reader.DataOffset();
+	}
 
-	m_wav_samples = new float[m_wav_length*m_chn];
-	if (!reader.ReadSamples(m_wav_samples, m_wav_length, m_max_v))
+	if (!m_file.OpenRead(filename) || m_file.Size() < offset)
 	{
-		delete[] m_wav_samples;
+		m_file.Close();
+		m_wav_length = 0;
 		return false;
 	}
 
+	// files shorter than their header are cut to the samples present
+	size_t available = (m_file.Size() - offset) / (sizeof(short)*m_chn);
+	if (available < (size_t)m_wav_length) m_wav_length = (unsigned)available;
+
+	const char* data = (const char*)m_file.Data() + offset;
+	if (offset % sizeof(short) == 0)
+		m_wav_samples = (const short*)data;
+	else
+	{
+		m_unaligned.resize((size_t)m_wav_length*m_chn);
+		memcpy(m_unaligned.data(), data, m_unaligned.size()*sizeof(short));
+		m_wav_samples = m_unaligned.data();
+		m_file.Close();
+	}
+
 	_fetchOriginFreq(root, name, instrumentName);
 
 	return true;
 }
 
+float InstrumentSample::_peak() const
+{
+	int peak = 0;
+	size_t count = (size_t)m_wav_length*m_chn;
+	for (size_t i = 0; i < count; i++)
+	{
+		int v = m_wav_samples[i];
+		if (v < 0) v = -v;
+		if (v > peak) peak = v;
+	}
+	return (float)peak / 32767.0f;
+}
+
 void InstrumentSample::_fetchOriginFreq(const char* root, const char* name, const char* instrumentName)
 {
 	char filename[1024];
@@ -50,36 +90,54 @@ void InstrumentSample::_fetchOriginFreq(const char* root, const char* name, cons
 	else
 		sprintf(filename, "%s/InstrumentSamples/%s/%s.freq", root, instrumentName, name);
 
+	// the frequency, and a "peak" line appended to the file once the peak is known
+	bool hasFreq = false;
+	bool hasPeak = false;
+	bool newLine = true;
 	FILE *fp = fopen(filename, "r");
 	if (fp)
 	{
-		fscanf(fp, "%f", &m_origin_freq);
+		char content[1024];
+		size_t len = fread(content, 1, sizeof(content) - 1, fp);
+		content[len] = 0;
 		fclose(fp);
+		newLine = len == 0 || content[len - 1] == '\n';
+
+		hasFreq = sscanf(content, "%f", &m_origin_freq) == 1;
+		const char* peak = strstr(content, "peak");
+		hasPeak = hasFreq && peak != nullptr && sscanf(peak + 4, "%f", &m_max_v) == 1;
 	}
-	else
+
+	if (!hasFreq)
 	{
-		float* localMono = nullptr;
-		float* pSamples = nullptr;
-		if (m_chn == 1)
+		std::vector<float> mono(m_wav_length);
+		for (unsigned i = 0; i < m_wav_length; i++)
 		{
-			pSamples = m_wav_samples;
+			float sum = 0.0f;
+			for (unsigned c = 0; c < m_chn; c++)
+				sum += (float)m_wav_samples[i*m_chn + c] / 32767.0f;
+			mono[i] = sum / (float)m_chn;
 		}
-		else if (m_chn == 2)
-		{
-			float* localMono = new float[m_wav_length];
-			pSamples = localMono;
-			for (unsigned i = 0; i < m_wav_length; i++)
-			{
-				localMono[i] = 0.5f*(m_wav_samples[i * 2] + m_wav_samples[i * 2 + 1]);
-			}
-		}
-		m_origin_freq = fetchFrequency(m_wav_length, pSamples, m_origin_sample_rate);
+		m_origin_freq = fetchFrequency(m_wav_length, mono.data(), m_origin_sample_rate);
 		printf("Detected frequency of %s.wav = %fHz\n", name, m_origin_freq);
+
 		fp = fopen(filename, "w");
-		fprintf(fp, "%f\n", m_origin_freq);
-		fclose(fp);
+		if (fp)
+		{
+			fprintf(fp, "%f\n", m_origin_freq);
+			fclose(fp);
+		}
+		newLine = true;
+	}
 
-		delete[] localMono;
+	if (!hasPeak)
+	{
+		m_max_v = _peak();
+		fp = fopen(filename, "a");
+		if (fp)
+		{
+			fprintf(fp, "%speak %.9g\n", newLine ? "" : "\n", m_max_v);
+			fclose(fp);
+		}
 	}
 }
-
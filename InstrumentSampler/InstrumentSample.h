@@ -1,6 +1,16 @@
 #ifndef _InstrumentSample_h
 #define _InstrumentSample_h
 
+#include <vector>
+#include <Deferred.h>
+#include <MappedFile.h>
+
+/*
+	The 16-bit PCM of the sample is mapped from the .wav file instead of being decoded,
+	the Resampler converts the frames it reads. Only the parts played are paged in, and
+	the pages are shared by all the processes using the sample.
+	The detected frequency and the peak are kept in the .freq file next to the .wav.
+*/
 class InstrumentSample
 {
 public:
@@ -9,7 +19,7 @@ public:
 
 	unsigned m_wav_length;
 	unsigned m_chn;
-	float *m_wav_samples;
+	const short *m_wav_samples; // interleaved, nullptr until loaded
 	float m_max_v;
 	float m_origin_freq;
 	unsigned m_origin_sample_rate;
@@ -18,7 +28,15 @@ public:
 
 private:
 	void _fetchOriginFreq(const char* root, const char* name, const char* instrumentName = nullptr);
+	float _peak() const;
+
+	MappedFile m_file;
+	std::vector<short> m_unaligned; // copy of the samples when they are at an odd offset in the file
+
+	InstrumentSample(const InstrumentSample &);
+	InstrumentSample &operator=(const InstrumentSample &);
 };
 
-#endif
+typedef Deferred<InstrumentSample> InstrumentSample_deferred;
 
+#endif
@@ -0,0 +1,260 @@
+#include "InstrumentSampleBank.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <ParallelFor.h>
+#include <Resampler.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+// bump when the rendering or the file layout changes, older files are then ignored
+static const char s_bankMagic[4] = { 'S', 'D', 'P', 'B' };
+static const uint32_t s_bankVersion = 1;
+
+static thread_local std::vector<float> t_blendScratch;
+
+static float SampleFreq(const InstrumentSample& sample)
+{
+	return sample.m_origin_freq / (float)sample.m_origin_sample_rate;
+}
+
+InstrumentSampleBank::InstrumentSampleBank() : m_chn(1)
+{
+}
+
+void InstrumentSampleBank::_clear()
+{
+	m_entries.clear();
+	m_data.clear();
+	m_data.shrink_to_fit();
+	m_file.Close();
+}
+
+size_t InstrumentSampleBank::Bytes() const
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < m_entries.size(); i++)
+		bytes += (size_t)m_entries[i].length * m_chn * sizeof(float);
+	return bytes;
+}
+
+unsigned InstrumentSampleBank::BlendLength(const InstrumentSample& s1, const InstrumentSample& s2, float sampleFreq)
+{
+	unsigned len1 = Resampler(s1.m_wav_samples, s1.m_wav_length, s1.m_chn).MaxFrames(sampleFreq / SampleFreq(s1));
+	unsigned len2 = Resampler(s2.m_wav_samples, s2.m_wav_length, s2.m_chn).MaxFrames(sampleFreq / SampleFreq(s2));
+	return len1 < len2 ? len1 : len2;
+}
+
+void InstrumentSampleBank::RenderBlend(const InstrumentSample& s1, const InstrumentSample& s2, float sampleFreq, unsigned count, float* dst)
+{
+	float freq1 = SampleFreq(s1);
+	float freq2 = SampleFreq(s2);
+	unsigned chn = s1.m_chn;
+
+	Resampler(s1.m_wav_samples, s1.m_wav_length, chn).Render(dst, count, sampleFreq / freq1, 1.0f / s1.m_max_v);
+
+	std::vector<float>& tmp = t_blendScratch;
+	if (tmp.size() < (size_t)count*chn) tmp.resize((size_t)count*chn);
+	Resampler(s2.m_wav_samples, s2.m_wav_length, chn).Render(tmp.data(), count, sampleFreq / freq2, 1.0f / s2.m_max_v);
+
+	float k2 = logf(sampleFreq / freq1) / logf(freq2 / freq1);
+	float k1 = 1.0f - k2;
+
+	for (size_t i = 0; i < (size_t)count*chn; i++)
+		dst[i] = k1*dst[i] + k2*tmp[i];
+}
+
+bool InstrumentSampleBank::Build(const std::vector<InstrumentSample_deferred>& samples, unsigned divisions, size_t budget)
+{
+	_clear();
+	if (samples.size() < 2 || divisions == 0) return false;
+
+	m_chn = samples[0]->m_chn;
+	std::vector<float> sampleFreqs(samples.size());
+	double maxGap = 0.0;
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		if (samples[i]->m_chn != m_chn || samples[i]->m_wav_length == 0) return false;
+		sampleFreqs[i] = SampleFreq(*samples[i]);
+		if (i > 0)
+		{
+			double gap = 12.0*log2((double)sampleFreqs[i] / (double)sampleFreqs[i - 1]);
+			if (gap > maxGap) maxGap = gap;
+		}
+	}
+
+	float lowest = sampleFreqs[0];
+	float highest = sampleFreqs[samples.size() - 1];
+	double range = 12.0*log2((double)highest / (double)lowest);
+
+	// the entries, and the index of the sample below each of them
+	std::vector<float> freqs;
+	std::vector<unsigned> lower;
+	std::vector<size_t> offsets;
+	size_t total = 0;
+
+	bool fits = false;
+	for (double spacing = 1.0 / (double)divisions; spacing < maxGap && !fits; spacing *= 2.0)
+	{
+		unsigned steps = (unsigned)ceil(range / spacing);
+		freqs.resize(steps + 1);
+		lower.resize(steps + 1);
+		offsets.resize(steps + 1);
+		total = 0;
+
+		unsigned I = 0;
+		for (unsigned k = 0; k <= steps; k++)
+		{
+			float freq = k < steps ? (float)((double)lowest*pow(2.0, (double)k*spacing / 12.0)) : highest;
+			while (I + 2 < (unsigned)samples.size() && freq >= sampleFreqs[I + 1]) I++;
+
+			freqs[k] = freq;
+			lower[k] = I;
+			offsets[k] = total;
+			total += (size_t)BlendLength(*samples[I], *samples[I + 1], freq) * m_chn;
+		}
+		fits = total * sizeof(float) <= budget;
+	}
+	if (!fits) return false;
+
+	m_data.resize(total);
+	m_entries.resize(freqs.size());
+	for (size_t k = 0; k < freqs.size(); k++)
+	{
+		Entry& entry = m_entries[k];
+		entry.sampleFreq = freqs[k];
+		entry.length = (unsigned)(((k + 1 < freqs.size() ? offsets[k + 1] : total) - offsets[k]) / m_chn);
+		entry.data = m_data.data() + offsets[k];
+	}
+
+	ParallelFor((unsigned)m_entries.size(), 0, [&](unsigned k)
+	{
+		const InstrumentSample& s1 = *samples[lower[k]];
+		const InstrumentSample& s2 = *samples[lower[k] + 1];
+		RenderBlend(s1, s2, freqs[k], m_entries[k].length, m_data.data() + offsets[k]);
+	});
+
+	return true;
+}
+
+const InstrumentSampleBank::Entry* InstrumentSampleBank::Find(float sampleFreq) const
+{
+	if (m_entries.size() == 0) return nullptr;
+	if (sampleFreq < m_entries[0].sampleFreq || sampleFreq > m_entries[m_entries.size() - 1].sampleFreq) return nullptr;
+
+	std::vector<Entry>::const_iterator iter = std::lower_bound(m_entries.begin(), m_entries.end(), sampleFreq,
+		[](const Entry& entry, float freq) { return entry.sampleFreq < freq; });
+	return &(*iter);
+}
+
+struct BankEntryHeader
+{
+	float sampleFreq;
+	uint32_t length;
+};
+
+bool InstrumentSampleBank::Save(const char* filename, const std::string& key) const
+{
+	// written to a temporary file first, so a reader never sees a partial file
+	std::string path = filename;
+	char suffix[64];
+	sprintf(suffix, ".%d.%p.tmp", (int)getpid(), (const void*)this);
+	std::string tmpPath = path + suffix;
+
+	FILE* fp = fopen(tmpPath.data(), "wb");
+	if (!fp) return false;
+
+	uint32_t keyLen = (uint32_t)key.length();
+	uint32_t chn = m_chn;
+	uint32_t count = (uint32_t)m_entries.size();
+	static const char padding[4] = { 0, 0, 0, 0 };
+	bool ok = fwrite(s_bankMagic, 1, 4, fp) == 4 &&
+		fwrite(&s_bankVersion, sizeof(uint32_t), 1, fp) == 1 &&
+		fwrite(&keyLen, sizeof(uint32_t), 1, fp) == 1 &&
+		fwrite(key.data(), 1, keyLen, fp) == keyLen &&
+		fwrite(padding, 1, (4 - keyLen % 4) % 4, fp) == (4 - keyLen % 4) % 4 &&
+		fwrite(&chn, sizeof(uint32_t), 1, fp) == 1 &&
+		fwrite(&count, sizeof(uint32_t), 1, fp) == 1;
+
+	for (size_t k = 0; ok && k < m_entries.size(); k++)
+	{
+		BankEntryHeader header = { m_entries[k].sampleFreq, m_entries[k].length };
+		ok = fwrite(&header, sizeof(BankEntryHeader), 1, fp) == 1;
+	}
+	for (size_t k = 0; ok && k < m_entries.size(); k++)
+	{
+		size_t n = (size_t)m_entries[k].length*m_chn;
+		ok = fwrite(m_entries[k].data, sizeof(float), n, fp) == n;
+	}
+	ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+	if (ok) remove(path.data());
+#endif
+	if (!ok || rename(tmpPath.data(), path.data()) != 0)
+	{
+		remove(tmpPath.data());
+		return false;
+	}
+	return true;
+}
+
+bool InstrumentSampleBank::Load(const char* filename, const std::string& key)
+{
+	_clear();
+	if (!m_file.OpenRead(filename)) return false;
+
+	const char* data = (const char*)m_file.Data();
+	size_t size = m_file.Size();
+	size_t pos = 0;
+
+	uint32_t version, keyLen, chn, count;
+	bool ok = size >= 12 && memcmp(data, s_bankMagic, 4) == 0;
+	if (ok)
+	{
+		memcpy(&version, data + 4, sizeof(uint32_t));
+		memcpy(&keyLen, data + 8, sizeof(uint32_t));
+		pos = 12 + ((size_t)keyLen + 3) / 4 * 4;
+		ok = version == s_bankVersion && keyLen == (uint32_t)key.length() && pos + 8 <= size &&
+			memcmp(data + 12, key.data(), keyLen) == 0;
+	}
+	if (ok)
+	{
+		memcpy(&chn, data + pos, sizeof(uint32_t));
+		memcpy(&count, data + pos + 4, sizeof(uint32_t));
+		pos += 8;
+		ok = chn > 0 && pos + (size_t)count*sizeof(BankEntryHeader) <= size;
+	}
+	if (!ok)
+	{
+		_clear();
+		return false;
+	}
+
+	m_chn = chn;
+	const BankEntryHeader* headers = (const BankEntryHeader*)(data + pos);
+	pos += (size_t)count*sizeof(BankEntryHeader);
+
+	m_entries.resize(count);
+	for (uint32_t k = 0; k < count; k++)
+	{
+		size_t bytes = (size_t)headers[k].length*m_chn*sizeof(float);
+		if (pos + bytes > size)
+		{
+			_clear();
+			return false;
+		}
+		m_entries[k].sampleFreq = headers[k].sampleFreq;
+		m_entries[k].length = headers[k].length;
+		m_entries[k].data = (const float*)(data + pos);
+		pos += bytes;
+	}
+	return true;
+}
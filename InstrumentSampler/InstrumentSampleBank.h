@@ -0,0 +1,67 @@
+#ifndef _InstrumentSampleBank_h
+#define _InstrumentSampleBank_h
+
+#include <vector>
+#include <string>
+#include <Deferred.h>
+#include <MappedFile.h>
+
+#include "InstrumentSample.h"
+
+/*
+	Waveforms of a multi-sampler pre-rendered on a grid of pitches between its lowest and
+	highest samples, each one already blended from the two samples around it.
+	A note within the range is then a single resample of the entry just above its pitch,
+	instead of two resamples and a crossfade.
+*/
+class InstrumentSampleBank
+{
+public:
+	InstrumentSampleBank();
+
+	struct Entry
+	{
+		float sampleFreq; // cycles per frame, like the origin_SampleFreq of the samples
+		unsigned length;
+		const float* data;
+	};
+
+	/*
+		"samples" are sorted by pitch and have the same number of channels.
+		Builds "divisions" entries per semitone, fewer if they don't fit in "budget" bytes.
+		Returns false if no grid finer than the samples themselves fits.
+	*/
+	bool Build(const std::vector<InstrumentSample_deferred>& samples, unsigned divisions, size_t budget);
+
+	// "key" identifies the samples and the settings, files with another key are ignored
+	bool Load(const char* filename, const std::string& key);
+	bool Save(const char* filename, const std::string& key) const;
+
+	bool IsEmpty() const { return m_entries.size() == 0; }
+	unsigned NumEntries() const { return (unsigned)m_entries.size(); }
+	size_t Bytes() const;
+
+	// the entry of lowest pitch not below sampleFreq, nullptr outside of the bank
+	const Entry* Find(float sampleFreq) const;
+
+	// resamples s1 and s2 to sampleFreq and blends them by pitch distance, without envelope
+	static unsigned BlendLength(const InstrumentSample& s1, const InstrumentSample& s2, float sampleFreq);
+	static void RenderBlend(const InstrumentSample& s1, const InstrumentSample& s2, float sampleFreq, unsigned count, float* dst);
+
+private:
+	void _clear();
+
+	unsigned m_chn;
+	std::vector<Entry> m_entries;
+
+	// entries point into one of these
+	std::vector<float> m_data;
+	MappedFile m_file;
+
+	InstrumentSampleBank(const InstrumentSampleBank &);
+	InstrumentSampleBank &operator=(const InstrumentSampleBank &);
+};
+
+typedef Deferred<InstrumentSampleBank> InstrumentSampleBank_deferred;
+
+#endif
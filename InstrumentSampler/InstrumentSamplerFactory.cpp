@@ -1,3 +1,4 @@
+#include <Python.h>
 #include "PyScoreDraft.h"
 
 #ifdef _WIN32
@@ -12,10 +13,12 @@
 #include <string.h>
 
 #include "InstrumentSample.h"
+#include "InstrumentSampleBank.h"
 #include "InstrumentSingleSampler.h"
 #include "InstrumentMultiSampler.h"
 
 #include <Deferred.h>
+#include <FileStamp.h>
 
 class InstrumentSamplerInitializer : public InstrumentInitializer
 {
@@ -62,6 +65,17 @@ public:
 	InstrumentMultiSamplerInitializer()
 	{
 		m_IsMultiSampler = true;
+		m_pitchBankDivisions = 0;
+		m_pitchBankMegabytes = 256;
+		m_bankDivisions = 0;
+		m_bankMegabytes = 0;
+	}
+
+	// pitch bank of the instruments created afterwards, set by InstrumentSamplerSetPitchBank()
+	void SetPitchBank(unsigned divisions, unsigned megabytes)
+	{
+		m_pitchBankDivisions = divisions;
+		m_pitchBankMegabytes = megabytes;
 	}
 
 
@@ -102,6 +116,7 @@ public:
 					InstrumentSample_deferred wav;
 					wav->LoadWav(m_root.data(), name, m_name.data());
 					m_SampleWavList.push_back(wav);
+					m_SampleNames.push_back(name);
 
 				} while (FindNextFile(hFind, &ffd) != 0);
 			}
@@ -128,6 +143,7 @@ public:
 							InstrumentSample_deferred wav;
 							wav->LoadWav(m_root.data(), name, m_name.data());
 							m_SampleWavList.push_back(wav);
+							m_SampleNames.push_back(name);
 						}
 					}
 
@@ -137,20 +153,85 @@ public:
 #endif
 			std::qsort(m_SampleWavList.data(), m_SampleWavList.size(), sizeof(InstrumentSample_deferred), compareSampleWav);
 		}
+		if (m_pitchBankDivisions != m_bankDivisions || m_pitchBankMegabytes != m_bankMegabytes)
+			_buildBank();
+
 		Instrument_deferred inst = Instrument_deferred::Instance<InstrumentMultiSampler>();
-		inst.DownCast<InstrumentMultiSampler>()->SetSampleList(&m_SampleWavList);
+		inst.DownCast<InstrumentMultiSampler>()->SetSampleList(&m_SampleWavList, m_bank);
 		return inst;
 
 	}
 
 private:
+	/*
+		The bank is stored next to the .freq files as "pitch.bank", and reused while
+		the samples and the settings stay the same. Instruments created before keep
+		the bank they were given.
+	*/
+	void _buildBank()
+	{
+		m_bankDivisions = m_pitchBankDivisions;
+		m_bankMegabytes = m_pitchBankMegabytes;
+		m_bank = InstrumentSampleBank_deferred();
+		if (m_bankDivisions == 0) return;
+
+		char path[1024];
+		sprintf(path, "%u:%u", m_bankDivisions, m_bankMegabytes);
+		std::string key = path;
+		for (size_t i = 0; i < m_SampleNames.size(); i++)
+		{
+			sprintf(path, "%s/InstrumentSamples/%s/%s.wav", m_root.data(), m_name.data(), m_SampleNames[i].data());
+			key += std::string(";") + m_SampleNames[i] + ":" + FileStamp(path);
+		}
+		for (size_t i = 0; i < m_SampleWavList.size(); i++)
+		{
+			sprintf(path, ";%f", m_SampleWavList[i]->m_origin_freq);
+			key += path;
+		}
+
+		sprintf(path, "%s/InstrumentSamples/%s/pitch.bank", m_root.data(), m_name.data());
+		if (m_bank->Load(path, key)) return;
+
+		if (!m_bank->Build(m_SampleWavList, m_bankDivisions, (size_t)m_bankMegabytes * 1024 * 1024))
+		{
+			printf("Pitch bank of %s doesn't fit in %u MB, not used\n", m_name.data(), m_bankMegabytes);
+			return;
+		}
+		printf("Built pitch bank of %s: %u entries, %.1f MB\n", m_name.data(), m_bank->NumEntries(), (double)m_bank->Bytes() / (1024.0*1024.0));
+		m_bank->Save(path, key);
+	}
+
 	std::vector<InstrumentSample_deferred> m_SampleWavList;
+	std::vector<std::string> m_SampleNames; // in the order of loading, before sorting
+	InstrumentSampleBank_deferred m_bank;
+	unsigned m_bankDivisions; // settings m_bank was built with
+	unsigned m_bankMegabytes;
+	unsigned m_pitchBankDivisions; // requested settings
+	unsigned m_pitchBankMegabytes;
 };
 
+static std::vector<InstrumentSamplerInitializer_Deferred> s_initializers;
+
+PyObject* InstrumentSamplerSetPitchBank(PyObject *args)
+{
+	const char* name = _PyUnicode_AsString(PyTuple_GetItem(args, 0));
+	unsigned divisions = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 1));
+	unsigned megabytes = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 2));
+	for (unsigned i = 0; i < s_initializers.size(); i++)
+	{
+		if (s_initializers[i]->m_IsMultiSampler && s_initializers[i]->m_name == name)
+		{
+			s_initializers[i].DownCast<InstrumentMultiSamplerInitializer>()->SetPitchBank(divisions, megabytes);
+			return PyLong_FromUnsignedLong(0);
+		}
+	}
+	PyErr_Format(PyExc_RuntimeError, "%s is not a multi-sample instrument", name);
+	return NULL;
+}
+
 
 PY_SCOREDRAFT_EXTENSION_INTERFACE void Initialize(PyScoreDraft* pyScoreDraft, const char* root)
 {
-	static std::vector<InstrumentSamplerInitializer_Deferred> s_initializers;
 
 #ifdef _WIN32
 	WIN32_FIND_DATAA ffd;
@@ -248,4 +329,12 @@ PY_SCOREDRAFT_EXTENSION_INTERFACE void Initialize(PyScoreDraft* pyScoreDraft, co
 
 	for (unsigned i = 0; i < s_initializers.size(); i++)
 		pyScoreDraft->RegisterInstrumentClass(s_initializers[i]->m_name.data(), s_initializers[i], s_initializers[i]->GetComment().data());
+
+	pyScoreDraft->RegisterInterfaceExtension("InstrumentSamplerSetPitchBank", InstrumentSamplerSetPitchBank, "name, divisions, megabytes", "name, divisions, megabytes",
+		"\t'''\n"
+		"\tPre-render the multi-sample instruments of class 'name' created afterwards on a grid of 'divisions' pitches per semitone,\n"
+		"\tso a note is resampled once instead of blended from two samples. A coarser grid is used if the bank\n"
+		"\tdoesn't fit in 'megabytes'. The bank is stored in the directory of the samples and reused in later sessions.\n"
+		"\t0 divisions, the default, disables the banks.\n"
+		"\t'''\n");
 }
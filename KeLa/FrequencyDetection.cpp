@@ -1,5 +1,5 @@
 #include "FrequencyDetection.h"
-#include "fft.h"
+#include "FFTPlan.h"
 #include <memory.h>
 #include <stdio.h>
 
@@ -21,36 +21,37 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 		len <<= 1;
 	}
 
-	DComp* fftData = new DComp[len];
-	memset(fftData, 0, sizeof(DComp)*len);
+	const FFTPlan& plan = FFTPlan::Get(l);
+	double* corr = FFTPlan::RealScratch(len);
+	DComp* fftData = FFTPlan::ComplexScratch(len / 2 + 1);
+	memset(corr, 0, sizeof(double)*len);
 
 	for (unsigned i = 0; i<length; i++)
 	{
-		fftData[i].Re = (double)samples[i];
-		fftData[i].Im = 0.0;
+		corr[i] = (double)samples[i];
 	}
-	fft(fftData, l);
+	plan.RealForward(corr, fftData);
 
 	// self-correlation
-	for (unsigned i = 0; i<len; i++)
+	for (unsigned i = 0; i<=len / 2; i++)
 	{
 		DComp c = fftData[i];
 		fftData[i].Re = c.Re*c.Re + c.Im*c.Im;
 		fftData[i].Im = 0.0;
 	}
 
-	ifft(fftData, l);
-	if (fftData[0].Re<0.01)	return -1.0f;
+	plan.RealInverse(fftData, corr);
+	if (corr[0]<0.01)	return -1.0f;
 	
 	unsigned maxi = (unsigned)(-1);
 	
-	double lastV = fftData[0].Re;
+	double lastV = corr[0];
 	double maxV = 0.0f;
 	bool ascending = false;
 
 	for (unsigned i = sampleRate / 500; i < min(sampleRate / 40, len / 2); i++)
 	{
-		double v = fftData[i].Re;
+		double v = corr[i];
 		if (!ascending)
 		{
 			if (v > lastV) ascending = true;
@@ -59,9 +60,9 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 		{
 			if (v < lastV)
 			{
-				if (fftData[i - 1].Re>maxV)
+				if (corr[i - 1]>maxV)
 				{
-					maxV = fftData[i - 1].Re;
+					maxV = corr[i - 1];
 					maxi = i - 1;
 				}
 				ascending = false;
@@ -72,7 +73,7 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 
 	float freq;
 
-	if (maxi != (unsigned)(-1) && maxV>0.6f* fftData[0].Re)
+	if (maxi != (unsigned)(-1) && maxV>0.6f* corr[0])
 	{
 		freq = (float)sampleRate / (float)maxi;
 	}
@@ -81,7 +82,5 @@ float fetchFrequency(unsigned length, float *samples, unsigned sampleRate)
 		freq = 0.0f;
 	}
 
-	delete[] fftData;
-
 	return freq;
 }
@@ -11,8 +11,12 @@
 
 #include <string.h>
 #include <cmath>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <ReadWav.h>
 #include "FrequencyDetection.h"
+#include "ParallelFor.h"
 #include <float.h>
 
 #ifndef max
@@ -137,13 +141,37 @@ void DetectFreqs(const Buffer& buf, std::vector<float>& frequencies, unsigned st
 
 }
 
+// a sample of the voice-bank with its detected frequencies, loaded on first use
+struct KeLaSample
+{
+	std::mutex mutex;
+	bool loaded;
+	bool valid;
+	Buffer source;
+	float maxv;
+	std::vector<float> frequencies;
+
+	KeLaSample() : loaded(false), valid(false), maxv(0.0f) {}
+};
+
+typedef Deferred<KeLaSample> KeLaSample_deferred;
+
+// settings of the tuning commands of KeLa
+class KeLaTuneState : public TuneStateExtension
+{
+public:
+	float rap_distortion;
+
+	KeLaTuneState() : rap_distortion(1.0f) {}
+};
+
 class KeLa : public Singer
 {
 public:
 	KeLa()
 	{
 		m_transition = 0.1f;
-		m_rap_distortion = 1.0f;
+		m_tuneExtension = TuneStateExtension_Deferred::Instance<KeLaTuneState>();
 	}
 	void SetName(const char* root, const char* name)
 	{
@@ -214,24 +242,25 @@ public:
 #endif
 
 	}
-	virtual bool Tune(const char* cmd)
+	virtual bool TuneExtension(const char* cmd, TuneState& state)
 	{
-		if (!Singer::Tune(cmd))
-		{
-			char command[1024];
-			sscanf(cmd, "%s", command);
+		char command[1024];
+		sscanf(cmd, "%s", command);
 
-			if (strcmp(command, "rap_distortion") == 0)
-			{
-				float value;
-				if (sscanf(cmd + strlen("rap_distortion")+1, "%f", &value))
-					m_rap_distortion = value;
-				return true;
-			}
+		if (strcmp(command, "rap_distortion") == 0)
+		{
+			TuneStateExtension_Deferred extension = TuneStateExtension_Deferred::Instance<KeLaTuneState>();
+			KeLaTuneState& params = *extension.DownCast<KeLaTuneState>();
+			params = _tuneParams(state);
+			float value;
+			if (sscanf(cmd + strlen("rap_distortion")+1, "%f", &value))
+				params.rap_distortion = value;
+			state.extension = extension;
+			return true;
 		}
 		return false;
 	}
-	virtual void GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf)
+	virtual void GenerateWave(SingingPieceInternal piece, const TuneState& /*state*/, NoteBuffer* noteBuf)
 	{
 		if (piece.notes.size() < 1) return;
 
@@ -295,8 +324,10 @@ public:
 
 	}
 
-	virtual void GenerateWave_Rap(RapPieceInternal piece, NoteBuffer* noteBuf)
+	virtual void GenerateWave_Rap(RapPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf)
 	{
+		float rap_distortion = _tuneParams(state).rap_distortion;
+
 		float sumLen = piece.fNumOfSamples;
 		unsigned uSumLen = (unsigned)ceilf(sumLen);
 		float *freqMap = new float[uSumLen];
@@ -311,7 +342,7 @@ public:
 		delete[] freqMap;
 
 		/// Distortion 
-		if (m_rap_distortion > 1.0f)
+		if (rap_distortion > 1.0f)
 		{
 			float maxV = 0.0f;
 			for (unsigned pos = 0; pos < uSumLen; pos++)
@@ -326,7 +357,7 @@ public:
 				float amplitude = 1.0f - expf((x2 - 1.0f)*10.0f);
 
 				float v = noteBuf->m_data[pos];
-				v *= m_rap_distortion;
+				v *= rap_distortion;
 				if (v > maxV) v = maxV;
 				if (v < -maxV) v = -maxV;
 				noteBuf->m_data[pos] = v;
@@ -334,7 +365,7 @@ public:
 		}
 	}
 
-	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, NoteBuffer* noteBuf)
+	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf)
 	{
 		typedef Deferred<NoteBuffer> NoteBuffer_Deferred;
 		std::vector <NoteBuffer_Deferred> subBufs;
@@ -346,7 +377,7 @@ public:
 			SingingPieceInternal& piece = *pieceList[i];
 			NoteBuffer_Deferred subBuf;
 			subBuf->m_sampleRate = noteBuf->m_sampleRate;
-			GenerateWave(piece, subBuf);
+			GenerateWave(piece, state, subBuf);
 			sumAllLen += subBuf->m_sampleNum;
 			subBufs.push_back(subBuf);
 		}
@@ -369,7 +400,7 @@ public:
 		
 	}
 
-	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuffer* noteBuf)
+	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf)
 	{
 		typedef Deferred<NoteBuffer> NoteBuffer_Deferred;
 		std::vector <NoteBuffer_Deferred> subBufs;
@@ -381,7 +412,7 @@ public:
 			RapPieceInternal&  piece = *pieceList[i];
 			NoteBuffer_Deferred subBuf;
 			subBuf->m_sampleRate = noteBuf->m_sampleRate;
-			GenerateWave_Rap(piece, subBuf);
+			GenerateWave_Rap(piece, state, subBuf);
 			sumAllLen += subBuf->m_sampleNum;
 			subBufs.push_back(subBuf);
 		}
@@ -405,39 +436,71 @@ public:
 
 	}
 
+	// each sample, its .freq file included, is loaded once under its own lock by _getSample(),
+	// generating only reads the loaded samples
+	virtual bool CanGenerateConcurrently(const TuneState& /*state*/) const { return true; }
+
+	// the samples don't depend on the output rate, nor on the states, they are loaded before returning
+	virtual SingerPrefetch_Deferred PrefetchSentences(const std::vector<SingingPieceInternalList>& singing, const std::vector<TuneState>& /*singingStates*/,
+		const std::vector<RapPieceInternalList>& raps, const std::vector<TuneState>& /*rapStates*/, float /*sampleRate*/)
+	{
+		std::vector<std::string> lyrics;
+		std::unordered_set<std::string> lyricSet;
+		for (size_t i = 0; i < singing.size(); i++)
+			for (size_t j = 0; j < singing[i].size(); j++)
+				if (lyricSet.insert(singing[i][j]->lyric).second) lyrics.push_back(singing[i][j]->lyric);
+		for (size_t i = 0; i < raps.size(); i++)
+			for (size_t j = 0; j < raps[i].size(); j++)
+				if (lyricSet.insert(raps[i][j]->lyric).second) lyrics.push_back(raps[i][j]->lyric);
+
+		ParallelFor((unsigned)lyrics.size(), DefaultNumberOfThreads(), [&](unsigned i)
+		{
+			_getSample(lyrics[i].data());
+		});
+		return SingerPrefetch_Deferred();
+	}
+
 private:
-	void _generateWave(const char* lyric, float sumLen, float* freqMap, NoteBuffer* noteBuf)
+	// states not made by this singer have the default settings
+	static const KeLaTuneState& _tuneParams(const TuneState& state)
 	{
-		unsigned uSumLen = (unsigned)ceilf(sumLen);
+		static const KeLaTuneState s_defaults;
+		const KeLaTuneState* params = dynamic_cast<const KeLaTuneState*>((const TuneStateExtension*)state.extension);
+		return params != nullptr ? *params : s_defaults;
+	}
 
-		/// calculate finalBuffer->tmpBuffer map
-		float minSampleFreq = FLT_MAX;
-		for (unsigned pos = 0; pos < uSumLen; pos++)
+	KeLaSample_deferred _getSample(const char* lyric)
+	{
+		KeLaSample_deferred sample;
 		{
-			float sampleFreq = freqMap[pos];
-			if (sampleFreq < minSampleFreq) minSampleFreq = sampleFreq;
+			std::lock_guard<std::mutex> lock(m_samplesMutex);
+			std::unordered_map<std::string, KeLaSample_deferred>::iterator iter = m_samples.find(lyric);
+			if (iter != m_samples.end())
+				sample = iter->second;
+			else
+				m_samples[lyric] = sample;
 		}
 
-		float* stretchingMap = new float[uSumLen];
-
-		float pos_tmpBuf = 0.0f;
-		for (unsigned pos = 0; pos < uSumLen; pos++)
+		// other threads asking for the same sample wait for it to be loaded
+		std::lock_guard<std::mutex> lock(sample->mutex);
+		if (!sample->loaded)
 		{
-			float sampleFreq = freqMap[pos];
-			float speed = sampleFreq / minSampleFreq;
-			pos_tmpBuf += speed;
-			stretchingMap[pos] = pos_tmpBuf;
+			sample->valid = _loadSample(lyric, *sample);
+			sample->loaded = true;
 		}
+		return sample;
+	}
 
+	bool _loadSample(const char* lyric, KeLaSample& sample)
+	{
 		char path[1024];
 		sprintf(path, "%s/KeLaSamples/%s/%s.wav", m_root.data(), m_name.data(), lyric);
 
-		Buffer source;
-		float maxv;
-		if (!ReadWavToBuffer(path, source, maxv)) return;
+		Buffer& source = sample.source;
+		if (!ReadWavToBuffer(path, source, sample.maxv)) return false;
 
 		unsigned freq_step = 256;
-		std::vector<float> frequencies;
+		std::vector<float>& frequencies = sample.frequencies;
 		
 		sprintf(path, "%s/KeLaSamples/%s/%s.freq", m_root.data(), m_name.data(), lyric);
 		FILE* fp = fopen(path, "r");
@@ -464,6 +527,40 @@ private:
 			}
 			fclose(fp);
 		}
+		return true;
+	}
+
+	void _generateWave(const char* lyric, float sumLen, float* freqMap, NoteBuffer* noteBuf)
+	{
+		unsigned uSumLen = (unsigned)ceilf(sumLen);
+
+		/// calculate finalBuffer->tmpBuffer map
+		float minSampleFreq = FLT_MAX;
+		for (unsigned pos = 0; pos < uSumLen; pos++)
+		{
+			float sampleFreq = freqMap[pos];
+			if (sampleFreq < minSampleFreq) minSampleFreq = sampleFreq;
+		}
+
+		float* stretchingMap = new float[uSumLen];
+
+		float pos_tmpBuf = 0.0f;
+		for (unsigned pos = 0; pos < uSumLen; pos++)
+		{
+			float sampleFreq = freqMap[pos];
+			float speed = sampleFreq / minSampleFreq;
+			pos_tmpBuf += speed;
+			stretchingMap[pos] = pos_tmpBuf;
+		}
+
+		KeLaSample_deferred sample = _getSample(lyric);
+		if (!sample->valid) return;
+
+		const Buffer& source = sample->source;
+		float maxv = sample->maxv;
+
+		unsigned freq_step = 256;
+		const std::vector<float>& frequencies = sample->frequencies;
 
 		unsigned unvoicedBegin = (unsigned)(-1);
 		unsigned voicedBegin = (unsigned)(-1);
@@ -703,7 +800,9 @@ private:
 	std::string m_root;
 
 	float m_transition;
-	float m_rap_distortion;
+
+	std::mutex m_samplesMutex;
+	std::unordered_map<std::string, KeLaSample_deferred> m_samples;
 };
 
 class KeLaInitializer : public SingerInitializer
@@ -83,7 +83,7 @@ MainWidget::MainWidget(const Visualizer* visualizer, TrackBuffer_deferred trackB
 	m_ui.setupUi(this);
 	m_ui.display->SetData(visualizer);
 
-	unsigned size = trackBuf->NumberOfSamples();
+	unsigned size = (unsigned)trackBuf->NumberOfSamples();
 	unsigned chn = trackBuf->NumberOfChannels();
 	m_pcm.resize(size*chn);
 	float volume = trackBuf->AbsoluteVolume();
@@ -12,6 +12,11 @@
 #include <string.h>
 #include <math.h>
 #include <ReadWav.h>
+#include <MappedFile.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <Resampler.h>
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -21,12 +26,18 @@
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
 #endif
 
+/*
+	The 16-bit PCM is mapped from the .wav file and converted by the Resampler as it is read,
+	like the samples of InstrumentSampler.
+	Every hit of a track plays the whole sample at the same rate, so the sample is resampled
+	and normalized once per track rate, and the hits are copied from there.
+*/
 class PercussionSample
 {
 public:
 	unsigned m_wav_length;
 	unsigned m_chn;
-	float *m_wav_samples;
+	const short *m_wav_samples;
 	float m_max_v;
 
 	unsigned m_origin_sample_rate;
@@ -34,12 +45,9 @@ public:
 	PercussionSample()
 	{
 		m_wav_length = 0;
+		m_chn = 1;
 		m_wav_samples = nullptr;
-	}
-
-	~PercussionSample()
-	{
-		delete[] m_wav_samples;
+		m_max_v = 1.0f;
 	}
 
 	bool LoadWav(const char* root, const char* name)
@@ -47,26 +55,87 @@ public:
 		char filename[1024];
 		sprintf(filename, "%s/PercussionSamples/%s.wav", root, name);
 
-		delete[] m_wav_samples;
+		m_file.Close();
+		m_unaligned.clear();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_resampled.clear();
+		}
 		m_wav_length = 0;
 		m_chn = 1;
 		m_wav_samples = nullptr;
 
-		ReadWav reader;
-		reader.OpenFile(filename);
-		if (!reader.ReadHeader(m_origin_sample_rate, m_wav_length, m_chn)) return false;
+		unsigned offset;
+		{
+			ReadWav reader;
+			if (!reader.OpenFile(filename)) return false;
+			if (!reader.ReadHeader(m_origin_sample_rate, m_wav_length, m_chn))
+			{
+				m_wav_length = 0;
+				return false;
+			}
+			offset = reader.DataOffset();
+		}
 
-		m_wav_samples = new float[m_wav_length*m_chn];
-		if (!reader.ReadSamples(m_wav_samples, m_wav_length, m_max_v))
+		if (!m_file.OpenRead(filename) || m_file.Size() < offset)
 		{
-			delete[] m_wav_samples;
+			m_file.Close();
+			m_wav_length = 0;
 			return false;
 		}
 
+		size_t available = (m_file.Size() - offset) / (sizeof(short)*m_chn);
+		if (available < (size_t)m_wav_length) m_wav_length = (unsigned)available;
+
+		const char* data = (const char*)m_file.Data() + offset;
+		if (offset % sizeof(short) == 0)
+			m_wav_samples = (const short*)data;
+		else
+		{
+			m_unaligned.resize((size_t)m_wav_length*m_chn);
+			memcpy(m_unaligned.data(), data, m_unaligned.size()*sizeof(short));
+			m_wav_samples = m_unaligned.data();
+			m_file.Close();
+		}
+
+		// drum samples are short, the peak is just scanned
+		int peak = 0;
+		for (size_t i = 0; i < (size_t)m_wav_length*m_chn; i++)
+		{
+			int v = m_wav_samples[i];
+			if (v < 0) v = -v;
+			if (v > peak) peak = v;
+		}
+		m_max_v = (float)peak / 32767.0f;
+
 		return true;
 	}
+
+	// the whole sample at "rate", divided by its peak, computed on first use
+	const std::vector<float>& Resampled(unsigned rate)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<unsigned, std::vector<float>>::iterator iter = m_resampled.find(rate);
+		if (iter != m_resampled.end()) return iter->second;
+
+		std::vector<float>& data = m_resampled[rate];
+		double step = (double)m_origin_sample_rate / (double)rate;
+		Resampler resampler(m_wav_samples, m_wav_length, m_chn);
+		unsigned frames = resampler.MaxFrames(step);
+		data.resize((size_t)frames*m_chn);
+		resampler.Render(data.data(), frames, step, 1.0f / m_max_v);
+		return data;
+	}
+
+private:
+	MappedFile m_file;
+	std::vector<short> m_unaligned;
+
+	std::mutex m_mutex;
+	std::map<unsigned, std::vector<float>> m_resampled; // by output rate
 };
 
+typedef Deferred<PercussionSample> PercussionSample_deferred;
 
 class PercussionSampler : public Percussion
 {
@@ -89,94 +158,18 @@ public:
 	{
 		if (!m_sample) return;
 
-		unsigned maxSample = (unsigned)((float)m_sample->m_wav_length * beatBuf->m_sampleRate / m_sample->m_origin_sample_rate);
-		beatBuf->m_sampleNum = min((unsigned)ceilf(fNumOfSamples), maxSample);
-		unsigned chn= beatBuf->m_channelNum = m_sample->m_chn;
-		beatBuf->Allocate();
-
-		float mult = 1.0f / m_sample->m_max_v;
-
-		if (beatBuf->m_sampleRate == (float)m_sample->m_origin_sample_rate)
-		{
+		unsigned chn = m_sample->m_chn;
+		const std::vector<float>& resampled = m_sample->Resampled((unsigned)beatBuf->m_sampleRate);
+		unsigned length = (unsigned)(resampled.size() / chn);
 
-			for (unsigned j = 0; j < beatBuf->m_sampleNum; j++)
-			{
-				float x2 = (float)j / fNumOfSamples;
-				float amplitude = 1.0f - expf((x2 - 1.0f)*10.0f);
+		beatBuf->m_sampleNum = min((unsigned)ceilf(fNumOfSamples), length);
+		beatBuf->m_channelNum = chn;
+		beatBuf->Allocate();
+		memcpy(beatBuf->m_data, resampled.data(), sizeof(float)*beatBuf->m_sampleNum*chn);
 
-				for (unsigned c = 0; c < chn; c++)
-				{
-					beatBuf->m_data[j * chn + c] = amplitude*m_sample->m_wav_samples[j * chn + c] * mult;
-				}
-			}
-		}
-		else
-		{
-			bool interpolation = beatBuf->m_sampleRate >= (float)m_sample->m_origin_sample_rate;
-			for (unsigned j = 0; j < beatBuf->m_sampleNum; j++)
-			{
-				float x2 = (float)j / fNumOfSamples;
-				float amplitude = 1.0f - expf((x2 - 1.0f)*10.0f);
-
-				float wave[2];
-				if (interpolation)
-				{
-					float pos = (float)j *(float)m_sample->m_origin_sample_rate / beatBuf->m_sampleRate;
-					int ipos1 = (int)pos;
-					float frac = pos - (float)ipos1;
-					int ipos2 = ipos1 + 1;
-					if (ipos2 >= (int)m_sample->m_wav_length) ipos2 = (int)m_sample->m_wav_length - 1;
-
-					// cubic interpolation
-					int ipos0 = ipos1 - 1;
-					if (ipos0 < 0) ipos0 = 0;
-
-					int ipos3 = ipos1 + 2;
-					if (ipos3 >= (int)m_sample->m_wav_length) ipos3 = (int)m_sample->m_wav_length - 1;
-
-					for (unsigned c = 0; c < chn; c++)
-					{
-						float p0 = m_sample->m_wav_samples[ipos0*chn +c];
-						float p1 = m_sample->m_wav_samples[ipos1*chn + c];
-						float p2 = m_sample->m_wav_samples[ipos2*chn + c];
-						float p3 = m_sample->m_wav_samples[ipos3*chn + c];
-
-						wave[c] = (-0.5f*p0 + 1.5f*p1 - 1.5f*p2 + 0.5f*p3)*powf(frac, 3.0f) +
-							(p0 - 2.5f*p1 + 2.0f*p2 - 0.5f*p3)*powf(frac, 2.0f) +
-							(-0.5f*p0 + 0.5f*p2)*frac + p1;
-
-					}
-					
-				}
-				else
-				{
-					int ipos1 = (int)ceilf(((float)j - 0.5f)*(float)m_sample->m_origin_sample_rate / beatBuf->m_sampleRate);
-					int ipos2 = (int)floorf(((float)j + 0.5f)*(float)m_sample->m_origin_sample_rate / beatBuf->m_sampleRate);
-					if (ipos1 < 0) ipos1 = 0;
-					if (ipos2 >= (int)m_sample->m_wav_length) ipos2 = (int)m_sample->m_wav_length - 1;
-					int count = ipos2 - ipos1 + 1;
-
-					for (unsigned c = 0; c < chn; c++)
-					{
-						float sum = 0.0f;
-						for (int ipos = ipos1; ipos <= ipos2; ipos++)
-						{
-							sum += m_sample->m_wav_samples[ipos*chn+c];
-						}
-						wave[c] = sum / (float)count;
-					}
-				}
-				if (beatBuf->m_channelNum == 1)
-				{
-					beatBuf->m_data[j] = amplitude*wave[0] * mult;
-				}
-				else if (beatBuf->m_channelNum == 2)
-				{
-					beatBuf->m_data[j * 2] = amplitude*wave[0] * mult;
-					beatBuf->m_data[j * 2 + 1] = amplitude*wave[1] * mult;
-				}
-			}
-		}
+		// a hit cut before the end of the sample is faded out, otherwise the sample decays by itself
+		if (beatBuf->m_sampleNum < length)
+			Resampler::ApplyRelease(beatBuf->m_data, beatBuf->m_sampleNum, chn, fNumOfSamples);
 	}
 	
 private:
@@ -195,14 +188,14 @@ public:
 	}
 	virtual Percussion_deferred Init()
 	{
-		if (!m_sample.m_wav_samples) m_sample.LoadWav(m_root.data(), m_name.data());
+		if (!m_sample->m_wav_samples) m_sample->LoadWav(m_root.data(), m_name.data());
 
 		Percussion_deferred perc = Percussion_deferred::Instance<PercussionSampler>();
-		perc.DownCast<PercussionSampler>()->SetSample(&m_sample);
+		perc.DownCast<PercussionSampler>()->SetSample(m_sample);
 		return perc;
 	}
 private:
-	PercussionSample m_sample;
+	PercussionSample_deferred m_sample;
 };
 
 PY_SCOREDRAFT_EXTENSION_INTERFACE void Initialize(PyScoreDraft* pyScoreDraft, const char* root)
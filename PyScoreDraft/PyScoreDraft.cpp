@@ -22,6 +22,7 @@
 
 #include <Deferred.h>
 #include <TrackBuffer.h>
+#include <BufferPool.h>
 #include <instruments/PureSin.h>
 #include <instruments/Square.h>
 #include <instruments/Sawtooth.h>
@@ -32,6 +33,8 @@
 #include "WinWavWriter.h"
 
 #include <vector>
+#include <map>
+#include <cmath>
 #include <utility>
 #include <string>
 #include <string.h>
@@ -249,10 +252,18 @@ static PyObject* GenerateCode(PyObject *self, PyObject *args)
 static PyObject* InitTrackBuffer(PyObject *self, PyObject *args)
 {
 	unsigned chn;
-	if (!PyArg_ParseTuple(args, "I", &chn))
+	const char* storageName = "file";
+	if (!PyArg_ParseTuple(args, "I|s", &chn, &storageName))
 		return NULL;
 
-	TrackBuffer_deferred buffer(44100,chn);
+	TrackStorageType storage;
+	if (!TrackStorage::TypeFromName(storageName, storage))
+	{
+		printf("Unknown track storage: %s, using file.\n", storageName);
+		storage = TrackStorage_File;
+	}
+
+	TrackBuffer_deferred buffer(44100, chn, storage);
 	unsigned id = s_PyScoreDraft.AddTrackBuffer(buffer);
 	return PyLong_FromUnsignedLong((unsigned long)(id));
 }
@@ -399,7 +410,23 @@ static PyObject* TrackBufferGetNumberOfSamples(PyObject *self, PyObject *args)
 		return NULL;
 
 	TrackBuffer_deferred buffer = s_PyScoreDraft.GetTrackBuffer(BufferId);
-	return PyLong_FromLong((long)buffer->NumberOfSamples());
+	return PyLong_FromUnsignedLongLong((unsigned long long)buffer->NumberOfSamples());
+}
+
+static PyObject* TrackBufferGetChunkPeaks(PyObject *self, PyObject *args)
+{
+	unsigned BufferId;
+	if (!PyArg_ParseTuple(args, "I", &BufferId))
+		return NULL;
+
+	TrackBuffer_deferred buffer = s_PyScoreDraft.GetTrackBuffer(BufferId);
+	std::vector<float> peaks;
+	buffer->GetChunkPeaks(peaks);
+
+	PyObject* list = PyList_New(peaks.size());
+	for (size_t i = 0; i < peaks.size(); i++)
+		PyList_SetItem(list, i, PyFloat_FromDouble((double)peaks[i]));
+	return list;
 }
 
 static PyObject* TrackBufferGetNumberOfChannels(PyObject *self, PyObject *args)
@@ -425,8 +452,8 @@ static PyObject* TrackBufferGetCursor(PyObject *self, PyObject *args)
 static PyObject* TrackBufferSetCursor(PyObject *self, PyObject *args)
 {
 	unsigned BufferId;
-	float cursor;
-	if (!PyArg_ParseTuple(args, "If", &BufferId, &cursor))
+	double cursor;
+	if (!PyArg_ParseTuple(args, "Id", &BufferId, &cursor))
 		return NULL;
 
 	TrackBuffer_deferred buffer = s_PyScoreDraft.GetTrackBuffer(BufferId);
@@ -438,8 +465,8 @@ static PyObject* TrackBufferSetCursor(PyObject *self, PyObject *args)
 static PyObject* TrackBufferMoveCursor(PyObject *self, PyObject *args)
 {
 	unsigned BufferId;
-	float cursor_delta;
-	if (!PyArg_ParseTuple(args, "If", &BufferId, &cursor_delta))
+	double cursor_delta;
+	if (!PyArg_ParseTuple(args, "Id", &BufferId, &cursor_delta))
 		return NULL;
 
 	TrackBuffer_deferred buffer = s_PyScoreDraft.GetTrackBuffer(BufferId);
@@ -448,6 +475,19 @@ static PyObject* TrackBufferMoveCursor(PyObject *self, PyObject *args)
 	return PyLong_FromLong(0);
 }
 
+// InstrumentPlay(), PercussionPlay() and Sing() convert the Python sequence while holding the GIL,
+// then render without it, so that Python threads can render different tracks at the same time.
+// Tuning commands inside a sequence act on a copy of the tune state taken at the start of the call,
+// which is written back to the object when the call returns.
+
+struct InstrumentEvent
+{
+	Note note;
+	bool isTune;
+	std::string tune;
+	InstrumentEvent() : isTune(false) {}
+};
+
 static PyObject* InstrumentPlay(PyObject *self, PyObject *args)
 {
 	unsigned TrackBufferId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
@@ -459,6 +499,7 @@ static PyObject* InstrumentPlay(PyObject *self, PyObject *args)
 	TrackBuffer_deferred buffer = s_PyScoreDraft.GetTrackBuffer(TrackBufferId);
 	Instrument_deferred instrument = s_PyScoreDraft.GetInstrument(InstrumentId);
 
+	std::vector<InstrumentEvent> events;
 	size_t piece_count = PyList_Size(seq_py);
 	for (size_t i = 0; i < piece_count; i++)
 	{
@@ -482,20 +523,18 @@ static PyObject* InstrumentPlay(PyObject *self, PyObject *args)
 							_item = PyTuple_GetItem(item, j);
 							if (!PyObject_TypeCheck(_item, &PyTuple_Type)) break;
 
-							Note note;
-							note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(_item, 0));
-							note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(_item, 1));
-					
-							instrument->PlayNote(*buffer, note, tempo, RefFreq);
+							InstrumentEvent e;
+							e.note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(_item, 0));
+							e.note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(_item, 1));
+							events.push_back(e);
 						}
 					}
 					else if (PyObject_TypeCheck(_item, &PyLong_Type)) // singing rap
 					{
-						int duration = (int)PyLong_AsLong(PyTuple_GetItem(item, j));
-						Note note;
-						note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(item, j + 1));
-						note.m_duration = duration;
-						instrument->PlayNote(*buffer, note, tempo, RefFreq);
+						InstrumentEvent e;
+						e.note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(item, j + 1));
+						e.note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(item, j));
+						events.push_back(e);
 
 						j++; // at freq1
 						j++; // at freq2
@@ -505,19 +544,36 @@ static PyObject* InstrumentPlay(PyObject *self, PyObject *args)
 			}
 			else if (PyObject_TypeCheck(_item, &PyFloat_Type)) // note
 			{
-				Note note;
-				note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(item, 0));
-				note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(item, 1));
-
-				instrument->PlayNote(*buffer, note, tempo, RefFreq);
+				InstrumentEvent e;
+				e.note.m_freq_rel = (float)PyFloat_AsDouble(PyTuple_GetItem(item, 0));
+				e.note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(item, 1));
+				events.push_back(e);
 			}
 		}
 		else if (PyObject_TypeCheck(item, &PyUnicode_Type))
 		{
-			instrument->Tune(_PyUnicode_AsString(item));
+			InstrumentEvent e;
+			e.isTune = true;
+			e.tune = _PyUnicode_AsString(item);
+			events.push_back(e);
 		}
 	}
 
+	TuneState state = instrument->GetTuneState();
+
+	Py_BEGIN_ALLOW_THREADS
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const InstrumentEvent& e = events[i];
+		if (e.isTune)
+			instrument->ApplyTune(e.tune.data(), state);
+		else
+			instrument->PlayNote(*buffer, e.note, state, tempo, RefFreq);
+	}
+	Py_END_ALLOW_THREADS
+
+	instrument->SetTuneState(state);
+
 	return PyLong_FromUnsignedLong(0);
 }
 
@@ -534,6 +590,219 @@ static PyObject* InstrumentTune(PyObject *self, PyObject *args)
 	return PyLong_FromLong(0);
 }
 
+/*
+	A list nested in a beat sequence is a pattern. A pattern is rendered once for each
+	set of tune states it starts with, on a scratch track, and the resulting clip is blended
+	into the track at each of its repetitions, so a drum part made of a few repeated bars
+	costs little more than rendering those bars. Identical nested lists share their clips.
+	The clips only live for the duration of the call. A clip is rendered at the sub-sample
+	position of its first repetition; where a pattern doesn't last a whole number of samples,
+	the beats of the other repetitions may land one sample away from where they would when
+	played one by one.
+	Patterns that backspace before their start, or send commands other than "volume" and
+	"pan", which change the percussion itself, are played beat by beat.
+*/
+
+struct PercussionEvent
+{
+	int percId;
+	int duration;
+	bool isTune;
+	std::string tune;
+	int pattern; // index of a nested sequence in the pattern list, -1 for a beat
+	PercussionEvent() : percId(-1), duration(0), isTune(false), pattern(-1) {}
+
+	bool operator == (const PercussionEvent& e) const
+	{
+		return percId == e.percId && duration == e.duration && isTune == e.isTune && tune == e.tune && pattern == e.pattern;
+	}
+};
+
+struct PercussionClip
+{
+	std::vector<TuneState> startStates;
+	std::vector<TuneState> endStates;
+	NoteBuffer wave;
+};
+
+typedef Deferred<PercussionClip> PercussionClip_deferred;
+
+struct PercussionPattern
+{
+	std::vector<PercussionEvent> events;
+	int duration; // in the same unit as the beat durations
+	int minPos; // lowest position reached by backspaces, relative to the start
+	bool commonTunesOnly;
+	std::vector<PercussionClip_deferred> clips;
+};
+
+static bool SameTuneStates(const std::vector<TuneState>& a, const std::vector<TuneState>& b)
+{
+	for (size_t i = 0; i < a.size(); i++)
+		if (a[i].volume != b[i].volume || a[i].pan != b[i].pan) return false;
+	return true;
+}
+
+// "parsed" maps the Python lists already converted to their pattern, [bar]*100 is converted once
+static void ParseBeatSequence(PyObject *seq_py, std::vector<PercussionEvent>& events, std::vector<PercussionPattern>& patterns, std::map<PyObject*, int>& parsed)
+{
+	size_t beat_count = PyList_Size(seq_py);
+	for (size_t i = 0; i < beat_count; i++)
+	{
+		PyObject *item = PyList_GetItem(seq_py, i);
+		PercussionEvent e;
+		if (PyObject_TypeCheck(item, &PyList_Type))
+		{
+			std::map<PyObject*, int>::iterator iter = parsed.find(item);
+			if (iter != parsed.end())
+			{
+				e.pattern = iter->second;
+				events.push_back(e);
+				continue;
+			}
+
+			PercussionPattern pattern;
+			ParseBeatSequence(item, pattern.events, patterns, parsed);
+
+			for (size_t j = 0; j < patterns.size(); j++)
+				if (patterns[j].events == pattern.events)
+				{
+					e.pattern = (int)j;
+					break;
+				}
+
+			if (e.pattern < 0)
+			{
+				int pos = 0;
+				pattern.minPos = 0;
+				pattern.commonTunesOnly = true;
+				for (size_t j = 0; j < pattern.events.size(); j++)
+				{
+					const PercussionEvent& sub = pattern.events[j];
+					if (sub.isTune)
+					{
+						TuneState state;
+						if (!state.Tune(sub.tune.data())) pattern.commonTunesOnly = false;
+					}
+					else if (sub.pattern >= 0)
+					{
+						const PercussionPattern& subPattern = patterns[sub.pattern];
+						pattern.minPos = min(pattern.minPos, pos + subPattern.minPos);
+						pattern.commonTunesOnly = pattern.commonTunesOnly && subPattern.commonTunesOnly;
+						pos += subPattern.duration;
+					}
+					else
+					{
+						pos += sub.duration;
+						pattern.minPos = min(pattern.minPos, pos);
+					}
+				}
+				pattern.duration = pos;
+
+				e.pattern = (int)patterns.size();
+				patterns.push_back(pattern);
+			}
+			parsed[item] = e.pattern;
+			events.push_back(e);
+			continue;
+		}
+
+		e.percId = (int)PyLong_AsLong(PyTuple_GetItem(item, 0));
+
+		PyObject *operation = PyTuple_GetItem(item, 1);
+		if (PyObject_TypeCheck(operation, &PyLong_Type))
+		{
+			e.duration = (int)PyLong_AsLong(operation);
+			events.push_back(e);
+		}
+		else if (PyObject_TypeCheck(operation, &PyUnicode_Type))
+		{
+			e.isTune = true;
+			e.tune = _PyUnicode_AsString(operation);
+			events.push_back(e);
+		}
+	}
+}
+
+class BeatSequencePlayer
+{
+public:
+	BeatSequencePlayer(Percussion_deferred* percs, std::vector<PercussionPattern>& patterns, unsigned tempo)
+		: m_percs(percs), m_patterns(patterns), m_tempo(tempo) {}
+
+	void Play(TrackBuffer& buffer, const std::vector<PercussionEvent>& events, std::vector<TuneState>& states)
+	{
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const PercussionEvent& e = events[i];
+			if (e.isTune)
+				m_percs[e.percId]->ApplyTune(e.tune.data(), states[e.percId]);
+			else if (e.pattern >= 0)
+				PlayPattern(buffer, m_patterns[e.pattern], states);
+			else if (e.percId >= 0)
+				m_percs[e.percId]->PlayBeat(buffer, e.duration, states[e.percId], m_tempo);
+			else if (e.duration >= 0)
+				Percussion::PlaySilence(buffer, e.duration, m_tempo);
+			else
+				Percussion::PlayBackspace(buffer, -e.duration, m_tempo);
+		}
+	}
+
+private:
+	void PlayPattern(TrackBuffer& buffer, PercussionPattern& pattern, std::vector<TuneState>& states)
+	{
+		if (pattern.minPos < 0 || !pattern.commonTunesOnly)
+		{
+			Play(buffer, pattern.events, states);
+			return;
+		}
+
+		PercussionClip_deferred clip;
+		size_t i = 0;
+		for (; i < pattern.clips.size(); i++)
+			if (SameTuneStates(pattern.clips[i]->startStates, states)) break;
+
+		if (i < pattern.clips.size())
+		{
+			clip = pattern.clips[i];
+			states = clip->endStates;
+		}
+		else
+		{
+			// rendered at the sub-sample offset of the cursor, which is dropped when stamping
+			double cursor = buffer.GetCursor();
+			double offset = cursor - floor(cursor);
+
+			clip->startStates = states;
+			TrackBuffer scratch(buffer.Rate(), buffer.NumberOfChannels(), TrackStorage_Memory);
+			scratch.SetCursor(offset);
+			Play(scratch, pattern.events, states);
+			clip->endStates = states;
+
+			NoteBuffer& wave = clip->wave;
+			wave.m_sampleRate = (float)buffer.Rate();
+			wave.m_channelNum = buffer.NumberOfChannels();
+			wave.m_sampleNum = (unsigned)scratch.NumberOfSamples();
+			wave.m_cursorDelta = scratch.GetCursor() - offset;
+			if (wave.m_sampleNum > 0)
+			{
+				wave.Allocate();
+				scratch.ReadSamples(0, wave.m_sampleNum, wave.m_data);
+			}
+			pattern.clips.push_back(clip);
+		}
+
+		if (clip->wave.m_sampleNum > 0)
+			buffer.WriteBlend(clip->wave);
+		else
+			buffer.MoveCursor(clip->wave.m_cursorDelta);
+	}
+
+	Percussion_deferred* m_percs;
+	std::vector<PercussionPattern>& m_patterns;
+	unsigned m_tempo;
+};
+
 static PyObject* PercussionPlay(PyObject *self, PyObject *args)
 {
 	unsigned TrackBufferId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
@@ -545,35 +814,26 @@ static PyObject* PercussionPlay(PyObject *self, PyObject *args)
 
 	size_t perc_count = PyList_Size(percId_list);
 	Percussion_deferred *perc_List = new Percussion_deferred[perc_count];
+	std::vector<TuneState> states(perc_count);
 	for (size_t i = 0; i < perc_count; i++)
 	{
 		unsigned long percId = PyLong_AsUnsignedLong(PyList_GetItem(percId_list, i));
 		perc_List[i] = s_PyScoreDraft.GetPercussion(percId);
+		states[i] = perc_List[i]->GetTuneState();
 	}
 
-	size_t beat_count = PyList_Size(seq_py);
-	for (size_t i = 0; i < beat_count; i++)
-	{
-		PyObject *item = PyList_GetItem(seq_py, i);
-		int percId = (int)PyLong_AsLong(PyTuple_GetItem(item, 0));
+	std::vector<PercussionEvent> events;
+	std::vector<PercussionPattern> patterns;
+	std::map<PyObject*, int> parsed;
+	ParseBeatSequence(seq_py, events, patterns, parsed);
 
-		PyObject *operation = PyTuple_GetItem(item, 1);
-		if (PyObject_TypeCheck(operation, &PyLong_Type))
-		{
-			int duration = (int)PyLong_AsLong(operation);
+	Py_BEGIN_ALLOW_THREADS
+	BeatSequencePlayer player(perc_List, patterns, tempo);
+	player.Play(*buffer, events, states);
+	Py_END_ALLOW_THREADS
 
-			if (percId >= 0)
-				perc_List[percId]->PlayBeat(*buffer, duration, tempo);
-			else if (duration >= 0)
-				Percussion::PlaySilence(*buffer, duration, tempo);
-			else
-				Percussion::PlayBackspace(*buffer, -duration, tempo);
-		}
-		else if (PyObject_TypeCheck(operation, &PyUnicode_Type))
-		{
-			perc_List[percId]->Tune(_PyUnicode_AsString(operation));
-		}
-	}
+	for (size_t i = 0; i < perc_count; i++)
+		perc_List[i]->SetTuneState(states[i]);
 
 	delete[] perc_List;
 
@@ -593,6 +853,15 @@ static PyObject* PercussionTune(PyObject *self, PyObject *args)
 	return PyLong_FromLong(0);
 }
 
+struct SingerEvent
+{
+	SingingSequence singing_pieces;
+	RapSequence rap_pieces;
+	bool isTune;
+	std::string tune;
+	SingerEvent() : isTune(false) {}
+};
+
 static PyObject* Sing(PyObject *self, PyObject *args)
 {
 	unsigned TrackBufferId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
@@ -606,6 +875,7 @@ static PyObject* Sing(PyObject *self, PyObject *args)
 	Singer_deferred singer = s_PyScoreDraft.GetSinger(SingerId);
 	std::string lyric_charset = singer->GetLyricCharset();
 
+	std::vector<SingerEvent> events;
 	size_t piece_count = PyList_Size(seq_py);
 
 	for (size_t i = 0; i < piece_count; i++)
@@ -616,8 +886,9 @@ static PyObject* Sing(PyObject *self, PyObject *args)
 			PyObject *_item = PyTuple_GetItem(item, 0);
 			if (PyObject_TypeCheck(_item, &PyUnicode_Type)) // singing
 			{
-				SingingSequence singing_pieces;
-				RapSequence rap_pieces;
+				events.push_back(SingerEvent());
+				SingingSequence& singing_pieces = events.back().singing_pieces;
+				RapSequence& rap_pieces = events.back().rap_pieces;
 
 				size_t tupleSize = PyTuple_Size(item);
 
@@ -662,29 +933,6 @@ static PyObject* Sing(PyObject *self, PyObject *args)
 					}
 
 				}
-				if (singing_pieces.size() > 0)
-				{
-					if (singing_pieces.size() < 2)
-					{
-						singer->SingPiece(*buffer, singing_pieces[0], tempo, RefFreq);
-					}
-					else
-					{
-						singer->SingConsecutivePieces(*buffer, singing_pieces, tempo, RefFreq);
-					}
-				}
-				if (rap_pieces.size() > 0)
-				{
-					if (rap_pieces.size() < 2)
-					{
-						singer->RapAPiece(*buffer, rap_pieces[0], tempo, RefFreq);
-					}
-					else
-					{
-						singer->RapConsecutivePieces(*buffer, rap_pieces, tempo, RefFreq);
-					}
-				}
-				
 			}
 			else if (PyObject_TypeCheck(_item, &PyFloat_Type)) // note
 			{
@@ -696,16 +944,90 @@ static PyObject* Sing(PyObject *self, PyObject *args)
 				note.m_duration = (int)PyLong_AsLong(PyTuple_GetItem(item, 1));
 
 				piece.m_notes.push_back(note);
-				singer->SingPiece(*buffer, piece, tempo, RefFreq);
+
+				events.push_back(SingerEvent());
+				events.back().singing_pieces.push_back(piece);
 			}
 
 		}
 		else if (PyObject_TypeCheck(item, &PyUnicode_Type))
 		{
-			singer->Tune(_PyUnicode_AsString(item));
+			events.push_back(SingerEvent());
+			events.back().isTune = true;
+			events.back().tune = _PyUnicode_AsString(item);
 		}
 	}
 
+	TuneState state = singer->GetTuneState();
+
+	Py_BEGIN_ALLOW_THREADS
+
+	// voice data is loaded ahead for the whole sequence, so the generation doesn't wait for the disk.
+	// The tuning commands are replayed on a copy of the state, for each part to be looked at with its own
+	std::vector<const SingingSequence*> singing;
+	std::vector<TuneState> singingStates;
+	std::vector<const RapSequence*> raps;
+	std::vector<TuneState> rapStates;
+	TuneState prefetchState = state;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		if (events[i].isTune)
+		{
+			singer->ApplyTune(events[i].tune.data(), prefetchState);
+			continue;
+		}
+		if (events[i].singing_pieces.size() > 0)
+		{
+			singing.push_back(&events[i].singing_pieces);
+			singingStates.push_back(prefetchState);
+		}
+		if (events[i].rap_pieces.size() > 0)
+		{
+			raps.push_back(&events[i].rap_pieces);
+			rapStates.push_back(prefetchState);
+		}
+	}
+	SingerPrefetch_Deferred prefetch = singer->PrefetchSequences(buffer->Rate(), singing, singingStates, raps, rapStates, tempo, RefFreq);
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const SingerEvent& e = events[i];
+		if (e.isTune)
+		{
+			singer->ApplyTune(e.tune.data(), state);
+			continue;
+		}
+
+		if (e.singing_pieces.size() > 0)
+		{
+			if (e.singing_pieces.size() < 2)
+			{
+				singer->SingPiece(*buffer, e.singing_pieces[0], state, tempo, RefFreq);
+			}
+			else
+			{
+				singer->SingConsecutivePieces(*buffer, e.singing_pieces, state, tempo, RefFreq);
+			}
+		}
+		if (e.rap_pieces.size() > 0)
+		{
+			if (e.rap_pieces.size() < 2)
+			{
+				singer->RapAPiece(*buffer, e.rap_pieces[0], state, tempo, RefFreq);
+			}
+			else
+			{
+				singer->RapConsecutivePieces(*buffer, e.rap_pieces, state, tempo, RefFreq);
+			}
+		}
+	}
+
+	// waits for the background loading, without the GIL, which it may need
+	prefetch.Abondon();
+	Py_END_ALLOW_THREADS
+
+	singer->SetTuneState(state);
+
 	return PyLong_FromUnsignedLong(0);
 }
 
@@ -726,6 +1048,9 @@ static PyObject* MixTrackBufferList(PyObject *self, PyObject *args)
 {
 	unsigned TargetTrackBufferId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
 	PyObject *list = PyTuple_GetItem(args, 1);
+	unsigned numThreads = 0;
+	if (PyTuple_Size(args) > 2)
+		numThreads = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 2));
 
 	TrackBuffer_deferred targetBuffer = s_PyScoreDraft.GetTrackBuffer(TargetTrackBufferId);
 	
@@ -737,12 +1062,44 @@ static PyObject* MixTrackBufferList(PyObject *self, PyObject *args)
 		bufferList[i] = s_PyScoreDraft.GetTrackBuffer(listId);
 	}
 
-	targetBuffer->CombineTracks((unsigned)bufferCount, bufferList);
+	targetBuffer->CombineTracks((unsigned)bufferCount, bufferList, numThreads);
 	delete[] bufferList;
 
 	return PyLong_FromUnsignedLong(0);
 }
 
+static PyObject* MixTrackBufferListToWav(PyObject *self, PyObject *args)
+{
+	PyObject *list = PyTuple_GetItem(args, 0);
+	PyObject *fnObj = PyTuple_GetItem(args, 1);
+	const char* fn = _PyUnicode_AsString(fnObj);
+	unsigned chn = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 2));
+	unsigned numThreads = 0;
+	if (PyTuple_Size(args) > 3)
+		numThreads = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 3));
+
+	if (chn < 1) chn = 1;
+	else if (chn > 2) chn = 2;
+
+	size_t bufferCount = PyList_Size(list);
+	TrackBuffer_deferred* bufferList = new TrackBuffer_deferred[bufferCount];
+	for (size_t i = 0; i < bufferCount; i++)
+	{
+		unsigned long listId = PyLong_AsUnsignedLong(PyList_GetItem(list, i));
+		bufferList[i] = s_PyScoreDraft.GetTrackBuffer(listId);
+	}
+
+	bool ok = MixTracksToWav((unsigned)bufferCount, bufferList, chn, fn, numThreads);
+	delete[] bufferList;
+
+	if (!ok)
+	{
+		PyErr_Format(PyExc_RuntimeError, "Failed to mix to %s: the track-buffers have different rates, or the file cannot be written", fn);
+		return NULL;
+	}
+	return PyLong_FromUnsignedLong(0);
+}
+
 static PyObject* WriteTrackBufferToWav(PyObject *self, PyObject *args)
 {
 	unsigned BufferId;
@@ -756,6 +1113,37 @@ static PyObject* WriteTrackBufferToWav(PyObject *self, PyObject *args)
 	return PyLong_FromUnsignedLong(0);
 }
 
+static PyObject* GetMemoryCounters(PyObject *self, PyObject *args)
+{
+	BufferPool::Counters counters = BufferPool::GetCounters();
+	PyObject* dict = PyDict_New();
+	PyObject* value;
+
+	value = PyLong_FromUnsignedLongLong((unsigned long long)counters.allocations);
+	PyDict_SetItemString(dict, "allocations", value);
+	Py_DECREF(value);
+
+	value = PyLong_FromUnsignedLongLong((unsigned long long)counters.systemAllocations);
+	PyDict_SetItemString(dict, "systemAllocations", value);
+	Py_DECREF(value);
+
+	value = PyLong_FromUnsignedLongLong((unsigned long long)counters.bytesInUse);
+	PyDict_SetItemString(dict, "bytesInUse", value);
+	Py_DECREF(value);
+
+	value = PyLong_FromUnsignedLongLong((unsigned long long)counters.peakBytesInUse);
+	PyDict_SetItemString(dict, "peakBytesInUse", value);
+	Py_DECREF(value);
+
+	return dict;
+}
+
+static PyObject* ResetMemoryCounters(PyObject *self, PyObject *args)
+{
+	BufferPool::ResetCounters();
+	return PyLong_FromUnsignedLong(0);
+}
+
 static PyObject* CallExtension(PyObject *self, PyObject *args)
 {
 	unsigned extId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
@@ -769,16 +1157,20 @@ static PyObject* CallExtension(PyObject *self, PyObject *args)
 	return ret;
 }
 
-static PyObject* TellDuration(PyObject *self, PyObject *args)
+// nested lists are beat patterns, see PercussionPlay()
+static int SequenceDuration(PyObject *seq_py)
 {
-	PyObject *seq_py = PyTuple_GetItem(args, 0);
 	size_t piece_count = PyList_Size(seq_py);
 
-	unsigned dure = 0;
+	int dure = 0;
 	for (size_t i = 0; i < piece_count; i++)
 	{
 		PyObject *item = PyList_GetItem(seq_py, i);
-		if (PyObject_TypeCheck(item, &PyTuple_Type))
+		if (PyObject_TypeCheck(item, &PyList_Type))
+		{
+			dure += SequenceDuration(item);
+		}
+		else if (PyObject_TypeCheck(item, &PyTuple_Type))
 		{
 			PyObject* _item = PyTuple_GetItem(item, 0);
 			if (PyObject_TypeCheck(_item, &PyUnicode_Type)) // singing
@@ -814,13 +1206,21 @@ static PyObject* TellDuration(PyObject *self, PyObject *args)
 			}
 			else if (PyObject_TypeCheck(_item, &PyLong_Type)) // beat
 			{
-				dure += (int)PyLong_AsLong(PyTuple_GetItem(item, 1));
+				// (index, "command") is a tuning command, no duration
+				PyObject* operation = PyTuple_GetItem(item, 1);
+				if (PyObject_TypeCheck(operation, &PyLong_Type))
+					dure += (int)PyLong_AsLong(operation);
 			}
 		}
 	}
 
-	return PyLong_FromUnsignedLong(dure);
+	return dure;
+}
 
+static PyObject* TellDuration(PyObject *self, PyObject *args)
+{
+	PyObject *seq_py = PyTuple_GetItem(args, 0);
+	return PyLong_FromUnsignedLong((unsigned)SequenceDuration(seq_py));
 }
 
 static PyMethodDef s_PyScoreDraftMethods[] = {
@@ -914,6 +1314,12 @@ static PyMethodDef s_PyScoreDraftMethods[] = {
 		METH_VARARGS,
 		""
 	},
+	{
+		"TrackBufferGetChunkPeaks",
+		TrackBufferGetChunkPeaks,
+		METH_VARARGS,
+		""
+	},
 	{
 		"TrackBufferGetNumberOfChannels",
 		TrackBufferGetNumberOfChannels,
@@ -980,12 +1386,30 @@ static PyMethodDef s_PyScoreDraftMethods[] = {
 		METH_VARARGS,
 		""
 	},
+	{
+		"MixTrackBufferListToWav",
+		MixTrackBufferListToWav,
+		METH_VARARGS,
+		""
+	},
 	{
 		"WriteTrackBufferToWav",
 		WriteTrackBufferToWav,
 		METH_VARARGS,
 		""
 	},
+	{
+		"GetMemoryCounters",
+		GetMemoryCounters,
+		METH_VARARGS,
+		""
+	},
+	{
+		"ResetMemoryCounters",
+		ResetMemoryCounters,
+		METH_VARARGS,
+		""
+	},
 	{
 		"CallExtension",
 		CallExtension,
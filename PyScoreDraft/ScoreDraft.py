@@ -38,15 +38,27 @@ def setDefaultNumberOfChannels(defChn):
 	global defaultNumOfChannels
 	defaultNumOfChannels=defChn
 
+defaultTrackStorage='file'
+def setDefaultTrackStorage(storage):
+	'''
+	Set the storage used by newly created track-buffers.
+	storage -- 'file': a temporary file, slowest but uses no memory
+	           'memory': growable in-memory buffer, fastest
+	           'mmap': memory-mapped temporary file, for tracks that don't fit in RAM
+	'''
+	global defaultTrackStorage
+	defaultTrackStorage=storage
+
 
 class TrackBuffer:
 	'''
 	Basic data structure storing waveform.
 	The content can either be generated by "play" and "sing" calls or by mixing track-buffer into a new one
 	'''
-	def __init__ (self, chn=-1):
+	def __init__ (self, chn=-1, storage=None):
 		'''
 		chn is the number of channels, which can be 1 or 2
+		storage is where the waveform is kept, which can be 'file', 'memory' or 'mmap'
 		'''
 		if chn==-1:
 			chn=defaultNumOfChannels
@@ -54,7 +66,9 @@ class TrackBuffer:
 			chn=1
 		elif chn>2:
 			chn=2
-		self.id= PyScoreDraft.InitTrackBuffer(chn)
+		if storage is None:
+			storage=defaultTrackStorage
+		self.id= PyScoreDraft.InitTrackBuffer(chn, storage)
 
 	def __del__(self):
 		PyScoreDraft.DelTrackBuffer(self.id)
@@ -94,6 +108,14 @@ class TrackBuffer:
 		'''
 		return PyScoreDraft.TrackBufferGetNumberOfSamples(self.id)
 
+	def getChunkPeaks(self):
+		'''
+		Get the absolute peak values of the buffer, one for every 65536 PCM samples.
+		The values are tracked while the buffer is written, so this doesn't rescan the buffer.
+		Returned value is a list of floats
+		'''
+		return PyScoreDraft.TrackBufferGetChunkPeaks(self.id)
+
 	def getNumberOfChannles(self):
 		'''
 		Get the number of Channels of the buffer.
@@ -176,6 +198,8 @@ class Instrument:
 		tempo -- an integer defining the tempo of play in beats/minute.
 		refFreq  --  a floating point defining the reference-frequency in Hz.
 
+		The rendering doesn't hold the GIL, so different track-buffers can be played into from different threads,
+		even with the same instrument.
 		'''
 		PyScoreDraft.InstrumentPlay(buf.id, self.id, seq, tempo, refFreq)
 
@@ -225,10 +249,23 @@ class Percussion:
 
 		       In the beat sequence case, an index need to be provided to choose which persecussion the command is sent to.
 
+		       Beat sequences can also be nested in the list as patterns, example:
+		         [bar1, bar1, bar2, bar1, (0,48)... ]
+		       Each distinct pattern is rendered once for the tune states it starts with, then copied to each of its repetitions,
+		       so long drum tracks made of a few repeated bars render quickly.
+
 		tempo -- an integer defining the tempo of play in beats/minute.		
 		'''
 		PyScoreDraft.PercussionPlay(buf.id, ObjectToId(percList), seq, tempo)
 
+	@staticmethod
+	def playPattern(percList, buf, seq, repeats, tempo=80):
+		'''
+		Plays the beat sequence "seq" "repeats" times in a row. 
+		The sequence is rendered once and copied to each repetition, see "play()".
+		'''
+		PyScoreDraft.PercussionPlay(buf.id, ObjectToId(percList), [seq]*repeats, tempo)
+
 class Singer:
 	'''
 	Structure to define an singer object 
@@ -288,17 +325,35 @@ class Singer:
 
 		tempo -- an integer defining the tempo of singing in beats/minute.
 		refFreq  --  a floating point defining the reference-frequency in Hz.
+
+		The rendering doesn't hold the GIL, so different track-buffers can be sung into from different threads.
 		'''
 		PyScoreDraft.Sing(buf.id, self.id, seq, tempo, refFreq)
 
 
-def MixTrackBufferList (targetbuf, bufferList):
+def MixTrackBufferList (targetbuf, bufferList, threads=0):
 	'''
 	Function used to mix a list of track-buffers into another one
 	targetbuf -- an instance of TrackBuffer to contain the result
 	bufferList -- a list a track-buffers
+	threads -- number of threads used for mixing, 0 means one per core. The result is the same for any number of threads.
 	'''
-	PyScoreDraft.MixTrackBufferList(targetbuf.id, ObjectToId(bufferList))
+	PyScoreDraft.MixTrackBufferList(targetbuf.id, ObjectToId(bufferList), threads)
+
+def MixTrackBufferListToWav(bufferList, filename, chn=-1, threads=0):
+	'''
+	Function used to mix a list of track-buffers directly into a .wav file.
+	Gives the same result as MixTrackBufferList() into a new track-buffer followed by WriteTrackBufferToWav(),
+	without storing the mixed track.
+	bufferList -- a list a track-buffers
+	filename -- a string
+	chn -- number of channels of the .wav file, -1 means using the default number of channels
+	threads -- number of threads used for mixing, 0 means one per core
+	Raises RuntimeError if the track-buffers have different rates or the file cannot be written.
+	'''
+	if chn==-1:
+		chn=defaultNumOfChannels
+	PyScoreDraft.MixTrackBufferListToWav(ObjectToId(bufferList), filename, chn, threads)
 
 def WriteTrackBufferToWav(buf, filename):
 	'''
@@ -308,6 +363,23 @@ def WriteTrackBufferToWav(buf, filename):
 	'''
 	PyScoreDraft.WriteTrackBufferToWav(buf.id, filename)
 
+def GetMemoryCounters():
+	'''
+	Get the counters of the sample-buffer pool used for rendering and mixing.
+	Returned value is a dictionary:
+	allocations -- number of buffers requested since the last ResetMemoryCounters()
+	systemAllocations -- how many of them were not served from the pool
+	bytesInUse -- bytes currently held by buffers
+	peakBytesInUse -- largest bytesInUse since the last ResetMemoryCounters()
+	'''
+	return PyScoreDraft.GetMemoryCounters()
+
+def ResetMemoryCounters():
+	'''
+	Restart the counters returned by GetMemoryCounters(), typically before a render.
+	'''
+	PyScoreDraft.ResetMemoryCounters()
+
 # generate dynamic code
 g_generated_code_and_summary=PyScoreDraft.GenerateCode()
 exec(g_generated_code_and_summary[0])
@@ -419,10 +491,9 @@ class Document:
 
 	def mixDown(self,filename,chn=-1):
 		'''
-		Mix the track-buffers in the document to a temporary buffer and write to a .wav file.
+		Mix the track-buffers in the document and write to a .wav file.
+		The mix is streamed to the file, without a temporary buffer.
 		filename -- a string
 		'''
-		targetBuf=TrackBuffer(chn)
-		self.mix(targetBuf)
-		WriteTrackBufferToWav(targetBuf, filename)
+		MixTrackBufferListToWav(self.bufferList, filename, chn)
 
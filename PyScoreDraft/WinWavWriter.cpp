@@ -1,5 +1,7 @@
 #include "WinWavWriter.h"
 #include "TrackBuffer.h"
+#include "TrackMixer.h"
+#include <cmath>
 #include <WriteWav.h>
 
 #ifndef max
@@ -10,10 +12,22 @@
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
 #endif
 
+// the RIFF header stores sizes in 32 bits
+static unsigned ClampToWavLength(uint64_t numSamples, unsigned chn)
+{
+	uint64_t maxSamples = (0xFFFFFFFFull - 36) / (chn*sizeof(short));
+	if (numSamples > maxSamples)
+	{
+		printf("Track too long for .wav, truncated to %llu samples.\n", (unsigned long long)maxSamples);
+		return (unsigned)maxSamples;
+	}
+	return (unsigned)numSamples;
+}
+
 void WriteToWav(TrackBuffer& track, const char* fileName)
 {
-	unsigned numSamples = track.NumberOfSamples();
 	unsigned chn = track.NumberOfChannels();
+	unsigned numSamples = ClampToWavLength(track.NumberOfSamples(), chn);
 	unsigned sampleRate = track.Rate();
 	float volume = track.AbsoluteVolume();
 	float pan = track.Pan();
@@ -24,12 +38,20 @@ void WriteToWav(TrackBuffer& track, const char* fileName)
 
 	unsigned localBufferSize = track.GetLocalBufferSize();
 	float *buffer = new float[localBufferSize*chn];
-	unsigned pos = 0;
+	uint64_t pos = 0;
 	while (numSamples > 0)
 	{
 		unsigned writeCount = min(numSamples, localBufferSize);
-		track.GetSamples(pos, writeCount, buffer);
-		writer.WriteSamples(buffer, writeCount, volume, pan);
+		// chunks of the track that were never written are skipped without reading
+		if (track.IsSilent(pos, writeCount))
+		{
+			writer.WriteSilence(writeCount);
+		}
+		else
+		{
+			track.GetSamples(pos, writeCount, buffer);
+			writer.WriteSamples(buffer, writeCount, volume, pan);
+		}
 		numSamples -= writeCount;
 		pos += writeCount;
 	}
@@ -37,3 +59,52 @@ void WriteToWav(TrackBuffer& track, const char* fileName)
 	delete[] buffer;
 }
 
+
+bool MixTracksToWav(unsigned num, TrackBuffer_deferred* tracks, unsigned chn, const char* fileName, unsigned numThreads)
+{
+	if (num < 1)
+	{
+		// an empty .wav, as WriteToWav() gives for an empty buffer
+		WriteWav writer;
+		if (!writer.OpenFile(fileName)) return false;
+		writer.WriteHeader(44100, 0, chn);
+		return true;
+	}
+	unsigned sampleRate = tracks[0]->Rate();
+	TrackMixer mixer(num, tracks, sampleRate, chn, numThreads);
+	if (!mixer.IsValid()) return false;
+
+	// the peak is needed before anything is written, so the tracks are mixed twice
+	// first pass: length and peak of the mix
+	uint64_t numSamples = 0;
+	float maxValue = 0.0f;
+	unsigned batchStart;
+	for (batchStart = 0; batchStart < mixer.NumberOfWindows(); batchStart += mixer.BatchSize())
+	{
+		unsigned batchCount = mixer.MixBatch(batchStart);
+		for (unsigned i = 0; i < batchCount; i++)
+		{
+			const NoteBuffer& window = mixer.Window(i);
+			numSamples += window.m_sampleNum;
+			for (unsigned j = 0; j < window.m_sampleNum*chn; j++)
+				maxValue = max(maxValue, fabsf(window.m_data[j]));
+		}
+	}
+	float volume = maxValue > 0.0f ? 1.0f / maxValue : 1.0f;
+
+	// second pass: normalize and write
+	WriteWav writer;
+	if (!writer.OpenFile(fileName)) return false;
+	writer.WriteHeader(sampleRate, ClampToWavLength(numSamples, chn), chn);
+
+	for (batchStart = 0; batchStart < mixer.NumberOfWindows(); batchStart += mixer.BatchSize())
+	{
+		unsigned batchCount = mixer.MixBatch(batchStart);
+		for (unsigned i = 0; i < batchCount; i++)
+		{
+			const NoteBuffer& window = mixer.Window(i);
+			writer.WriteSamples(window.m_data, window.m_sampleNum, volume);
+		}
+	}
+	return true;
+}
@@ -2,7 +2,13 @@
 #define _WinWavWriter_h
 
 class TrackBuffer;
+class TrackBuffer_deferred;
 void WriteToWav(TrackBuffer& track, const char* fileName);
 
+// mixes the tracks straight into a .wav file, the same as CombineTracks() into an empty
+// buffer followed by WriteToWav(), without storing the mix
+// fails if the tracks have different rates or the file cannot be written
+bool MixTracksToWav(unsigned num, TrackBuffer_deferred* tracks, unsigned chn, const char* fileName, unsigned numThreads = 0);
+
 
 #endif
\ No newline at end of file
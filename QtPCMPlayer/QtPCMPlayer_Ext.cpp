@@ -64,9 +64,9 @@ PyObject * QPlayTrackBuffer(PyObject *args)
 	TrackBuffer_deferred buffer = s_pPyScoreDraft->GetTrackBuffer(BufferId);
 	buffer->SeekToCursor();
 
-	unsigned AlignPos = buffer->AlignPos();
+	unsigned AlignPos = (unsigned)buffer->AlignPos();
 
-	unsigned size = buffer->NumberOfSamples();
+	unsigned size = (unsigned)buffer->NumberOfSamples();
 	unsigned chn = buffer->NumberOfChannels();
 	short* data = new short[size*chn];
 
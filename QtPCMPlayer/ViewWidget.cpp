@@ -1,6 +1,6 @@
 #include "ViewWidget.h"
 #include <QPainter>
-#include <fft.h>
+#include <FFTPlan.h>
 
 ViewWidget::ViewWidget(QWidget* parent) : QOpenGLWidget(parent)
 {
@@ -51,16 +51,16 @@ void ViewWidget::paintGL()
 	case Spectrum:
 		{
 			// spectrum visualization
-			DComp* fftData = new DComp[2048];
+			float samples[2048];
 			for (unsigned i = 0; i < 2048; i++)
 			{
 				float x = (float)((int)i - 1024) / 1024.0f;
 				float win = 0.5f*(cosf(x*(float)PI) + 1.0f);
-				fftData[i].Re = win*m_BufferQueue.GetSample();
-				fftData[i].Im = 0.0f;
+				samples[i] = win*m_BufferQueue.GetSample();
 			}
 
-			fft(fftData, 11);
+			DComp* fftData = FFTPlan::ComplexScratch(1025);
+			FFTPlan::Get(11).RealForward(samples, fftData);
 
 			float* barv = new float[100];
 
@@ -87,7 +87,6 @@ void ViewWidget::paintGL()
 				barv[i] = logf(ave*10.0f) / 10.0f;
 
 			}
-			delete[] fftData;
 
 			glBegin(GL_QUADS);
 
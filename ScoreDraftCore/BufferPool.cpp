@@ -0,0 +1,136 @@
+#include "BufferPool.h"
+#include <new>
+#include <vector>
+#include <atomic>
+#include <cassert>
+
+// class k holds 2^(k + s_minClassBits) floats
+static const unsigned s_minClassBits = 10;
+static const unsigned s_numClasses = 20;
+static const unsigned s_hugeClass = 0xFFFF;
+
+// per thread, at most this many free buffers of each class and this many bytes are kept
+static const size_t s_maxCachedPerClass = 16;
+static const size_t s_maxCachedBytes = 64 * 1024 * 1024;
+
+static const uint32_t s_magic = 0x5344424Fu;
+
+// placed right before the data, its size keeps the data 16-byte aligned
+struct BufferHeader
+{
+	uint32_t sizeClass;
+	uint32_t magic;
+	uint64_t capacity;
+};
+
+static std::atomic<uint64_t> s_allocations(0);
+static std::atomic<uint64_t> s_systemAllocations(0);
+static std::atomic<uint64_t> s_bytesInUse(0);
+static std::atomic<uint64_t> s_peakBytesInUse(0);
+
+struct ThreadCache
+{
+	std::vector<BufferHeader*> freeLists[s_numClasses];
+	size_t cachedBytes;
+
+	ThreadCache() : cachedBytes(0) {}
+	~ThreadCache()
+	{
+		for (unsigned i = 0; i < s_numClasses; i++)
+			for (size_t j = 0; j < freeLists[i].size(); j++)
+				::operator delete(freeLists[i][j]);
+	}
+};
+
+static thread_local ThreadCache t_cache;
+
+static unsigned SizeClass(size_t count)
+{
+	unsigned k = 0;
+	while (k < s_numClasses && ((size_t)1 << (k + s_minClassBits)) < count) k++;
+	return k < s_numClasses ? k : s_hugeClass;
+}
+
+static void CountInUse(uint64_t bytes)
+{
+	uint64_t inUse = (s_bytesInUse += bytes);
+	uint64_t peak = s_peakBytesInUse.load(std::memory_order_relaxed);
+	while (inUse > peak && !s_peakBytesInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed));
+}
+
+float* BufferPool::Allocate(size_t count)
+{
+	s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	unsigned sizeClass = SizeClass(count);
+	size_t capacity = sizeClass == s_hugeClass ? count : ((size_t)1 << (sizeClass + s_minClassBits));
+	size_t bytes = sizeof(BufferHeader) + capacity*sizeof(float);
+
+	BufferHeader* header = nullptr;
+	if (sizeClass != s_hugeClass)
+	{
+		std::vector<BufferHeader*>& list = t_cache.freeLists[sizeClass];
+		if (list.size() > 0)
+		{
+			header = list.back();
+			list.pop_back();
+			t_cache.cachedBytes -= bytes;
+		}
+	}
+	if (header == nullptr)
+	{
+		s_systemAllocations.fetch_add(1, std::memory_order_relaxed);
+		header = (BufferHeader*)::operator new(bytes);
+		header->sizeClass = sizeClass;
+		header->magic = s_magic;
+		header->capacity = capacity;
+	}
+
+	CountInUse(capacity*sizeof(float));
+	return (float*)(header + 1);
+}
+
+void BufferPool::Free(float* p)
+{
+	if (p == nullptr) return;
+	BufferHeader* header = (BufferHeader*)p - 1;
+	assert(header->magic == s_magic);
+	size_t capacity = (size_t)header->capacity;
+	size_t bytes = sizeof(BufferHeader) + capacity*sizeof(float);
+	s_bytesInUse -= capacity*sizeof(float);
+
+	if (header->sizeClass != s_hugeClass)
+	{
+		std::vector<BufferHeader*>& list = t_cache.freeLists[header->sizeClass];
+		if (list.size() < s_maxCachedPerClass && t_cache.cachedBytes + bytes <= s_maxCachedBytes)
+		{
+			list.push_back(header);
+			t_cache.cachedBytes += bytes;
+			return;
+		}
+	}
+	::operator delete(header);
+}
+
+size_t BufferPool::Capacity(const float* p)
+{
+	if (p == nullptr) return 0;
+	return (size_t)((const BufferHeader*)p - 1)->capacity;
+}
+
+BufferPool::Counters BufferPool::GetCounters()
+{
+	Counters counters;
+	counters.allocations = s_allocations.load();
+	counters.systemAllocations = s_systemAllocations.load();
+	counters.bytesInUse = s_bytesInUse.load();
+	counters.peakBytesInUse = s_peakBytesInUse.load();
+	return counters;
+}
+
+void BufferPool::ResetCounters()
+{
+	s_allocations = 0;
+	s_systemAllocations = 0;
+	s_peakBytesInUse = s_bytesInUse.load();
+}
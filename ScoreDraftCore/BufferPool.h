@@ -0,0 +1,35 @@
+#ifndef _scoredraft_BufferPool_h
+#define _scoredraft_BufferPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Size-classed pool for sample buffers.
+	Buffers are rounded up to a power of two and recycled through a per-thread cache,
+	so rendering note after note doesn't go to the system allocator every time.
+	A buffer can be freed on a different thread than it was allocated on.
+*/
+class BufferPool
+{
+public:
+	// returned memory is 16-byte aligned and not initialized
+	static float* Allocate(size_t count);
+	// accepts nullptr
+	static void Free(float* p);
+	// number of floats the buffer can actually hold
+	static size_t Capacity(const float* p);
+
+	struct Counters
+	{
+		uint64_t allocations;		// calls to Allocate()
+		uint64_t systemAllocations;	// allocations not served from the cache
+		uint64_t bytesInUse;
+		uint64_t peakBytesInUse;
+	};
+	static Counters GetCounters();
+	// restarts the allocation counts and sets the peak to the current usage
+	static void ResetCounters();
+};
+
+#endif
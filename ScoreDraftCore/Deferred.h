@@ -15,6 +15,10 @@ public:
 	{
 		if (m != nullptr) m->addRef();
 	}
+	Deferred(Deferred && in) noexcept : m(in.m)
+	{
+		in.m = nullptr;
+	}
 	~Deferred()
 	{
 		if (m != nullptr) m->release();
@@ -34,6 +38,15 @@ public:
 		m = in.m;
 	}
 
+	// the source is left empty, like after Abondon()
+	void operator=(Deferred && in) noexcept
+	{
+		if (this == &in) return;
+		if (m != nullptr) m->release();
+		m = in.m;
+		in.m = nullptr;
+	}
+
 	T* operator -> () 
 	{ 
 		if (m == nullptr) return nullptr;
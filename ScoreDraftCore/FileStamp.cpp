@@ -0,0 +1,18 @@
+#include "FileStamp.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+std::string FileStamp(const char* filename)
+{
+	char stamp[64];
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(filename, &st) != 0) return "";
+#else
+	struct stat st;
+	if (stat(filename, &st) != 0) return "";
+#endif
+	sprintf(stamp, "%llu:%lld", (unsigned long long)st.st_size, (long long)st.st_mtime);
+	return stamp;
+}
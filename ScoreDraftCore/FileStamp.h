@@ -0,0 +1,10 @@
+#ifndef _scoredraft_FileStamp_h
+#define _scoredraft_FileStamp_h
+
+#include <string>
+
+// size and modification time of a file, for the keys of caches stored on disk
+// empty if the file doesn't exist
+std::string FileStamp(const char* filename);
+
+#endif
@@ -40,8 +40,13 @@ void Instrument::GenerateNoteWave(float fNumOfSamples, float sampleFreq, NoteBuf
 
 void Instrument::PlayNote(TrackBuffer& buffer, const Note& aNote, unsigned tempo, float RefFreq)
 {
-	float fduration=fabsf((float)(aNote.m_duration*60))/(float)(tempo*48);
-	float fNumOfSamples = buffer.Rate()*fduration;
+	PlayNote(buffer, aNote, GetTuneState(), tempo, RefFreq);
+}
+
+void Instrument::PlayNote(TrackBuffer& buffer, const Note& aNote, const TuneState& state, unsigned tempo, float RefFreq)
+{
+	double fduration=fabs((double)(aNote.m_duration*60))/(double)(tempo*48);
+	double fNumOfSamples = buffer.Rate()*fduration;
 
 	if (aNote.m_freq_rel<0.0f)
 	{
@@ -64,10 +69,10 @@ void Instrument::PlayNote(TrackBuffer& buffer, const Note& aNote, unsigned tempo
 	NoteBuffer noteBuf;
 	noteBuf.m_sampleRate = (float)buffer.Rate();
 	noteBuf.m_cursorDelta = fNumOfSamples;
-	noteBuf.m_volume = m_noteVolume;
-	noteBuf.m_pan = m_notePan;
+	noteBuf.m_volume = state.volume;
+	noteBuf.m_pan = state.pan;
 
-	GenerateNoteWave(fNumOfSamples, sampleFreq, &noteBuf);
+	GenerateNoteWave((float)fNumOfSamples, sampleFreq, &noteBuf);
 	
 	buffer.WriteBlend(noteBuf);
 		
@@ -75,28 +80,27 @@ void Instrument::PlayNote(TrackBuffer& buffer, const Note& aNote, unsigned tempo
 
 bool Instrument::Tune(const char* cmd)
 {
-	char command[1024];
-	sscanf(cmd, "%s", command);
-	if (strcmp(command, "volume") == 0)
-	{
-		float value;
-		if (sscanf(cmd + 7, "%f", &value))
-		{
-			if (value < 0.0f) value = 0.0f;
-			m_noteVolume = value;
-		}
-		return true;
-	}
-	else if (strcmp(command, "pan") == 0)
-	{
-		float value;
-		if (sscanf(cmd + 4, "%f", &value))
-		{
-			if (value<-1.0f) value = -1.0f;
-			else if (value>1.0f) value = 1.0f;
-			m_notePan = value;
-		}
-		return true;
-	}
-	return false;
+	TuneState state = GetTuneState();
+	if (!state.Tune(cmd)) return false;
+	SetTuneState(state);
+	return true;
+}
+
+TuneState Instrument::GetTuneState() const
+{
+	TuneState state;
+	state.volume = m_noteVolume;
+	state.pan = m_notePan;
+	return state;
+}
+
+void Instrument::SetTuneState(const TuneState& state)
+{
+	m_noteVolume = state.volume;
+	m_notePan = state.pan;
+}
+
+bool Instrument::ApplyTune(const char* cmd, TuneState& state)
+{
+	return state.Tune(cmd);
 }
@@ -1,6 +1,8 @@
 #ifndef _scoredraft_Instrument_h
 #define _scoredraft_Instrument_h
 
+#include "TuneState.h"
+
 class NoteBuffer;
 class TrackBuffer;
 class Note;
@@ -12,8 +14,16 @@ public:
 	~Instrument();
 
 	void PlayNote(TrackBuffer& buffer, const Note& aNote, unsigned tempo=80,float RefFreq=261.626f);
+	// uses the volume and pan of "state" instead of the instrument's own
+	void PlayNote(TrackBuffer& buffer, const Note& aNote, const TuneState& state, unsigned tempo = 80, float RefFreq = 261.626f);
+
+	bool Tune(const char* cmd);
+
+	TuneState GetTuneState() const;
+	void SetTuneState(const TuneState& state);
 
-	virtual bool Tune(const char* cmd);
+	// same as Tune(), changing "state" only, so it can be called while other threads render with the instrument
+	bool ApplyTune(const char* cmd, TuneState& state);
 	
 protected:
 	void Silence(unsigned numOfSamples, NoteBuffer* noteBuf);
@@ -0,0 +1,196 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#endif
+
+#ifdef _WIN32
+const MappedFileHandle MappedFile::s_invalidHandle = INVALID_HANDLE_VALUE;
+#else
+const MappedFileHandle MappedFile::s_invalidHandle = -1;
+#endif
+
+MappedFile::MappedFile()
+{
+	m_file = s_invalidHandle;
+	m_mapping = s_invalidHandle;
+	m_writable = false;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::OpenRead(const char* filename)
+{
+	Close();
+	m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		Close();
+		return false;
+	}
+	m_size = (size_t)size.QuadPart;
+	m_writable = false;
+	if (m_size == 0) return true;
+	if (!_map(false))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::CreateTemp()
+{
+	Close();
+	char tmpPath[MAX_PATH];
+	char tmpFn[MAX_PATH];
+	if (!GetTempPathA(MAX_PATH, tmpPath)) return false;
+	if (!GetTempFileNameA(tmpPath, "sdt", 0, tmpFn)) return false;
+
+	m_file = CreateFileA(tmpFn, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	DWORD bytesReturned;
+	DeviceIoControl(m_file, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &bytesReturned, NULL);
+
+	m_writable = true;
+	m_size = 0;
+	return true;
+}
+
+bool MappedFile::_map(bool writable)
+{
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)m_size;
+	m_mapping = CreateFileMappingA(m_file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, size.HighPart, size.LowPart, NULL);
+	if (m_mapping == NULL)
+	{
+		m_mapping = INVALID_HANDLE_VALUE;
+		return false;
+	}
+	m_data = MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m_size);
+	return m_data != nullptr;
+}
+
+void MappedFile::_unmap()
+{
+	if (m_data != nullptr) UnmapViewOfFile(m_data);
+	m_data = nullptr;
+	if (m_mapping != INVALID_HANDLE_VALUE) CloseHandle(m_mapping);
+	m_mapping = INVALID_HANDLE_VALUE;
+}
+
+void MappedFile::Close()
+{
+	_unmap();
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::OpenRead(const char* filename)
+{
+	Close();
+	m_file = open(filename, O_RDONLY);
+	if (m_file < 0) return false;
+
+	struct stat st;
+	if (fstat(m_file, &st) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = (size_t)st.st_size;
+	m_writable = false;
+	if (m_size == 0) return true;
+	if (!_map(false))
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool MappedFile::CreateTemp()
+{
+	Close();
+
+	// tmpfile() gives us an already unlinked file in the system temp directory
+	FILE* fp = tmpfile();
+	if (!fp) return false;
+	m_file = dup(fileno(fp));
+	fclose(fp);
+	if (m_file < 0) return false;
+
+	m_writable = true;
+	m_size = 0;
+	return true;
+}
+
+bool MappedFile::_map(bool writable)
+{
+	void* p = mmap(nullptr, m_size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_file, 0);
+	if (p == MAP_FAILED) return false;
+	m_data = p;
+	return true;
+}
+
+void MappedFile::_unmap()
+{
+	if (m_data != nullptr) munmap(m_data, m_size);
+	m_data = nullptr;
+}
+
+void MappedFile::Close()
+{
+	_unmap();
+	if (m_file >= 0) close(m_file);
+	m_file = -1;
+	m_size = 0;
+}
+
+#endif
+
+bool MappedFile::Resize(size_t size)
+{
+	if (!m_writable || m_file == s_invalidHandle) return false;
+	if (size == m_size) return true;
+	size_t oldSize = m_size;
+	_unmap();
+
+#ifdef _WIN32
+	// CreateFileMapping() extends the file to the size of the mapping
+	bool resized = true;
+#else
+	bool resized = ftruncate(m_file, (off_t)size) == 0;
+#endif
+	m_size = size;
+	if (resized && (m_size == 0 || _map(true))) return true;
+
+	// the previous view is mapped again, its content is still in the file
+	// if even that fails the file is closed, Data() is then nullptr
+	_unmap();
+	m_size = oldSize;
+	if (m_size > 0 && !_map(true)) Close();
+	return false;
+}
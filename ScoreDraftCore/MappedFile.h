@@ -0,0 +1,52 @@
+#ifndef _scoredraft_MappedFile_h
+#define _scoredraft_MappedFile_h
+
+#include <stddef.h>
+
+#ifdef _WIN32
+typedef void* MappedFileHandle;
+#else
+typedef int MappedFileHandle;
+#endif
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// read-only view of an existing file
+	bool OpenRead(const char* filename);
+
+	// read-write view of an anonymous temporary file, which is removed on Close()
+	bool CreateTemp();
+
+	// only valid for temporary files, grows the file and re-maps the view
+	// the file is extended sparsely, new contents read as zeros
+	// on failure the previous view is kept, or the file is closed if it cannot be mapped again
+	bool Resize(size_t size);
+
+	void Close();
+
+	bool IsOpen() const { return m_data != nullptr || m_file != s_invalidHandle; }
+	void* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+private:
+	static const MappedFileHandle s_invalidHandle;
+
+	bool _map(bool writable);
+	void _unmap();
+
+	MappedFileHandle m_file;
+	MappedFileHandle m_mapping;
+	bool m_writable;
+
+	void* m_data;
+	size_t m_size;
+
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
+
+#endif
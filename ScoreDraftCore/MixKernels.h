@@ -0,0 +1,196 @@
+#ifndef _scoredraft_MixKernels_h
+#define _scoredraft_MixKernels_h
+
+/*
+	Block kernels blending a span of interleaved samples into another:
+
+		dst += pan(src) * volume
+
+	specialized on the source and destination channel counts. The arithmetic
+	is kept in the same order as CalcPan(), so results are identical to the
+	per-sample path whichever kernel is used.
+*/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCOREDRAFT_MIX_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define SCOREDRAFT_MIX_AVX
+#include <immintrin.h>
+#endif
+
+// CalcPan() as a 2x2 matrix:
+//  l' = l*ll + r*rl
+//  r' = l*lr + r*rr
+// the zero and unit entries leave the rounding of CalcPan() unchanged
+struct PanGains
+{
+	float ll, rl, lr, rr;
+	PanGains(float pan)
+	{
+		if (pan < 0.0f)
+		{
+			ll = 1.0f; rl = -pan;
+			lr = 0.0f; rr = 1.0f + pan;
+		}
+		else if (pan > 0.0f)
+		{
+			ll = 1.0f - pan; rl = 0.0f;
+			lr = pan; rr = 1.0f;
+		}
+		else
+		{
+			ll = 1.0f; rl = 0.0f;
+			lr = 0.0f; rr = 1.0f;
+		}
+	}
+};
+
+template <unsigned SrcChn, unsigned DstChn>
+struct MixKernel;
+
+template <>
+struct MixKernel<1, 1>
+{
+	static void Blend(float* dst, const float* src, unsigned count, float volume, float /*pan*/)
+	{
+		unsigned i = 0;
+#if defined(SCOREDRAFT_MIX_AVX)
+		__m256 vol8 = _mm256_set1_ps(volume);
+		__m256 half8 = _mm256_set1_ps(0.5f);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256 s = _mm256_loadu_ps(src + i);
+			__m256 v = _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(s, s), half8), vol8);
+			_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), v));
+		}
+#endif
+#if defined(SCOREDRAFT_MIX_SSE)
+		__m128 vol4 = _mm_set1_ps(volume);
+		__m128 half4 = _mm_set1_ps(0.5f);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 s = _mm_loadu_ps(src + i);
+			__m128 v = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(s, s), half4), vol4);
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] += (src[i] + src[i])*0.5f * volume;
+	}
+};
+
+template <>
+struct MixKernel<2, 1>
+{
+	static void Blend(float* dst, const float* src, unsigned count, float volume, float /*pan*/)
+	{
+		unsigned i = 0;
+#if defined(SCOREDRAFT_MIX_SSE)
+		__m128 vol4 = _mm_set1_ps(volume);
+		__m128 half4 = _mm_set1_ps(0.5f);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(src + i * 2);
+			__m128 b = _mm_loadu_ps(src + i * 2 + 4);
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			__m128 v = _mm_mul_ps(_mm_mul_ps(_mm_add_ps(l, r), half4), vol4);
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), v));
+		}
+#endif
+		for (; i < count; i++)
+			dst[i] += (src[i * 2] + src[i * 2 + 1])*0.5f * volume;
+	}
+};
+
+template <>
+struct MixKernel<1, 2>
+{
+	static void Blend(float* dst, const float* src, unsigned count, float volume, float pan)
+	{
+		PanGains g(pan);
+		unsigned i = 0;
+#if defined(SCOREDRAFT_MIX_SSE)
+		__m128 vol4 = _mm_set1_ps(volume);
+		__m128 gainA = _mm_setr_ps(g.ll, g.rr, g.ll, g.rr);
+		__m128 gainB = _mm_setr_ps(g.rl, g.lr, g.rl, g.lr);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 s = _mm_loadu_ps(src + i);
+			__m128 lo = _mm_unpacklo_ps(s, s);
+			__m128 hi = _mm_unpackhi_ps(s, s);
+			__m128 vlo = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(lo, gainA), _mm_mul_ps(lo, gainB)), vol4);
+			__m128 vhi = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(hi, gainA), _mm_mul_ps(hi, gainB)), vol4);
+			_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), vlo));
+			_mm_storeu_ps(dst + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(dst + i * 2 + 4), vhi));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float s = src[i];
+			dst[i * 2] += (s*g.ll + s*g.rl) * volume;
+			dst[i * 2 + 1] += (s*g.rr + s*g.lr) * volume;
+		}
+	}
+};
+
+template <>
+struct MixKernel<2, 2>
+{
+	static void Blend(float* dst, const float* src, unsigned count, float volume, float pan)
+	{
+		PanGains g(pan);
+		unsigned i = 0;
+#if defined(SCOREDRAFT_MIX_AVX)
+		// lanes alternate l, r: own channel times gainA plus the other channel times gainB
+		__m256 vol8 = _mm256_set1_ps(volume);
+		__m256 gainA8 = _mm256_setr_ps(g.ll, g.rr, g.ll, g.rr, g.ll, g.rr, g.ll, g.rr);
+		__m256 gainB8 = _mm256_setr_ps(g.rl, g.lr, g.rl, g.lr, g.rl, g.lr, g.rl, g.lr);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m256 s = _mm256_loadu_ps(src + i * 2);
+			__m256 swapped = _mm256_permute_ps(s, _MM_SHUFFLE(2, 3, 0, 1));
+			__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, gainA8), _mm256_mul_ps(swapped, gainB8)), vol8);
+			_mm256_storeu_ps(dst + i * 2, _mm256_add_ps(_mm256_loadu_ps(dst + i * 2), v));
+		}
+#endif
+#if defined(SCOREDRAFT_MIX_SSE)
+		__m128 vol4 = _mm_set1_ps(volume);
+		__m128 gainA = _mm_setr_ps(g.ll, g.rr, g.ll, g.rr);
+		__m128 gainB = _mm_setr_ps(g.rl, g.lr, g.rl, g.lr);
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128 s = _mm_loadu_ps(src + i * 2);
+			__m128 swapped = _mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 3, 0, 1));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(s, gainA), _mm_mul_ps(swapped, gainB)), vol4);
+			_mm_storeu_ps(dst + i * 2, _mm_add_ps(_mm_loadu_ps(dst + i * 2), v));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			float l = src[i * 2];
+			float r = src[i * 2 + 1];
+			dst[i * 2] += (l*g.ll + r*g.rl) * volume;
+			dst[i * 2 + 1] += (r*g.rr + l*g.lr) * volume;
+		}
+	}
+};
+
+inline void MixBlend(float* dst, unsigned dst_chn, const float* src, unsigned src_chn, unsigned count, float volume, float pan)
+{
+	if (src_chn == 1)
+	{
+		if (dst_chn == 1) MixKernel<1, 1>::Blend(dst, src, count, volume, pan);
+		else MixKernel<1, 2>::Blend(dst, src, count, volume, pan);
+	}
+	else
+	{
+		if (dst_chn == 1) MixKernel<2, 1>::Blend(dst, src, count, volume, pan);
+		else MixKernel<2, 2>::Blend(dst, src, count, volume, pan);
+	}
+}
+
+#endif
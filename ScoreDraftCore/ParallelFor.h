@@ -0,0 +1,45 @@
+#ifndef _scoredraft_ParallelFor_h
+#define _scoredraft_ParallelFor_h
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+inline unsigned DefaultNumberOfThreads()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+// Calls func(i) for i in [0, count) on up to numThreads threads, the calling thread included.
+// Indices are handed out one at a time, so uneven jobs are balanced automatically.
+// numThreads = 0 means one thread per core.
+template <class Func>
+void ParallelFor(unsigned count, unsigned numThreads, Func func)
+{
+	if (numThreads == 0) numThreads = DefaultNumberOfThreads();
+	if (numThreads > count) numThreads = count;
+	if (numThreads <= 1)
+	{
+		for (unsigned i = 0; i < count; i++)
+			func(i);
+		return;
+	}
+
+	std::atomic<unsigned> next(0);
+	auto worker = [&]()
+	{
+		unsigned i;
+		while ((i = next++) < count)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < numThreads; t++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (unsigned t = 0; t < (unsigned)threads.size(); t++)
+		threads[t].join();
+}
+
+#endif
@@ -41,59 +41,62 @@ void Percussion::GenerateBeatWave(float fNumOfSamples, NoteBuffer* beatBuf)
 
 void Percussion::PlayBeat(TrackBuffer& buffer, int duration, unsigned tempo)
 {
+	PlayBeat(buffer, duration, GetTuneState(), tempo);
+}
 
-	float fduration = (float)(duration * 60) / (float)(tempo * 48);
-	float fNumOfSamples = buffer.Rate()*fduration;
+void Percussion::PlayBeat(TrackBuffer& buffer, int duration, const TuneState& state, unsigned tempo)
+{
+	double fduration = (double)(duration * 60) / (double)(tempo * 48);
+	double fNumOfSamples = buffer.Rate()*fduration;
 
 	NoteBuffer beatBuf;
 	beatBuf.m_sampleRate = (float)buffer.Rate();
 	beatBuf.m_cursorDelta = fNumOfSamples;
-	beatBuf.m_volume = m_beatVolume;
-	beatBuf.m_pan = m_beatPan;
+	beatBuf.m_volume = state.volume;
+	beatBuf.m_pan = state.pan;
 
-	GenerateBeatWave(fNumOfSamples, &beatBuf);
+	GenerateBeatWave((float)fNumOfSamples, &beatBuf);
 	buffer.WriteBlend(beatBuf);
 }
 
 void Percussion::PlaySilence(TrackBuffer& buffer, int duration, unsigned tempo)
 {
-	float fduration = (float)(duration * 60) / (float)(tempo * 48);
-	float fNumOfSamples = buffer.Rate()*fduration;
+	double fduration = (double)(duration * 60) / (double)(tempo * 48);
+	double fNumOfSamples = buffer.Rate()*fduration;
 	buffer.MoveCursor(fNumOfSamples);
 }
 
 void Percussion::PlayBackspace(TrackBuffer& buffer, int duration, unsigned tempo)
 {
-	float fduration = (float)(duration * 60) / (float)(tempo * 48);
-	float fNumOfSamples = buffer.Rate()*fduration;
+	double fduration = (double)(duration * 60) / (double)(tempo * 48);
+	double fNumOfSamples = buffer.Rate()*fduration;
 	buffer.MoveCursor(-fNumOfSamples);
 	return;
 }
 
 bool Percussion::Tune(const char* cmd)
 {
-	char command[1024];
-	sscanf(cmd, "%s", command);
-	if (strcmp(command, "volume") == 0)
-	{
-		float value;
-		if (sscanf(cmd + 7, "%f", &value))
-		{
-			if (value < 0.0f) value = 0.0f;
-			m_beatVolume = value;
-		}
-		return true;
-	}
-	else if (strcmp(command, "pan") == 0)
-	{
-		float value;
-		if (sscanf(cmd + 4, "%f", &value))
-		{
-			if (value<-1.0f) value = -1.0f;
-			else if (value>1.0f) value = 1.0f;
-			m_beatPan = value;
-		}
-		return true;
-	}
-	return false;
+	TuneState state = GetTuneState();
+	if (!state.Tune(cmd)) return false;
+	SetTuneState(state);
+	return true;
+}
+
+TuneState Percussion::GetTuneState() const
+{
+	TuneState state;
+	state.volume = m_beatVolume;
+	state.pan = m_beatPan;
+	return state;
+}
+
+void Percussion::SetTuneState(const TuneState& state)
+{
+	m_beatVolume = state.volume;
+	m_beatPan = state.pan;
+}
+
+bool Percussion::ApplyTune(const char* cmd, TuneState& state)
+{
+	return state.Tune(cmd);
 }
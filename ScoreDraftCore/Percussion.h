@@ -3,6 +3,7 @@
 
 #include<string>
 #include "Deferred.h"
+#include "TuneState.h"
 
 class NoteBuffer;
 class TrackBuffer;
@@ -17,10 +18,18 @@ public:
 	~Percussion();
 
 	void PlayBeat(TrackBuffer& buffer, int duration, unsigned tempo = 80);
+	// uses the volume and pan of "state" instead of the percussion's own
+	void PlayBeat(TrackBuffer& buffer, int duration, const TuneState& state, unsigned tempo = 80);
 	static void PlaySilence(TrackBuffer& buffer, int duration, unsigned tempo = 80);
 	static void PlayBackspace(TrackBuffer& buffer, int duration, unsigned tempo = 80);
 
-	virtual bool Tune(const char* cmd);
+	bool Tune(const char* cmd);
+
+	TuneState GetTuneState() const;
+	void SetTuneState(const TuneState& state);
+
+	// same as Tune(), changing "state" only, so it can be called while other threads render with the percussion
+	bool ApplyTune(const char* cmd, TuneState& state);
 
 
 protected:
@@ -1,6 +1,9 @@
 #ifndef _scoredraft_RefCounted_h
 #define _scoredraft_RefCounted_h
 
+#include <atomic>
+
+// The count is atomic, so references can be added and released on different threads.
 class RefCounted
 {
 public:
@@ -14,27 +17,30 @@ public:
 
 	unsigned addRef() const
 	{
-		m_count++;
-		return m_count;
+		// a new reference is always made from an existing one, no ordering needed
+		return (unsigned)(m_count.fetch_add(1, std::memory_order_relaxed) + 1);
 	}
 
 	unsigned release() const
 	{
-		m_count--;
-		if (m_count == 0) {
+		// release publishes our writes to whoever deletes the object,
+		// the acquire fence makes them visible before the destructor runs
+		int count = m_count.fetch_sub(1, std::memory_order_release) - 1;
+		if (count == 0) {
+			std::atomic_thread_fence(std::memory_order_acquire);
 			delete this;
 			return 0;
 		}
-		return m_count;
+		return (unsigned)count;
 	}
 
 	int refCount() const
 	{
-		return m_count;
+		return m_count.load(std::memory_order_relaxed);
 	}
 
 private: 
-	mutable int m_count;
+	mutable std::atomic<int> m_count;
 
 	RefCounted(const RefCounted &); 
 	RefCounted &operator=(const RefCounted &);
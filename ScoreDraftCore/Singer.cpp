@@ -2,9 +2,11 @@
 #include "SingingPiece.h"
 #include "RapPiece.h"
 #include "TrackBuffer.h"
+#include "ParallelFor.h"
 #include <memory.h>
 #include <cmath>
 #include <vector>
+#include <utility>
 #include <stdlib.h>
 
 #ifndef max
@@ -15,6 +17,20 @@
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
 #endif
 
+static bool TuneDefaultLyric(const char* cmd, TuneState& state)
+{
+	char command[1024];
+	sscanf(cmd, "%s", command);
+	if (strcmp(command, "default_lyric") == 0)
+	{
+		char lyric[1024];
+		if (sscanf(cmd + 14, "%s", lyric))
+			state.defaultLyric = lyric;
+		return true;
+	}
+	return false;
+}
+
 Singer::Singer() : m_noteVolume(1.0f), m_notePan(0.0f)
 {
 	m_lyric_charset = "utf-8";
@@ -33,7 +49,7 @@ void Singer::Silence(unsigned numOfSamples, NoteBuffer* noteBuf)
 	memset(noteBuf->m_data, 0, sizeof(float)*numOfSamples);
 }
 
-void Singer::GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf)
+void Singer::GenerateWave(SingingPieceInternal piece, const TuneState& /*state*/, NoteBuffer* noteBuf)
 {
 	float totalDuration = 0.0f;
 	for (size_t i = 0; i < piece.notes.size(); i++)
@@ -42,12 +58,12 @@ void Singer::GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf)
 	Silence((unsigned)ceilf(totalDuration), noteBuf);
 }
 
-void Singer::GenerateWave_Rap(RapPieceInternal piece, NoteBuffer* noteBuf)
+void Singer::GenerateWave_Rap(RapPieceInternal piece, const TuneState& /*state*/, NoteBuffer* noteBuf)
 {
 	Silence((unsigned)ceilf(piece.fNumOfSamples), noteBuf);
 }
 
-void Singer::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, NoteBuffer* noteBuf)
+void Singer::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, const TuneState& /*state*/, NoteBuffer* noteBuf)
 {
 	float totalDuration = 0.0f;
 	for (size_t j = 0; j < pieceList.size(); j++)
@@ -60,7 +76,7 @@ void Singer::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, No
 
 }
 
-void Singer::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuffer* noteBuf)
+void Singer::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, const TuneState& /*state*/, NoteBuffer* noteBuf)
 {
 	float totalDuration = 0.0f;
 	for (size_t j = 0; j < pieceList.size(); j++)
@@ -72,22 +88,27 @@ void Singer::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuf
 }
 
 void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned tempo, float RefFreq)
+{
+	SingPiece(buffer, piece, GetTuneState(), tempo, RefFreq);
+}
+
+void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, const TuneState& state, unsigned tempo, float RefFreq)
 {
 	std::vector<SingerNoteParams> noteParams;
 
-	float totalDuration = 0.0f;
+	double totalDuration = 0.0;
 
 	for (size_t i = 0; i < piece.m_notes.size(); i++)
 	{
 		const Note& aNote = piece.m_notes[i];
-		float fduration = fabsf((float)(aNote.m_duration * 60)) / (float)(tempo * 48);
-		float fNumOfSamples = buffer.Rate()*fduration;
+		double fduration = fabs((double)(aNote.m_duration * 60)) / (double)(tempo * 48);
+		double fNumOfSamples = buffer.Rate()*fduration;
 		if (aNote.m_freq_rel<0.0f)
 		{
 			if (noteParams.size()>0)
 			{
 				std::string lyric = piece.m_lyric;
-				if (lyric == "") lyric = m_defaultLyric;
+				if (lyric == "") lyric = state.defaultLyric;
 				SingingPieceInternal _piece;
 				_piece.lyric = lyric;
 				_piece.notes = noteParams;
@@ -95,13 +116,13 @@ void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned
 				NoteBuffer noteBuf;
 				noteBuf.m_sampleRate = (float)buffer.Rate();
 				noteBuf.m_cursorDelta = totalDuration;
-				noteBuf.m_volume = m_noteVolume;
-				noteBuf.m_pan = m_notePan;
+				noteBuf.m_volume = state.volume;
+				noteBuf.m_pan = state.pan;
 
-				GenerateWave(_piece, &noteBuf);
+				GenerateWave(_piece, state, &noteBuf);
 				buffer.WriteBlend(noteBuf);
 				noteParams.clear();
-				totalDuration = 0.0f;
+				totalDuration = 0.0;
 			}
 
 			if (aNote.m_duration>0)
@@ -118,7 +139,7 @@ void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned
 		SingerNoteParams param;
 		float freq = RefFreq*aNote.m_freq_rel;
 		param.sampleFreq = freq / (float)buffer.Rate();
-		param.fNumOfSamples = fNumOfSamples;
+		param.fNumOfSamples = (float)fNumOfSamples;
 		noteParams.push_back(param);
 		totalDuration += fNumOfSamples;
 	}
@@ -126,7 +147,7 @@ void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned
 	if (noteParams.size()>0)
 	{
 		std::string lyric = piece.m_lyric;
-		if (lyric == "") lyric = m_defaultLyric;
+		if (lyric == "") lyric = state.defaultLyric;
 		SingingPieceInternal _piece;
 		_piece.lyric = lyric;
 		_piece.notes = noteParams;
@@ -134,10 +155,10 @@ void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned
 		NoteBuffer noteBuf;
 		noteBuf.m_sampleRate = (float)buffer.Rate();
 		noteBuf.m_cursorDelta = totalDuration;
-		noteBuf.m_volume = m_noteVolume;
-		noteBuf.m_pan = m_notePan;
+		noteBuf.m_volume = state.volume;
+		noteBuf.m_pan = state.pan;
 
-		GenerateWave(_piece, &noteBuf);
+		GenerateWave(_piece, state, &noteBuf);
 		buffer.WriteBlend(noteBuf);
 	}
 
@@ -145,8 +166,13 @@ void Singer::SingPiece(TrackBuffer& buffer, const SingingPiece& piece, unsigned
 
 void Singer::RapAPiece(TrackBuffer& buffer, const RapPiece& piece, unsigned tempo, float RefFreq)
 {
-	float fduration = fabsf((float)(piece.m_duration * 60)) / (float)(tempo * 48);
-	float fNumOfSamples = buffer.Rate()*fduration;
+	RapAPiece(buffer, piece, GetTuneState(), tempo, RefFreq);
+}
+
+void Singer::RapAPiece(TrackBuffer& buffer, const RapPiece& piece, const TuneState& state, unsigned tempo, float RefFreq)
+{
+	double fduration = fabs((double)(piece.m_duration * 60)) / (double)(tempo * 48);
+	double fNumOfSamples = buffer.Rate()*fduration;
 
 	if (piece.m_freq1<0.0 || piece.m_freq2<0.0)
 	{
@@ -165,7 +191,7 @@ void Singer::RapAPiece(TrackBuffer& buffer, const RapPiece& piece, unsigned temp
 
 	RapPieceInternal _piece;
 	_piece.lyric = piece.m_lyric;
-	_piece.fNumOfSamples = fNumOfSamples;
+	_piece.fNumOfSamples = (float)fNumOfSamples;
 	_piece.sampleFreq1 = RefFreq*piece.m_freq1 / (float)buffer.Rate();
 	_piece.sampleFreq2 = RefFreq*piece.m_freq2 / (float)buffer.Rate();
 	_piece.isVowel = true;
@@ -173,19 +199,96 @@ void Singer::RapAPiece(TrackBuffer& buffer, const RapPiece& piece, unsigned temp
 	NoteBuffer noteBuf;
 	noteBuf.m_sampleRate = (float)buffer.Rate();
 	noteBuf.m_cursorDelta = fNumOfSamples;
-	noteBuf.m_volume = m_noteVolume;
-	noteBuf.m_pan = m_notePan;
+	noteBuf.m_volume = state.volume;
+	noteBuf.m_pan = state.pan;
 
-	GenerateWave_Rap(_piece, &noteBuf);
+	GenerateWave_Rap(_piece, state, &noteBuf);
 
 	buffer.WriteBlend(noteBuf);
 }
 
+// a sentence, or a move of the cursor between two sentences when pieceList is empty
+template <class PieceList>
+struct SentenceStep
+{
+	PieceList pieceList;
+	double duration; // cursor delta of the sentence, or the move
+};
+
+template <class PieceList>
+static void AddSentence(std::vector<SentenceStep<PieceList>>& steps, const PieceList& pieceList, double duration)
+{
+	steps.push_back(SentenceStep<PieceList>());
+	steps.back().pieceList = pieceList;
+	steps.back().duration = duration;
+}
+
+template <class PieceList>
+static void AddCursorMove(std::vector<SentenceStep<PieceList>>& steps, double delta)
+{
+	steps.push_back(SentenceStep<PieceList>());
+	steps.back().duration = delta;
+}
+
+/*
+	Sentences don't share any state, so when the singer allows it, a batch of them is
+	generated on several threads. They are then blended, and the cursor moved, in the
+	original order, so the track is the same as when they are generated one by one.
+	Batches bound the number of sentences held in memory at a time.
+*/
+template <class PieceList, class Generate>
+static void RenderSentences(TrackBuffer& buffer, const TuneState& state, const std::vector<SentenceStep<PieceList>>& steps, bool concurrent, Generate generate)
+{
+	typedef Deferred<NoteBuffer> NoteBuffer_Deferred;
+
+	unsigned numThreads = concurrent ? DefaultNumberOfThreads() : 1;
+	unsigned batchSize = numThreads > 1 ? numThreads * 2 : 1;
+
+	size_t first = 0;
+	while (first < steps.size())
+	{
+		// the batch ends after its batchSize-th sentence
+		std::vector<size_t> sentences;
+		size_t end = first;
+		while (end < steps.size() && sentences.size() < batchSize)
+		{
+			if (steps[end].pieceList.size() > 0) sentences.push_back(end);
+			end++;
+		}
+
+		std::vector<NoteBuffer_Deferred> noteBufs(sentences.size());
+		ParallelFor((unsigned)sentences.size(), numThreads, [&](unsigned i)
+		{
+			NoteBuffer& noteBuf = *noteBufs[i];
+			noteBuf.m_sampleRate = (float)buffer.Rate();
+			noteBuf.m_cursorDelta = steps[sentences[i]].duration;
+			noteBuf.m_volume = state.volume;
+			noteBuf.m_pan = state.pan;
+			generate(steps[sentences[i]].pieceList, &noteBuf);
+		});
+
+		unsigned sentenceId = 0;
+		for (size_t j = first; j < end; j++)
+		{
+			if (steps[j].pieceList.size() > 0)
+				buffer.WriteBlend(*noteBufs[sentenceId++]);
+			else
+				buffer.MoveCursor(steps[j].duration);
+		}
+		first = end;
+	}
+}
+
 void Singer::SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& pieces, unsigned tempo, float RefFreq)
+{
+	SingConsecutivePieces(buffer, pieces, GetTuneState(), tempo, RefFreq);
+}
+
+static void BuildSentences(unsigned rate, const SingingSequence& pieces, const TuneState& state, unsigned tempo, float RefFreq, std::vector<SentenceStep<SingingPieceInternalList>>& steps)
 {
 	SingingPieceInternalList pieceList;
 
-	float totalDuration = 0.0f;
+	double totalDuration = 0.0;
 
 	for (size_t j = 0; j < pieces.size(); j++)
 	{
@@ -195,8 +298,8 @@ void Singer::SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& p
 		for (size_t i = 0; i < piece.m_notes.size(); i++)
 		{
 			const Note& aNote = piece.m_notes[i];
-			float fduration = fabsf((float)(aNote.m_duration * 60)) / (float)(tempo * 48);
-			float fNumOfSamples = buffer.Rate()*fduration;
+			double fduration = fabs((double)(aNote.m_duration * 60)) / (double)(tempo * 48);
+			double fNumOfSamples = rate*fduration;
 			if (aNote.m_freq_rel < 0.0f)
 			{
 				if (pieceList.size()>0 || noteParams.size()>0)
@@ -204,102 +307,95 @@ void Singer::SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& p
 					if (noteParams.size() > 0)
 					{
 						std::string lyric = piece.m_lyric;
-						if (lyric == "") lyric = m_defaultLyric;
+						if (lyric == "") lyric = state.defaultLyric;
 						SingingPieceInternal_Deferred _piece;
 						_piece->lyric = lyric;
 						_piece->notes = noteParams;
 						_piece->isVowel = true;
-						pieceList.push_back(_piece);
+						pieceList.push_back(std::move(_piece));
 					}
-					NoteBuffer noteBuf;
-					noteBuf.m_sampleRate = (float)buffer.Rate();
-					noteBuf.m_cursorDelta = totalDuration;
-					noteBuf.m_volume = m_noteVolume;
-					noteBuf.m_pan = m_notePan;
-
-					GenerateWave_SingConsecutive(pieceList, &noteBuf);
-					buffer.WriteBlend(noteBuf);
+					AddSentence(steps, pieceList, totalDuration);
 					noteParams.clear();
 					pieceList.clear();
-					totalDuration = 0.0f;
+					totalDuration = 0.0;
 				}
 
 				if (aNote.m_duration>0)
 				{
-					buffer.MoveCursor(fNumOfSamples);
+					AddCursorMove(steps, fNumOfSamples);
 				}
 				else if (aNote.m_duration<0)
 				{
-					buffer.MoveCursor(-fNumOfSamples);
+					AddCursorMove(steps, -fNumOfSamples);
 				}
 				continue;
 			}
 			SingerNoteParams param;
 			float freq = RefFreq*aNote.m_freq_rel;
-			param.sampleFreq = freq / (float)buffer.Rate();
-			param.fNumOfSamples = fNumOfSamples;
+			param.sampleFreq = freq / (float)rate;
+			param.fNumOfSamples = (float)fNumOfSamples;
 			noteParams.push_back(param);
 			totalDuration += fNumOfSamples;
 		}
 		if (noteParams.size()>0)
 		{
 			std::string lyric = piece.m_lyric;
-			if (lyric == "") lyric = m_defaultLyric;
+			if (lyric == "") lyric = state.defaultLyric;
 			SingingPieceInternal_Deferred _piece;
 			_piece->lyric = lyric;
 			_piece->notes = noteParams;
 			_piece->isVowel = true;
-			pieceList.push_back(_piece);
+			pieceList.push_back(std::move(_piece));
 		}		
 	}
 
 	if (pieceList.size() > 0)
-	{
-		NoteBuffer noteBuf;
-		noteBuf.m_sampleRate = (float)buffer.Rate();
-		noteBuf.m_cursorDelta = totalDuration;
-		noteBuf.m_volume = m_noteVolume;
-		noteBuf.m_pan = m_notePan;
+		AddSentence(steps, pieceList, totalDuration);
+}
 
-		GenerateWave_SingConsecutive(pieceList, &noteBuf);
-		buffer.WriteBlend(noteBuf);
-	}
+void Singer::SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& pieces, const TuneState& state, unsigned tempo, float RefFreq)
+{
+	std::vector<SentenceStep<SingingPieceInternalList>> steps;
+	BuildSentences(buffer.Rate(), pieces, state, tempo, RefFreq, steps);
+
+	RenderSentences(buffer, state, steps, CanGenerateConcurrently(state), [this, &state](const SingingPieceInternalList& pieceList, NoteBuffer* noteBuf)
+	{
+		GenerateWave_SingConsecutive(pieceList, state, noteBuf);
+	});
 }
 
 void Singer::RapConsecutivePieces(TrackBuffer& buffer, const RapSequence& pieces, unsigned tempo, float RefFreq)
+{
+	RapConsecutivePieces(buffer, pieces, GetTuneState(), tempo, RefFreq);
+}
+
+static void BuildSentences(unsigned rate, const RapSequence& pieces, unsigned tempo, float RefFreq, std::vector<SentenceStep<RapPieceInternalList>>& steps)
 {
 	RapPieceInternalList pieceList;
 
-	float totalDuration = 0.0f;
+	double totalDuration = 0.0;
 
 	for (size_t j = 0; j < pieces.size(); j++)
 	{
 		const RapPiece& piece = pieces[j];
-		float fduration = fabsf((float)(piece.m_duration * 60)) / (float)(tempo * 48);
-		float fNumOfSamples = buffer.Rate()*fduration;
+		double fduration = fabs((double)(piece.m_duration * 60)) / (double)(tempo * 48);
+		double fNumOfSamples = rate*fduration;
 
 		if (piece.m_freq1 < 0.0f || piece.m_freq2 < 0.0f)
 		{
 			if (pieceList.size()>0)
 			{
-				NoteBuffer noteBuf;
-				noteBuf.m_sampleRate = (float)buffer.Rate();
-				noteBuf.m_cursorDelta = totalDuration;
-				noteBuf.m_volume = m_noteVolume;
-				noteBuf.m_pan = m_notePan;
-
-				GenerateWave_RapConsecutive(pieceList, &noteBuf);
-				buffer.WriteBlend(noteBuf);
+				AddSentence(steps, pieceList, totalDuration);
 				pieceList.clear();
-				totalDuration = 0.0f;
+				totalDuration = 0.0;
 			}
 			if (piece.m_duration>0)
 			{
-				buffer.MoveCursor(fNumOfSamples);
+				AddCursorMove(steps, fNumOfSamples);
 			}
 			else if (piece.m_duration<0)
 			{
-				buffer.MoveCursor(-fNumOfSamples);
+				AddCursorMove(steps, -fNumOfSamples);
 			}
 		}
 		else
@@ -307,62 +403,93 @@ void Singer::RapConsecutivePieces(TrackBuffer& buffer, const RapSequence& pieces
 
 			RapPieceInternal_Deferred _piece;
 			_piece->lyric = piece.m_lyric;
-			_piece->fNumOfSamples = fNumOfSamples;
-			_piece->sampleFreq1 = RefFreq*piece.m_freq1 / (float)buffer.Rate();
-			_piece->sampleFreq2 = RefFreq*piece.m_freq2 / (float)buffer.Rate();
+			_piece->fNumOfSamples = (float)fNumOfSamples;
+			_piece->sampleFreq1 = RefFreq*piece.m_freq1 / (float)rate;
+			_piece->sampleFreq2 = RefFreq*piece.m_freq2 / (float)rate;
 			_piece->isVowel = true;
 			totalDuration += fNumOfSamples;
 
-			pieceList.push_back(_piece);
+			pieceList.push_back(std::move(_piece));
 
 		}
 	}
 	if (pieceList.size() > 0)
-	{
-		NoteBuffer noteBuf;
-		noteBuf.m_sampleRate = (float)buffer.Rate();
-		noteBuf.m_cursorDelta = totalDuration;
-		noteBuf.m_volume = m_noteVolume;
-		noteBuf.m_pan = m_notePan;
+		AddSentence(steps, pieceList, totalDuration);
+}
 
-		GenerateWave_RapConsecutive(pieceList, &noteBuf);
-		buffer.WriteBlend(noteBuf);
-	}
+void Singer::RapConsecutivePieces(TrackBuffer& buffer, const RapSequence& pieces, const TuneState& state, unsigned tempo, float RefFreq)
+{
+	std::vector<SentenceStep<RapPieceInternalList>> steps;
+	BuildSentences(buffer.Rate(), pieces, tempo, RefFreq, steps);
 
+	RenderSentences(buffer, state, steps, CanGenerateConcurrently(state), [this, &state](const RapPieceInternalList& pieceList, NoteBuffer* noteBuf)
+	{
+		GenerateWave_RapConsecutive(pieceList, state, noteBuf);
+	});
 }
 
-
-bool Singer::Tune(const char* cmd)
+SingerPrefetch_Deferred Singer::PrefetchSequences(unsigned sampleRate, const std::vector<const SingingSequence*>& singing, const std::vector<TuneState>& singingStates,
+	const std::vector<const RapSequence*>& raps, const std::vector<TuneState>& rapStates, unsigned tempo, float RefFreq)
 {
-	char command[1024];
-	sscanf(cmd, "%s", command);
-	if (strcmp(command, "volume") == 0)
+	std::vector<SingingPieceInternalList> singingSentences;
+	std::vector<TuneState> singingSentenceStates;
+	for (size_t i = 0; i < singing.size(); i++)
 	{
-		float value;
-		if (sscanf(cmd + 7, "%f", &value))
+		std::vector<SentenceStep<SingingPieceInternalList>> steps;
+		BuildSentences(sampleRate, *singing[i], singingStates[i], tempo, RefFreq, steps);
+		for (size_t j = 0; j < steps.size(); j++)
 		{
-			if (value < 0.0f) value = 0.0f;
-			m_noteVolume = value;
+			if (steps[j].pieceList.size() == 0) continue;
+			singingSentences.push_back(steps[j].pieceList);
+			singingSentenceStates.push_back(singingStates[i]);
 		}
-		return true;
 	}
-	else if (strcmp(command, "pan") == 0)
+
+	std::vector<RapPieceInternalList> rapSentences;
+	std::vector<TuneState> rapSentenceStates;
+	for (size_t i = 0; i < raps.size(); i++)
 	{
-		float value;
-		if (sscanf(cmd + 4, "%f", &value))
+		std::vector<SentenceStep<RapPieceInternalList>> steps;
+		BuildSentences(sampleRate, *raps[i], tempo, RefFreq, steps);
+		for (size_t j = 0; j < steps.size(); j++)
 		{
-			if (value<-1.0f) value = -1.0f;
-			else if (value>1.0f) value = 1.0f;
-			m_notePan = value;
+			if (steps[j].pieceList.size() == 0) continue;
+			rapSentences.push_back(steps[j].pieceList);
+			rapSentenceStates.push_back(rapStates[i]);
 		}
-		return true;
 	}
-	else if (strcmp(command, "default_lyric") == 0)
-	{
-		char lyric[1024];
-		if (sscanf(cmd + 14, "%s", lyric))
-			m_defaultLyric = lyric;
-		return true;
-	}
-	return false;
+
+	if (singingSentences.size() == 0 && rapSentences.size() == 0) return SingerPrefetch_Deferred();
+	return PrefetchSentences(singingSentences, singingSentenceStates, rapSentences, rapSentenceStates, (float)sampleRate);
+}
+
+bool Singer::Tune(const char* cmd)
+{
+	TuneState state = GetTuneState();
+	if (!ApplyTune(cmd, state)) return false;
+	SetTuneState(state);
+	return true;
+}
+
+TuneState Singer::GetTuneState() const
+{
+	TuneState state;
+	state.volume = m_noteVolume;
+	state.pan = m_notePan;
+	state.defaultLyric = m_defaultLyric;
+	state.extension = m_tuneExtension;
+	return state;
+}
+
+void Singer::SetTuneState(const TuneState& state)
+{
+	m_noteVolume = state.volume;
+	m_notePan = state.pan;
+	m_defaultLyric = state.defaultLyric;
+	m_tuneExtension = state.extension;
+}
+
+bool Singer::ApplyTune(const char* cmd, TuneState& state)
+{
+	return state.Tune(cmd) || TuneDefaultLyric(cmd, state) || TuneExtension(cmd, state);
 }
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <Deferred.h>
+#include "TuneState.h"
 
 class NoteBuffer;
 class TrackBuffer;
@@ -42,6 +43,15 @@ struct RapPieceInternal
 typedef Deferred<RapPieceInternal> RapPieceInternal_Deferred;
 typedef std::vector<RapPieceInternal_Deferred> RapPieceInternalList;
 
+// what a singer still loads in the background for a call, waited for when released
+class SingerPrefetch
+{
+public:
+	virtual ~SingerPrefetch() {}
+};
+
+typedef Deferred<SingerPrefetch> SingerPrefetch_Deferred;
+
 class Singer
 {
 public:
@@ -54,26 +64,60 @@ public:
 	void SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& pieces, unsigned tempo = 80, float RefFreq = 261.626f);
 	void RapConsecutivePieces(TrackBuffer& buffer, const RapSequence& pieces, unsigned tempo = 80, float RefFreq = 261.626f);
 
+	// same as above, using the volume, pan and default lyric of "state" instead of the singer's own
+	void SingPiece(TrackBuffer& buffer, const SingingPiece& piece, const TuneState& state, unsigned tempo = 80, float RefFreq = 261.626f);
+	void RapAPiece(TrackBuffer& buffer, const RapPiece& piece, const TuneState& state, unsigned tempo = 80, float RefFreq = 261.626f);
+	void SingConsecutivePieces(TrackBuffer& buffer, const SingingSequence& pieces, const TuneState& state, unsigned tempo = 80, float RefFreq = 261.626f);
+	void RapConsecutivePieces(TrackBuffer& buffer, const RapSequence& pieces, const TuneState& state, unsigned tempo = 80, float RefFreq = 261.626f);
+
+	// lets the singer load what the sequences will use before they are generated, each sequence
+	// with the state it will be generated with. Rendering can start before the returned job ends
+	SingerPrefetch_Deferred PrefetchSequences(unsigned sampleRate, const std::vector<const SingingSequence*>& singing, const std::vector<TuneState>& singingStates,
+		const std::vector<const RapSequence*>& raps, const std::vector<TuneState>& rapStates, unsigned tempo = 80, float RefFreq = 261.626f);
+
 	std::string GetLyricCharset()
 	{
 		return m_lyric_charset;
 	}
 
-	virtual bool Tune(const char* cmd);
+	bool Tune(const char* cmd);
+
+	TuneState GetTuneState() const;
+	void SetTuneState(const TuneState& state);
+
+	// same as Tune(), changing "state" only, so it can be called while other threads render with the singer
+	bool ApplyTune(const char* cmd, TuneState& state);
 
 protected:
+	// commands of a subclass, which keeps their settings in state.extension
+	// (see TuneStateExtension) and reads them back from the state it generates with
+	virtual bool TuneExtension(const char* /*cmd*/, TuneState& /*state*/) { return false; }
+
 	void Silence(unsigned numOfSamples, NoteBuffer* noteBuf);
-	virtual void GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf);
-	virtual void GenerateWave_Rap(RapPieceInternal piece, NoteBuffer* noteBuf);
+	virtual void GenerateWave(SingingPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf);
+	virtual void GenerateWave_Rap(RapPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf);
+
+	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf);
+	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf);
 
-	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, NoteBuffer* noteBuf);
-	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuffer* noteBuf);
+	// whether the two above can run on several threads at once, the sentences of a sequence
+	// (separated by rests) are then generated concurrently
+	virtual bool CanGenerateConcurrently(const TuneState& /*state*/) const { return false; }
+
+	// gets the sentences of the sequences as GenerateWave_SingConsecutive()/GenerateWave_RapConsecutive()
+	// will receive them, with their states, to load ahead what they use. Nothing is done by default
+	virtual SingerPrefetch_Deferred PrefetchSentences(const std::vector<SingingPieceInternalList>& /*singing*/, const std::vector<TuneState>& /*singingStates*/,
+		const std::vector<RapPieceInternalList>& /*raps*/, const std::vector<TuneState>& /*rapStates*/, float /*sampleRate*/)
+	{
+		return SingerPrefetch_Deferred();
+	}
 
 	float m_noteVolume;
 	float m_notePan;
 
 	std::string m_defaultLyric;
 	std::string m_lyric_charset;
+	TuneStateExtension_Deferred m_tuneExtension;
 
 };
 
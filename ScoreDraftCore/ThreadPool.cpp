@@ -0,0 +1,88 @@
+#include "ThreadPool.h"
+#include "ParallelFor.h"
+
+ThreadPool::ThreadPool(unsigned numThreads)
+	: m_func(nullptr), m_count(0), m_next(0), m_numWorkers(0), m_busy(0), m_jobId(0), m_quit(false)
+{
+	if (numThreads == 0) numThreads = DefaultNumberOfThreads();
+	for (unsigned t = 1; t < numThreads; t++)
+		m_threads.push_back(std::thread(&ThreadPool::_workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (unsigned t = 0; t < (unsigned)m_threads.size(); t++)
+		m_threads[t].join();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	// never destroyed, joining threads while the process exits isn't safe everywhere
+	static ThreadPool* s_pool = new ThreadPool;
+	return *s_pool;
+}
+
+void ThreadPool::ParallelFor(unsigned count, unsigned numThreads, const std::function<void(unsigned)>& func)
+{
+	if (numThreads == 0 || numThreads > NumberOfThreads()) numThreads = NumberOfThreads();
+	if (numThreads > count) numThreads = count;
+
+	std::unique_lock<std::mutex> job(m_jobMutex, std::try_to_lock);
+	if (numThreads <= 1 || !job.owns_lock())
+	{
+		for (unsigned i = 0; i < count; i++)
+			func(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_func = &func;
+		m_count = count;
+		m_next = 0;
+		m_numWorkers = numThreads - 1;
+		m_jobId++;
+	}
+	m_wake.notify_all();
+
+	_work();
+
+	// workers that didn't join by now find no index left, the job is closed for them
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busy == 0; });
+	m_func = nullptr;
+	m_count = 0;
+	m_numWorkers = 0;
+}
+
+void ThreadPool::_work()
+{
+	unsigned i;
+	while ((i = m_next++) < m_count)
+		(*m_func)(i);
+}
+
+void ThreadPool::_workerLoop()
+{
+	unsigned jobId = 0;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [this, jobId]() { return m_quit || m_jobId != jobId; });
+		if (m_quit) break;
+		jobId = m_jobId;
+		if (m_busy >= m_numWorkers) continue;
+
+		m_busy++;
+		lock.unlock();
+		_work();
+		lock.lock();
+		m_busy--;
+		if (m_busy == 0) m_done.notify_all();
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef _scoredraft_ThreadPool_h
+#define _scoredraft_ThreadPool_h
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+/*
+	Worker threads kept alive across jobs, for loops run many times per second,
+	where starting threads for each call of ParallelFor() would cost more than the work.
+	One job runs at a time. A job started while another one is running, from another
+	thread or from inside the job, runs on the calling thread alone.
+*/
+class ThreadPool
+{
+public:
+	// numThreads counts the calling thread, 0 means one thread per core
+	ThreadPool(unsigned numThreads = 0);
+	~ThreadPool();
+
+	unsigned NumberOfThreads() const { return (unsigned)m_threads.size() + 1; }
+
+	// Calls func(i) for i in [0, count) on up to numThreads threads of the pool, the calling thread included.
+	// Indices are handed out one at a time, like ParallelFor(). numThreads = 0 means all the threads.
+	void ParallelFor(unsigned count, unsigned numThreads, const std::function<void(unsigned)>& func);
+
+	// pool of the process, created on first use with one thread per core
+	static ThreadPool& Shared();
+
+private:
+	void _workerLoop();
+	void _work();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_jobMutex; // held by the thread running a job
+
+	// job state, guarded by m_mutex, except m_next
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(unsigned)>* m_func;
+	unsigned m_count;
+	std::atomic<unsigned> m_next;
+	unsigned m_numWorkers; // workers allowed to join the job
+	unsigned m_busy; // workers currently in the job
+	unsigned m_jobId;
+	bool m_quit;
+
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator=(const ThreadPool &);
+};
+
+#endif
@@ -1,7 +1,11 @@
 #include "TrackBuffer.h"
+#include "MixKernels.h"
+#include "TrackMixer.h"
+#include "BufferPool.h"
 #include <memory.h>
 #include <cmath>
 #include <cassert>
+#include <stdio.h>
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -19,7 +23,7 @@ NoteBuffer::NoteBuffer()
 	m_sampleNum = 0;
 	m_data = nullptr;
 
-	m_cursorDelta = 0.0f;
+	m_cursorDelta = 0.0;
 	m_alignPos = 0;	
 	m_volume = 1.0f;
 	m_pan = 0.0f;
@@ -27,26 +31,30 @@ NoteBuffer::NoteBuffer()
 
 NoteBuffer::~NoteBuffer()
 {
-	delete[] m_data;
+	BufferPool::Free(m_data);
 }
 
 void NoteBuffer::Allocate()
 {
-	delete[] m_data;
-	m_data = new float[m_sampleNum*m_channelNum];
+	size_t count = (size_t)m_sampleNum*m_channelNum;
+	if (BufferPool::Capacity(m_data) >= count) return;
+	BufferPool::Free(m_data);
+	m_data = BufferPool::Allocate(count);
 }
 
 TrackBuffer_deferred::TrackBuffer_deferred(){}
 TrackBuffer_deferred::TrackBuffer_deferred(const TrackBuffer_deferred & in) : Deferred<TrackBuffer>(in){}
-TrackBuffer_deferred::TrackBuffer_deferred(unsigned rate, unsigned chn): Deferred<TrackBuffer>(new TrackBuffer(rate, chn)){}
+TrackBuffer_deferred::TrackBuffer_deferred(unsigned rate, unsigned chn, TrackStorageType storage) : Deferred<TrackBuffer>(new TrackBuffer(rate, chn, storage)){}
+
+static const unsigned s_chunkSize = 65536;
+static const unsigned s_absentChunk = (unsigned)(-1);
 
-static const unsigned s_localBufferSize = 65536;
 unsigned TrackBuffer::GetLocalBufferSize()
 {
-	return s_localBufferSize;
+	return s_chunkSize;
 }
 
-TrackBuffer::TrackBuffer(unsigned rate, unsigned chn) : m_rate(rate)
+TrackBuffer::TrackBuffer(unsigned rate, unsigned chn, TrackStorageType storage) : m_rate(rate)
 {
 	if (chn < 1)
 	{
@@ -58,77 +66,198 @@ TrackBuffer::TrackBuffer(unsigned rate, unsigned chn) : m_rate(rate)
 	}
 	m_chn = chn;
 
-	m_fp = tmpfile();
+	m_storage = TrackStorage::Create(storage);
+	m_numSlots = 0;
 
-	m_localBuffer = new float[s_localBufferSize*m_chn];
-	m_localBufferPos = (unsigned)(-1);
+	// addressable storages are read in place, only the file storage needs a read cache
+	m_localBuffer = m_storage->Addressable() ? nullptr : new float[s_chunkSize*m_chn];
+	m_localBufferSlot = s_absentChunk;
 
 	m_volume = 1.0f;
 	m_pan = 0.0f;
-	m_cursor = 0.0f;
+	m_cursor = 0.0;
 	m_length = 0;
-	m_alignPos = (unsigned)(-1);
+	m_alignPos = (uint64_t)(-1);
 }
 
 TrackBuffer::~TrackBuffer()
 {
-	delete m_localBuffer;
-	fclose(m_fp);
+	delete[] m_localBuffer;
+	delete m_storage;
 }
 
-void TrackBuffer::_seek(unsigned upos)
+void TrackBuffer::_seek(uint64_t upos)
 {
-	if (upos <= m_length)
-	{
-		fseek(m_fp, (long)(sizeof(float)*upos*m_chn), SEEK_SET);
-	}
-	else
-	{
-		fseek(m_fp, 0, SEEK_END);
-		float *tmp = new float[(upos - m_length)*m_chn];
-		memset(tmp, 0, (upos - m_length)*m_chn*sizeof(float));
-		fwrite(tmp, sizeof(float), (upos - m_length)*m_chn, m_fp);
-		delete[] tmp;
-		m_length = upos;
-	}
+	// nothing to write, chunks that are never written read as zeros
+	if (upos > m_length) m_length = upos;
 }
 
 
-float TrackBuffer::GetCursor()
+double TrackBuffer::GetCursor()
 {
 	return m_cursor;
 }
 
 
-void TrackBuffer::SetCursor(float fpos)
+void TrackBuffer::SetCursor(double fpos)
 {
-	if (m_alignPos == (unsigned)(-1)) m_alignPos = 0;
+	if (m_alignPos == (uint64_t)(-1)) m_alignPos = 0;
 	m_cursor = fpos;
-	if (m_cursor < 0.0f) m_cursor = 0.0f;
+	if (m_cursor < 0.0) m_cursor = 0.0;
 }
 
 
-void TrackBuffer::MoveCursor(float delta)
+void TrackBuffer::MoveCursor(double delta)
 {
 	SetCursor(m_cursor + delta);
 }
 
 void TrackBuffer::SeekToCursor()
 {
-	unsigned upos = (unsigned)(m_cursor);
+	uint64_t upos = (uint64_t)(m_cursor);
 	_seek(upos);
 }
 
+unsigned TrackBuffer::_getSlot(unsigned chunk) const
+{
+	if (chunk >= (unsigned)m_chunks.size()) return s_absentChunk;
+	return m_chunks[chunk].slot;
+}
 
-void TrackBuffer::_writeSamples(unsigned count, const float* samples, unsigned alignPos)
+unsigned TrackBuffer::_allocateSlot(unsigned chunk)
 {
-	unsigned upos = (unsigned)(m_cursor)+m_alignPos - alignPos;
-	_seek(upos);
-	fwrite(samples, sizeof(float), count*m_chn, m_fp);
-	m_length = max(m_length, upos + count);
-	m_localBufferPos = -1;
+	if (m_storage->Addressable())
+	{
+		size_t size = (size_t)(m_numSlots + 1)*s_chunkSize*m_chn;
+		if (!m_storage->Extend(size)) _migrateToFile();
+	}
+	unsigned slot = m_numSlots;
+	// the file storage is extended when the new chunk is written as a whole
+
+	if (chunk >= (unsigned)m_chunks.size())
+	{
+		TrackChunk absent;
+		absent.slot = s_absentChunk;
+		absent.peak = 0.0f;
+		absent.peakPos = 0;
+		absent.peakValid = true;
+		m_chunks.resize(chunk + 1, absent);
+	}
+	m_chunks[chunk].slot = slot;
+	m_numSlots++;
+	return slot;
+}
+
+// when an addressable storage cannot grow (the mapped file fails to resize), the chunks
+// written so far are copied to a file storage, which the track uses from then on
+void TrackBuffer::_migrateToFile()
+{
+	printf("TrackBuffer: moving the track to the file storage.\n");
+	TrackStorage* storage = TrackStorage::Create(TrackStorage_File);
+	size_t chunkFloats = (size_t)s_chunkSize*m_chn;
+	const float* data = m_storage->Data();
+	if (data == nullptr && m_numSlots > 0)
+	{
+		// the mapping was lost, the chunks written so far read as silence from now on
+		printf("TrackBuffer: the content of the track was lost while moving it.\n");
+		for (unsigned chunk = 0; chunk < (unsigned)m_chunks.size(); chunk++)
+		{
+			m_chunks[chunk].slot = s_absentChunk;
+			m_chunks[chunk].peak = 0.0f;
+			m_chunks[chunk].peakPos = 0;
+			m_chunks[chunk].peakValid = true;
+		}
+		m_numSlots = 0;
+	}
+	for (unsigned slot = 0; slot < m_numSlots; slot++)
+		if (!storage->Write((uint64_t)slot*chunkFloats, chunkFloats, data + (size_t)slot*chunkFloats))
+		{
+			printf("TrackBuffer: failed to write to the track storage.\n");
+			break;
+		}
+	delete m_storage;
+	m_storage = storage;
+
+	m_localBuffer = new float[chunkFloats];
+	m_localBufferSlot = s_absentChunk;
+}
+
+const float* TrackBuffer::_chunkData(unsigned slot)
+{
+	if (m_storage->Addressable())
+		return m_storage->Data() + (size_t)slot*s_chunkSize*m_chn;
+
+	if (m_localBufferSlot != slot)
+	{
+		m_storage->Read((size_t)slot*s_chunkSize*m_chn, s_chunkSize*m_chn, m_localBuffer);
+		m_localBufferSlot = slot;
+	}
+	return m_localBuffer;
+}
+
+bool TrackBuffer::IsSilent(uint64_t startIndex, uint64_t length) const
+{
+	if (length == 0 || startIndex >= m_length) return true;
+	uint64_t endIndex = min(startIndex + length, m_length);
+	unsigned lastChunk = (unsigned)((endIndex - 1) / s_chunkSize);
+	for (unsigned chunk = (unsigned)(startIndex / s_chunkSize); chunk <= lastChunk; chunk++)
+		if (_getSlot(chunk) != s_absentChunk) return false;
+	return true;
 }
 
+static float PeakOf(const float* samples, unsigned count, unsigned chn, unsigned& peakPos)
+{
+	float peak = 0.0f;
+	peakPos = 0;
+	for (unsigned i = 0; i < count*chn; i++)
+	{
+		float v = fabsf(samples[i]);
+		if (v > peak)
+		{
+			peak = v;
+			peakPos = i / chn;
+		}
+	}
+	return peak;
+}
+
+void TrackBuffer::_updatePeak(unsigned chunk, unsigned offset, unsigned len, const float* written)
+{
+	TrackChunk& entry = m_chunks[chunk];
+	if (!entry.peakValid) return;
+
+	unsigned pos;
+	float peak = PeakOf(written, len, m_chn, pos);
+	if (peak >= entry.peak)
+	{
+		entry.peak = peak;
+		entry.peakPos = offset + pos;
+	}
+	else if (entry.peakPos >= offset && entry.peakPos < offset + len)
+	{
+		// the old peak may have been cancelled, rescan the chunk when the peak is asked for
+		entry.peakValid = false;
+	}
+}
+
+float TrackBuffer::_chunkPeak(unsigned chunk)
+{
+	TrackChunk& entry = m_chunks[chunk];
+	if (entry.slot == s_absentChunk) return 0.0f;
+	if (!entry.peakValid)
+	{
+		entry.peak = PeakOf(_chunkData(entry.slot), s_chunkSize, m_chn, entry.peakPos);
+		entry.peakValid = true;
+	}
+	return entry.peak;
+}
+
+static bool IsZero(const float* samples, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++)
+		if (samples[i] != 0.0f) return false;
+	return true;
+}
 
 void TrackBuffer::WriteBlend(const NoteBuffer& noteBuf)
 {
@@ -136,259 +265,183 @@ void TrackBuffer::WriteBlend(const NoteBuffer& noteBuf)
 	unsigned count = noteBuf.m_sampleNum;
 	unsigned src_chn = noteBuf.m_channelNum;
 
-	float* samples = noteBuf.m_data;
+	const float* samples = noteBuf.m_data;
 	unsigned note_alignPos = noteBuf.m_alignPos;
-	float cursorDelta = noteBuf.m_cursorDelta;
+	double cursorDelta = noteBuf.m_cursorDelta;
 	float volume = noteBuf.m_volume;
 
-	if (m_alignPos == (unsigned)(-1))
+	if (m_alignPos == (uint64_t)(-1))
 	{
 		m_alignPos = note_alignPos;
 	}
-	if ((unsigned)(m_cursor)+m_alignPos < note_alignPos)
+	uint64_t alignedCursor = (uint64_t)(m_cursor)+m_alignPos;
+	if (alignedCursor < note_alignPos)
 	{
-		unsigned truncate = note_alignPos - (unsigned)(m_cursor)+m_alignPos;
+		unsigned truncate = note_alignPos - (unsigned)alignedCursor;
+		if (truncate > count) truncate = count;
 		count -= truncate;
 		samples += truncate*src_chn;
 		note_alignPos -= truncate;
 	}
-	unsigned upos = (unsigned)(m_cursor)+m_alignPos - note_alignPos;
+	uint64_t upos = alignedCursor >= note_alignPos ? alignedCursor - note_alignPos : 0;
 
-	float *tmpSamples = new float[count*m_chn];
-	for (unsigned i = 0; i < count; i++)
-	{
-		float sample_l;
-		float sample_r;
+	size_t chunkFloats = (size_t)s_chunkSize*m_chn;
 
-		if (src_chn == 1)
-		{
-			sample_l = sample_r = samples[i];
-		}
-		else if (src_chn == 2)
+	uint64_t pos = upos;
+	unsigned remaining = count;
+	while (remaining > 0)
+	{
+		unsigned chunk = (unsigned)(pos / s_chunkSize);
+		unsigned offset = (unsigned)(pos - (uint64_t)chunk*s_chunkSize);
+		unsigned len = min(remaining, s_chunkSize - offset);
+
+		unsigned slot = _getSlot(chunk);
+		bool newChunk = false;
+		// silence landing on an unwritten chunk stays implicit
+		if (slot == s_absentChunk && !IsZero(samples, len*src_chn))
 		{
-			sample_l = samples[i * 2];
-			sample_r = samples[i * 2 + 1];
+			slot = _allocateSlot(chunk);
+			newChunk = true;
 		}
 
-		if (m_chn == 1)
-		{
-			tmpSamples[i] = (sample_l + sample_r)*0.5f * volume;
-		}
-		else if (m_chn == 2)
+		if (slot != s_absentChunk)
 		{
-			CalcPan(noteBuf.m_pan, sample_l, sample_r);
-			tmpSamples[i * 2] = sample_l* volume;
-			tmpSamples[i * 2 + 1] = sample_r* volume;
+			size_t chunkStart = (size_t)slot*chunkFloats;
+			// checked for each chunk, allocating one may have moved the track to the file storage
+			if (m_storage->Addressable())
+			{
+				// blend in place, no round trip through a temporary buffer
+				float* dst = m_storage->Data() + chunkStart + offset*m_chn;
+				MixBlend(dst, m_chn, samples, src_chn, len, volume, noteBuf.m_pan);
+				_updatePeak(chunk, offset, len, dst);
+			}
+			else
+			{
+				// read-modify-write through the local buffer, a new chunk is written as a whole
+				if (newChunk)
+					memset(m_localBuffer, 0, sizeof(float)*chunkFloats);
+				else
+					m_storage->Read(chunkStart + offset*m_chn, len*m_chn, m_localBuffer + offset*m_chn);
+				MixBlend(m_localBuffer + offset*m_chn, m_chn, samples, src_chn, len, volume, noteBuf.m_pan);
+				_updatePeak(chunk, offset, len, m_localBuffer + offset*m_chn);
+				bool written;
+				if (newChunk)
+					written = m_storage->Write(chunkStart, chunkFloats, m_localBuffer);
+				else
+					written = m_storage->Write(chunkStart + offset*m_chn, len*m_chn, m_localBuffer + offset*m_chn);
+				if (!written) printf("TrackBuffer: failed to write to the track storage.\n");
+				m_localBufferSlot = s_absentChunk;
+			}
 		}
 
+		pos += len;
+		samples += len*src_chn;
+		remaining -= len;
 	}
-
-	if (upos < m_length)
-	{
-		unsigned sec = min(count, m_length - upos);
-		float* secbuf = new float[sec * m_chn];
-		_seek(upos);
-		fread(secbuf, sizeof(float), sec*m_chn, m_fp);
-
-		for (unsigned i = 0; i < sec*m_chn; i++)
-			tmpSamples[i] += secbuf[i];
-
-		delete[] secbuf;
-	}
-
-	_writeSamples(count, tmpSamples, note_alignPos);
-
-	delete[] tmpSamples;
+	m_length = max(m_length, upos + count);
 
 	MoveCursor(cursorDelta);
 }
 
 
-bool TrackBuffer::CombineTracks(unsigned num, TrackBuffer_deferred* tracks)
+bool TrackBuffer::CombineTracks(unsigned num, TrackBuffer_deferred* tracks, unsigned numThreads)
 {
-	NoteBuffer targetBuffer;
-	targetBuffer.m_sampleNum = s_localBufferSize;
-	targetBuffer.m_channelNum = m_chn;
-	targetBuffer.Allocate();
-
-	unsigned *lengths = new unsigned[num];
-	int* sourcePos = new int[num];
-	float* trackVolumes = new float[num];
-	float* trackPans = new float[num];
-
-	// scan
-	unsigned i;
-	float maxCursor = 0.0f;
-	unsigned maxAlign = 0;
-
-	for (i = 0; i<num; i++)
-	{
-		if (tracks[i]->Rate() != m_rate)
-		{
-			delete[] trackPans;
-			delete[] trackVolumes;
-			delete[] sourcePos;
-			delete[] lengths;
-			return false;
-		}
-		lengths[i] = tracks[i]->NumberOfSamples();
+	TrackMixer mixer(num, tracks, m_rate, m_chn, numThreads);
+	if (!mixer.IsValid()) return false;
 
-		float cursor = tracks[i]->GetCursor();
-		if (cursor > maxCursor) maxCursor = cursor;
+	double maxCursor = mixer.MaxCursor() + m_cursor;
+	uint64_t maxAlign = mixer.AlignPos();
 
-		unsigned align = tracks[i]->AlignPos();
-		if (align != (unsigned)(-1) && align > maxAlign) maxAlign = align;
-
-		sourcePos[i] = (int)(align);
-		trackVolumes[i] = tracks[i]->AbsoluteVolume();
-		trackPans[i] = tracks[i]->Pan();
-	}
-
-	for (i = 0; i < num; i++)
+	// windows are mixed in parallel batches, then blended into this track in order
+	for (unsigned batchStart = 0; batchStart < mixer.NumberOfWindows(); batchStart += mixer.BatchSize())
 	{
-		sourcePos[i] -= (int)maxAlign;
-	}
-
-	maxCursor += m_cursor;
-
-	bool finish = false;
-
-	while (!finish)
-	{
-		finish = true;
-		memset(targetBuffer.m_data, 0, sizeof(float)*s_localBufferSize*m_chn);
-		unsigned maxCount = 0;
-
-		for (i = 0; i<num; i++)
+		unsigned batchCount = mixer.MixBatch(batchStart);
+		for (unsigned i = 0; i < batchCount; i++)
 		{
-			if ((int)lengths[i] > sourcePos[i])
-			{
-				int count = min(s_localBufferSize, (int)lengths[i] - sourcePos[i]);
-				maxCount = (unsigned)max(count, (int)maxCount);
-				int j;
-				for (j = 0; j<count; j++)
-				{
-					if ((int)j + sourcePos[i]>0)
-					{
-						float samples[2];
-						tracks[i]->Sample((unsigned)((int)j + sourcePos[i]), samples);
-						float sample_l;
-						float sample_r;
-						if (tracks[i]->m_chn == 1)
-						{
-							sample_l = sample_r = samples[0];
-						}
-						else if (tracks[i]->m_chn == 2)
-						{
-							sample_l = samples[0];
-							sample_r = samples[1];
-						}
-
-						if (m_chn == 1)
-						{
-							targetBuffer.m_data[j] += (sample_l + sample_r)*0.5f* trackVolumes[i];
-						}
-						else if (m_chn == 2)
-						{
-							CalcPan(trackPans[i], sample_l, sample_r);
-							targetBuffer.m_data[j * 2] += sample_l* trackVolumes[i];
-							targetBuffer.m_data[j * 2 + 1] += sample_r* trackVolumes[i];
-						}
-					}
-				}
-				sourcePos[i] += count;
-				if ((int)lengths[i] > sourcePos[i]) finish = false;
-			}
+			NoteBuffer& window = mixer.Window(i);
+			window.m_alignPos = (unsigned)maxAlign;
+			window.m_cursorDelta = (double)window.m_sampleNum - (double)maxAlign;
+			WriteBlend(window);
+			maxAlign = 0;
 		}
-		targetBuffer.m_sampleNum = maxCount;
-		targetBuffer.m_cursorDelta = (float)(maxCount - maxAlign);
-		targetBuffer.m_alignPos = maxAlign;
-		WriteBlend(targetBuffer);
-		maxAlign = 0;
 	}
 	SetCursor(maxCursor);
 
-	delete[] trackPans;
-	delete[] trackVolumes;
-	delete[] sourcePos;
-	delete[] lengths;
-
 	return true;
 }
 
 
-void TrackBuffer::Sample(unsigned index, float* sample)
+void TrackBuffer::Sample(uint64_t index, float* sample)
 {
-	if (index >= m_length)
+	unsigned slot = index < m_length ? _getSlot((unsigned)(index / s_chunkSize)) : s_absentChunk;
+	if (slot == s_absentChunk)
 	{
 		for (unsigned c = 0; c<m_chn; c++)
 			sample[c] = 0.0f;
-	}
-	if (m_localBufferPos == (unsigned)(-1) || m_localBufferPos>index || m_localBufferPos + s_localBufferSize <= index)
-	{
-		m_localBufferPos = (index / s_localBufferSize)*s_localBufferSize;
-		memset(m_localBuffer, 0, sizeof(float)*s_localBufferSize*m_chn);
-
-		if (m_localBufferPos < m_length)
-		{
-			fseek(m_fp, m_localBufferPos*sizeof(float)*m_chn, SEEK_SET);
-			fread(m_localBuffer, sizeof(float), min(s_localBufferSize, m_length - m_localBufferPos)*m_chn, m_fp);
-		}
+		return;
 	}
 
-	unsigned readPos = index - m_localBufferPos;
+	const float* data = _chunkData(slot) + (index % s_chunkSize)*m_chn;
 	for (unsigned c = 0; c < m_chn; c++)
-		sample[c] = m_localBuffer[readPos * m_chn + c];
+		sample[c] = data[c];
 }
 
-void TrackBuffer::GetSamples(unsigned startIndex, unsigned length, float* buffer)
+void TrackBuffer::GetSamples(uint64_t startIndex, unsigned length, float* buffer)
 {
 	while (length > 0)
 	{
 		if (startIndex >= m_length) break;
-		if (m_localBufferPos == (unsigned)(-1) || m_localBufferPos > startIndex || m_localBufferPos + s_localBufferSize <= startIndex)
-		{
-			m_localBufferPos = (startIndex / s_localBufferSize)*s_localBufferSize;
-			memset(m_localBuffer, 0, sizeof(float)*s_localBufferSize*m_chn);
+		unsigned chunk = (unsigned)(startIndex / s_chunkSize);
+		unsigned offset = (unsigned)(startIndex - (uint64_t)chunk*s_chunkSize);
+		unsigned readLength = min(length, s_chunkSize - offset);
 
-			if (m_localBufferPos < m_length)
-			{
-				fseek(m_fp, m_localBufferPos*sizeof(float)*m_chn, SEEK_SET);
-				fread(m_localBuffer, sizeof(float), min(s_localBufferSize, m_length - m_localBufferPos)*m_chn, m_fp);
-			}
-		}
+		unsigned slot = _getSlot(chunk);
+		if (slot == s_absentChunk)
+			memset(buffer, 0, sizeof(float)*readLength*m_chn);
+		else
+			memcpy(buffer, _chunkData(slot) + offset*m_chn, sizeof(float)* readLength*m_chn);
 
-		unsigned readLength = min(length, m_localBufferPos + s_localBufferSize - startIndex);
-		memcpy(buffer, m_localBuffer + (startIndex - m_localBufferPos)*m_chn, sizeof(float)* readLength*m_chn);
 		startIndex += readLength;
 		length -= readLength;
-		buffer += readLength;
+		buffer += readLength*m_chn;
 	}
 }
 
-float TrackBuffer::MaxValue()
+void TrackBuffer::ReadSamples(uint64_t startIndex, unsigned length, float* buffer) const
 {
-	unsigned i;
-	float buf[2];
-	Sample(0, buf);
-
-	float maxValue;
-	if (m_chn == 1)
-		maxValue = fabsf(buf[0]);
-	else if (m_chn == 2)
-		maxValue = max(fabsf(buf[0]), fabsf(buf[1]));
-
-	for (i = 1; i < m_length; i++)
+	while (length > 0)
 	{
-		Sample(i, buf);
-		float _max;
-		if (m_chn == 1)
-			_max = fabsf(buf[0]);
-		else if (m_chn == 2)
-			_max = max(fabsf(buf[0]), fabsf(buf[1]));
-
-		maxValue = max(maxValue, _max);
+		if (startIndex >= m_length) break;
+		unsigned chunk = (unsigned)(startIndex / s_chunkSize);
+		unsigned offset = (unsigned)(startIndex - (uint64_t)chunk*s_chunkSize);
+		unsigned readLength = min(length, s_chunkSize - offset);
+
+		unsigned slot = _getSlot(chunk);
+		if (slot == s_absentChunk)
+			memset(buffer, 0, sizeof(float)*readLength*m_chn);
+		else if (m_storage->Addressable())
+			memcpy(buffer, m_storage->Data() + ((size_t)slot*s_chunkSize + offset)*m_chn, sizeof(float)* readLength*m_chn);
+		else
+			m_storage->Read(((size_t)slot*s_chunkSize + offset)*m_chn, readLength*m_chn, buffer);
+
+		startIndex += readLength;
+		length -= readLength;
+		buffer += readLength*m_chn;
 	}
+}
 
+float TrackBuffer::MaxValue()
+{
+	float maxValue = 0.0f;
+	for (unsigned chunk = 0; chunk < (unsigned)m_chunks.size(); chunk++)
+		maxValue = max(maxValue, _chunkPeak(chunk));
 	return maxValue;
 }
+
+void TrackBuffer::GetChunkPeaks(std::vector<float>& peaks)
+{
+	unsigned numChunks = (unsigned)((m_length + s_chunkSize - 1) / s_chunkSize);
+	peaks.resize(numChunks);
+	for (unsigned chunk = 0; chunk < numChunks; chunk++)
+		peaks[chunk] = chunk < (unsigned)m_chunks.size() ? _chunkPeak(chunk) : 0.0f;
+}
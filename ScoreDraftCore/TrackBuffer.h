@@ -2,7 +2,10 @@
 #define _scoredraft_TrackBuffer_h
 
 #include "stdio.h"
+#include <stdint.h>
+#include <vector>
 #include "Deferred.h"
+#include "TrackStorage.h"
 
 inline void CalcPan(float pan, float& l, float& r)
 {
@@ -37,11 +40,12 @@ public:
 	unsigned m_sampleNum;
 	float* m_data;
 
-	float m_cursorDelta;
+	double m_cursorDelta;
 	unsigned m_alignPos;
 	float m_volume;
 	float m_pan;
 
+	// buffers come from BufferPool, an existing buffer is kept if it is large enough
 	void Allocate();
 };
 
@@ -51,15 +55,17 @@ class TrackBuffer_deferred : public Deferred<TrackBuffer>
 public:
 	TrackBuffer_deferred();
 	TrackBuffer_deferred(const TrackBuffer_deferred & in);
-	TrackBuffer_deferred(unsigned rate, unsigned chn=1);
+	TrackBuffer_deferred(unsigned rate, unsigned chn = 1, TrackStorageType storage = TrackStorage_File);
 };
 
 class TrackBuffer
 {
 public:
-	TrackBuffer(unsigned rate = 44100, unsigned chn = 1);
+	TrackBuffer(unsigned rate = 44100, unsigned chn = 1, TrackStorageType storage = TrackStorage_File);
 	~TrackBuffer();
 
+	TrackStorageType StorageType() const { return m_storage->Type(); }
+
 	unsigned Rate() const { return m_rate; }
 	void SetRate(unsigned rate) { m_rate = rate; }
 
@@ -76,33 +82,45 @@ public:
 	float Pan() const { return m_pan; }
 	void SetPan(float pan) { m_pan = pan; }
 
-	float GetCursor();
-	void SetCursor(float fpos);
-	void MoveCursor(float delta);
+	// cursors are kept in double, so that they stay sample accurate in long tracks
+	double GetCursor();
+	void SetCursor(double fpos);
+	void MoveCursor(double delta);
 
 	void SeekToCursor();
 
 	void WriteBlend(const NoteBuffer& noteBuf);
 
-	unsigned NumberOfSamples()
+	uint64_t NumberOfSamples()
 	{
 		return m_length;
 	}
-	unsigned AlignPos()
+	uint64_t AlignPos()
 	{
 		return m_alignPos;
 	}
 
-	void Sample(unsigned index, float* sample);
+	void Sample(uint64_t index, float* sample);
+
+	// peaks are tracked per chunk as samples are written, no rescan of the track
 	float MaxValue();
+	// absolute peak of each chunk of GetLocalBufferSize() samples, 0 for silent chunks
+	void GetChunkPeaks(std::vector<float>& peaks);
+
+	void GetSamples(uint64_t startIndex, unsigned length, float* buffer);
+
+	// same as GetSamples() but bypasses the local buffer, safe to call from multiple threads
+	void ReadSamples(uint64_t startIndex, unsigned length, float* buffer) const;
 
-	void GetSamples(unsigned startIndex, unsigned length, float* buffer);
+	// true if no sample in the range has ever been written
+	bool IsSilent(uint64_t startIndex, uint64_t length) const;
 
-	bool CombineTracks(unsigned num, TrackBuffer_deferred* tracks);
+	// numThreads = 0 uses all cores, the result is the same for any number of threads
+	bool CombineTracks(unsigned num, TrackBuffer_deferred* tracks, unsigned numThreads = 0);
 	unsigned GetLocalBufferSize();
 
 private:
-	FILE *m_fp;
+	TrackStorage *m_storage;
 
 	unsigned m_rate;
 	unsigned m_chn;
@@ -110,16 +128,34 @@ private:
 	float m_volume;
 	float m_pan;
 
+	// the track is stored as fixed-size chunks, in the order they are first written
+	// m_chunks maps each chunk of the timeline to its slot in m_storage
+	// chunks that are never written are absent and read as zeros
+	struct TrackChunk
+	{
+		unsigned slot;
+		float peak;
+		unsigned peakPos;
+		bool peakValid;
+	};
+	std::vector<TrackChunk> m_chunks;
+	unsigned m_numSlots;
+
 	float *m_localBuffer;
-	unsigned m_localBufferPos;
+	unsigned m_localBufferSlot;
 
-	unsigned m_length;
-	unsigned m_alignPos;
+	uint64_t m_length;
+	uint64_t m_alignPos;
 
-	float m_cursor;
+	double m_cursor;
 
-	void _writeSamples(unsigned count, const float* samples, unsigned alignPos);
-	void _seek(unsigned upos);
+	void _seek(uint64_t upos);
+	unsigned _getSlot(unsigned chunk) const;
+	unsigned _allocateSlot(unsigned chunk);
+	void _migrateToFile();
+	const float* _chunkData(unsigned slot);
+	void _updatePeak(unsigned chunk, unsigned offset, unsigned len, const float* written);
+	float _chunkPeak(unsigned chunk);
 };
 
 #endif 
\ No newline at end of file
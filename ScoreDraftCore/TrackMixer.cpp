@@ -0,0 +1,130 @@
+#include "TrackMixer.h"
+#include "MixKernels.h"
+#include "ParallelFor.h"
+#include "BufferPool.h"
+#include <memory.h>
+
+#ifndef max
+#define max(a,b)            (((a) > (b)) ? (a) : (b))
+#endif
+
+#ifndef min
+#define min(a,b)            (((a) < (b)) ? (a) : (b))
+#endif
+
+static const unsigned s_windowSize = 65536;
+
+unsigned TrackMixer::WindowSize()
+{
+	return s_windowSize;
+}
+
+TrackMixer::TrackMixer(unsigned num, TrackBuffer_deferred* tracks, unsigned rate, unsigned chn, unsigned numThreads)
+	: m_num(num), m_tracks(tracks), m_chn(chn)
+{
+	m_lengths = new uint64_t[num];
+	m_sourcePos = new int64_t[num];
+	m_trackVolumes = new float[num];
+	m_trackPans = new float[num];
+	m_windows = nullptr;
+	m_sourceBuffers = nullptr;
+	m_batchSize = 0;
+	m_numWindows = 0;
+
+	// scan
+	unsigned i;
+	m_valid = true;
+	m_maxCursor = 0.0;
+	m_maxAlign = 0;
+
+	for (i = 0; i<num; i++)
+	{
+		if (tracks[i]->Rate() != rate)
+		{
+			m_valid = false;
+			return;
+		}
+		m_lengths[i] = tracks[i]->NumberOfSamples();
+
+		double cursor = tracks[i]->GetCursor();
+		if (cursor > m_maxCursor) m_maxCursor = cursor;
+
+		uint64_t align = tracks[i]->AlignPos();
+		if (align != (uint64_t)(-1) && align > m_maxAlign) m_maxAlign = align;
+
+		m_sourcePos[i] = (int64_t)(align);
+		m_trackVolumes[i] = tracks[i]->AbsoluteVolume();
+		m_trackPans[i] = tracks[i]->Pan();
+	}
+
+	// in window w, track i is read from m_sourcePos[i] + w*s_windowSize
+	m_numWindows = 1;
+	for (i = 0; i < num; i++)
+	{
+		m_sourcePos[i] -= (int64_t)m_maxAlign;
+		if ((int64_t)m_lengths[i] > m_sourcePos[i])
+			m_numWindows = max(m_numWindows, (unsigned)(((uint64_t)((int64_t)m_lengths[i] - m_sourcePos[i]) + s_windowSize - 1) / s_windowSize));
+	}
+
+	m_numThreads = numThreads > 0 ? numThreads : DefaultNumberOfThreads();
+	m_batchSize = min(m_numWindows, m_numThreads * 2);
+
+	m_windows = new NoteBuffer[m_batchSize];
+	m_sourceBuffers = BufferPool::Allocate(m_batchSize * s_windowSize * 2);
+	for (i = 0; i < m_batchSize; i++)
+	{
+		m_windows[i].m_sampleNum = s_windowSize;
+		m_windows[i].m_channelNum = chn;
+		m_windows[i].Allocate();
+	}
+}
+
+TrackMixer::~TrackMixer()
+{
+	BufferPool::Free(m_sourceBuffers);
+	delete[] m_windows;
+	delete[] m_trackPans;
+	delete[] m_trackVolumes;
+	delete[] m_sourcePos;
+	delete[] m_lengths;
+}
+
+void TrackMixer::_mixWindow(unsigned window, unsigned slot)
+{
+	NoteBuffer& target = m_windows[slot];
+	float* sourceBuffer = m_sourceBuffers + slot * s_windowSize * 2;
+	int64_t windowPos = (int64_t)window*s_windowSize;
+
+	memset(target.m_data, 0, sizeof(float)*s_windowSize*m_chn);
+	unsigned maxCount = 0;
+
+	for (unsigned i = 0; i < m_num; i++)
+	{
+		int64_t pos = m_sourcePos[i] + windowPos;
+		if ((int64_t)m_lengths[i] > pos)
+		{
+			int count = (int)min((int64_t)s_windowSize, (int64_t)m_lengths[i] - pos);
+			maxCount = (unsigned)max(count, (int)maxCount);
+
+			int64_t start = max(pos, (int64_t)0);
+			int offset = (int)(start - pos);
+			if (count > offset && !m_tracks[i]->IsSilent((uint64_t)start, (uint64_t)(count - offset)))
+			{
+				m_tracks[i]->ReadSamples((uint64_t)start, (unsigned)(count - offset), sourceBuffer);
+				MixBlend(target.m_data + offset*m_chn, m_chn, sourceBuffer, m_tracks[i]->NumberOfChannels(), (unsigned)(count - offset), m_trackVolumes[i], m_trackPans[i]);
+			}
+		}
+	}
+	target.m_sampleNum = maxCount;
+}
+
+unsigned TrackMixer::MixBatch(unsigned firstWindow)
+{
+	if (!m_valid || firstWindow >= m_numWindows) return 0;
+	unsigned count = min(m_batchSize, m_numWindows - firstWindow);
+	ParallelFor(count, m_numThreads, [this, firstWindow](unsigned i)
+	{
+		_mixWindow(firstWindow + i, i);
+	});
+	return count;
+}
@@ -0,0 +1,67 @@
+#ifndef _scoredraft_TrackMixer_h
+#define _scoredraft_TrackMixer_h
+
+#include "TrackBuffer.h"
+
+/*
+	Mixes a list of tracks window by window, with their align positions lined up.
+	Each window holds WindowSize() samples of the mix, and the windows of a batch are
+	mixed in parallel. Every window sums the tracks in list order, so the result is
+	the same for any number of threads.
+	Shared by TrackBuffer::CombineTracks() and streaming mixdown, which never stores
+	the whole mix.
+*/
+class TrackMixer
+{
+public:
+	// numThreads = 0 uses all cores
+	TrackMixer(unsigned num, TrackBuffer_deferred* tracks, unsigned rate, unsigned chn, unsigned numThreads = 0);
+	~TrackMixer();
+
+	// false if a track doesn't have the given sample rate
+	bool IsValid() const { return m_valid; }
+
+	static unsigned WindowSize();
+
+	unsigned NumberOfWindows() const { return m_numWindows; }
+	unsigned BatchSize() const { return m_batchSize; }
+
+	// align position of the mix, sample 0 of the mix is aligned to sample AlignPos() of the track
+	// that has the largest align position
+	uint64_t AlignPos() const { return m_maxAlign; }
+	double MaxCursor() const { return m_maxCursor; }
+
+	// mixes windows [firstWindow, firstWindow + BatchSize()), clipped to NumberOfWindows()
+	// returns the number of windows mixed
+	unsigned MixBatch(unsigned firstWindow);
+
+	// results of the last batch, m_sampleNum is the length of the window
+	NoteBuffer& Window(unsigned i) { return m_windows[i]; }
+
+private:
+	unsigned m_num;
+	TrackBuffer_deferred* m_tracks;
+	unsigned m_chn;
+	unsigned m_numThreads;
+	bool m_valid;
+
+	uint64_t *m_lengths;
+	int64_t* m_sourcePos;
+	float* m_trackVolumes;
+	float* m_trackPans;
+
+	double m_maxCursor;
+	uint64_t m_maxAlign;
+	unsigned m_numWindows;
+
+	unsigned m_batchSize;
+	NoteBuffer *m_windows;
+	float *m_sourceBuffers;
+
+	void _mixWindow(unsigned window, unsigned slot);
+
+	TrackMixer(const TrackMixer &);
+	TrackMixer &operator=(const TrackMixer &);
+};
+
+#endif
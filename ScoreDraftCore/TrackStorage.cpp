@@ -0,0 +1,228 @@
+// 64-bit file offsets on 32-bit POSIX systems
+#ifndef _WIN32
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include "TrackStorage.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <memory.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+
+#ifndef max
+#define max(a,b)            (((a) > (b)) ? (a) : (b))
+#endif
+
+#ifndef min
+#define min(a,b)            (((a) < (b)) ? (a) : (b))
+#endif
+
+// fseek() takes a long, which is 32-bit on Windows and 32-bit Linux
+static int FSeek64(FILE* fp, uint64_t offset, int origin)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, (__int64)offset, origin);
+#else
+	return fseeko(fp, (off_t)offset, origin);
+#endif
+}
+
+class FileTrackStorage : public TrackStorage
+{
+public:
+	FileTrackStorage()
+	{
+		m_fp = tmpfile();
+		m_size = 0;
+	}
+
+	~FileTrackStorage()
+	{
+		if (m_fp) fclose(m_fp);
+	}
+
+	bool IsValid() const { return m_fp != nullptr; }
+
+	virtual TrackStorageType Type() const { return TrackStorage_File; }
+	virtual uint64_t Size() const { return m_size; }
+
+	virtual bool Extend(uint64_t size)
+	{
+		if (size <= m_size) return true;
+		static const size_t s_zeroBlock = 65536;
+		float *zeros = new float[s_zeroBlock];
+		memset(zeros, 0, sizeof(float)*s_zeroBlock);
+		FSeek64(m_fp, 0, SEEK_END);
+		bool ok = true;
+		while (ok && m_size < size)
+		{
+			size_t count = (size_t)min((uint64_t)s_zeroBlock, size - m_size);
+			size_t written = fwrite(zeros, sizeof(float), count, m_fp);
+			m_size += written;
+			ok = written == count;
+		}
+		delete[] zeros;
+		return ok;
+	}
+
+	virtual void Read(uint64_t offset, size_t count, float* data)
+	{
+		// the file position is shared, so concurrent readers have to take turns
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t readCount = 0;
+		if (offset < m_size)
+		{
+			readCount = (size_t)min((uint64_t)count, m_size - offset);
+			FSeek64(m_fp, sizeof(float)*offset, SEEK_SET);
+			fread(data, sizeof(float), readCount, m_fp);
+		}
+		if (readCount < count)
+			memset(data + readCount, 0, sizeof(float)*(count - readCount));
+	}
+
+	virtual bool Write(uint64_t offset, size_t count, const float* data)
+	{
+		if (offset > m_size && !Extend(offset)) return false;
+		FSeek64(m_fp, sizeof(float)*offset, SEEK_SET);
+		size_t written = fwrite(data, sizeof(float), count, m_fp);
+		m_size = max(m_size, offset + (uint64_t)written);
+		return written == count;
+	}
+
+private:
+	FILE* m_fp;
+	uint64_t m_size;
+	std::mutex m_mutex;
+};
+
+class MemoryTrackStorage : public TrackStorage
+{
+public:
+	virtual TrackStorageType Type() const { return TrackStorage_Memory; }
+	virtual uint64_t Size() const { return m_data.size(); }
+
+	virtual bool Extend(uint64_t size)
+	{
+		if (size <= (uint64_t)m_data.size()) return true;
+		// keep growth geometric, so that a track written note by note is not copied over and over
+		if (size > m_data.capacity())
+			m_data.reserve(max((size_t)size, m_data.capacity() * 2));
+		m_data.resize((size_t)size, 0.0f);
+		return true;
+	}
+
+	virtual void Read(uint64_t offset, size_t count, float* data)
+	{
+		size_t readCount = 0;
+		if (offset < (uint64_t)m_data.size())
+		{
+			readCount = min(count, m_data.size() - (size_t)offset);
+			memcpy(data, m_data.data() + (size_t)offset, sizeof(float)*readCount);
+		}
+		if (readCount < count)
+			memset(data + readCount, 0, sizeof(float)*(count - readCount));
+	}
+
+	virtual bool Write(uint64_t offset, size_t count, const float* data)
+	{
+		Extend(offset + count);
+		memcpy(m_data.data() + (size_t)offset, data, sizeof(float)*count);
+		return true;
+	}
+
+	virtual bool Addressable() const { return true; }
+	virtual float* Data() { return m_data.data(); }
+
+private:
+	std::vector<float> m_data;
+};
+
+class MmapTrackStorage : public TrackStorage
+{
+public:
+	MmapTrackStorage()
+	{
+		m_size = 0;
+		m_valid = m_file.CreateTemp();
+	}
+
+	bool IsValid() const { return m_valid; }
+
+	virtual TrackStorageType Type() const { return TrackStorage_Mmap; }
+	virtual uint64_t Size() const { return m_size; }
+
+	virtual bool Extend(uint64_t size)
+	{
+		if (size <= m_size) return true;
+		uint64_t capacity = m_file.Size() / sizeof(float);
+		if (size > capacity)
+		{
+			// the file is sparse, so reserving ahead costs no disk space
+			static const uint64_t s_minCapacity = 1 << 20;
+			uint64_t newCapacity = max(s_minCapacity, max(size, capacity * 2));
+			// the whole file has to fit in the address space
+			if (newCapacity > (uint64_t)((size_t)(-1) / sizeof(float)) || !m_file.Resize((size_t)newCapacity*sizeof(float)))
+			{
+				printf("TrackStorage: failed to grow mapped file to %llu floats.\n", (unsigned long long)newCapacity);
+				return false;
+			}
+		}
+		m_size = size;
+		return true;
+	}
+
+	virtual void Read(uint64_t offset, size_t count, float* data)
+	{
+		size_t readCount = 0;
+		// Data() is nullptr if the file could not be mapped again after a failed Extend()
+		if (offset < m_size && Data() != nullptr)
+		{
+			readCount = (size_t)min((uint64_t)count, m_size - offset);
+			memcpy(data, Data() + (size_t)offset, sizeof(float)*readCount);
+		}
+		if (readCount < count)
+			memset(data + readCount, 0, sizeof(float)*(count - readCount));
+	}
+
+	virtual bool Write(uint64_t offset, size_t count, const float* data)
+	{
+		if (!Extend(offset + count) || Data() == nullptr) return false;
+		memcpy(Data() + (size_t)offset, data, sizeof(float)*count);
+		return true;
+	}
+
+	virtual bool Addressable() const { return true; }
+	virtual float* Data() { return (float*)m_file.Data(); }
+
+private:
+	MappedFile m_file;
+	bool m_valid;
+	uint64_t m_size;
+};
+
+TrackStorage* TrackStorage::Create(TrackStorageType type)
+{
+	if (type == TrackStorage_Memory)
+	{
+		return new MemoryTrackStorage;
+	}
+	else if (type == TrackStorage_Mmap)
+	{
+		MmapTrackStorage* storage = new MmapTrackStorage;
+		if (storage->IsValid()) return storage;
+		delete storage;
+		printf("TrackStorage: mmap backend not available, falling back to file.\n");
+	}
+	return new FileTrackStorage;
+}
+
+bool TrackStorage::TypeFromName(const char* name, TrackStorageType& type)
+{
+	if (strcmp(name, "file") == 0) type = TrackStorage_File;
+	else if (strcmp(name, "memory") == 0) type = TrackStorage_Memory;
+	else if (strcmp(name, "mmap") == 0) type = TrackStorage_Mmap;
+	else return false;
+	return true;
+}
@@ -0,0 +1,50 @@
+#ifndef _scoredraft_TrackStorage_h
+#define _scoredraft_TrackStorage_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum TrackStorageType
+{
+	TrackStorage_File,
+	TrackStorage_Memory,
+	TrackStorage_Mmap
+};
+
+// Backing store of a TrackBuffer.
+// All offsets and sizes are counted in floats.
+class TrackStorage
+{
+public:
+	virtual ~TrackStorage(){}
+
+	virtual TrackStorageType Type() const = 0;
+
+	virtual uint64_t Size() const = 0;
+
+	// grows the storage, new contents are zeros
+	// returns false if it cannot grow, the storage is then left as it was
+	virtual bool Extend(uint64_t size) = 0;
+
+	// reading beyond Size() gives zeros
+	// concurrent calls to Read() are safe, as long as nothing is written meanwhile
+	virtual void Read(uint64_t offset, size_t count, float* data) = 0;
+
+	// writing beyond Size() extends the storage
+	// returns false if the data could not be written
+	virtual bool Write(uint64_t offset, size_t count, const float* data) = 0;
+
+	// true if the whole content can be accessed through Data()
+	virtual bool Addressable() const { return false; }
+
+	// only valid when Addressable(), invalidated by Extend() and Write()
+	virtual float* Data() { return nullptr; }
+
+	// falls back to TrackStorage_File if the requested backend cannot be created
+	static TrackStorage* Create(TrackStorageType type);
+
+	// "file", "memory" or "mmap"
+	static bool TypeFromName(const char* name, TrackStorageType& type);
+};
+
+#endif
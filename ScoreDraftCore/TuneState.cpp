@@ -0,0 +1,31 @@
+#include "TuneState.h"
+#include <stdio.h>
+#include <string.h>
+
+bool TuneState::Tune(const char* cmd)
+{
+	char command[1024];
+	sscanf(cmd, "%s", command);
+	if (strcmp(command, "volume") == 0)
+	{
+		float value;
+		if (sscanf(cmd + 7, "%f", &value))
+		{
+			if (value < 0.0f) value = 0.0f;
+			volume = value;
+		}
+		return true;
+	}
+	else if (strcmp(command, "pan") == 0)
+	{
+		float value;
+		if (sscanf(cmd + 4, "%f", &value))
+		{
+			if (value<-1.0f) value = -1.0f;
+			else if (value>1.0f) value = 1.0f;
+			pan = value;
+		}
+		return true;
+	}
+	return false;
+}
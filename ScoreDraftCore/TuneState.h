@@ -0,0 +1,38 @@
+#ifndef _scoredraft_TuneState_h
+#define _scoredraft_TuneState_h
+
+#include <string>
+#include "Deferred.h"
+
+/*
+	Settings of the tuning commands of a subclass, see Singer::TuneExtension().
+	An extension is shared by the copies of a state and never modified once made:
+	a command makes a modified copy instead.
+*/
+class TuneStateExtension
+{
+public:
+	virtual ~TuneStateExtension() {}
+};
+
+typedef Deferred<TuneStateExtension> TuneStateExtension_Deferred;
+
+/*
+	Settings changed by the tuning commands common to instruments, percussions and singers.
+	A play call can render with its own copy, so the tuning commands inside a sequence
+	don't modify an object that other threads may be rendering with at the same time.
+*/
+struct TuneState
+{
+	float volume;
+	float pan;
+	std::string defaultLyric; // singers only
+	TuneStateExtension_Deferred extension; // singers only
+
+	TuneState() : volume(1.0f), pan(0.0f) {}
+
+	// handles "volume" and "pan", returns false for any other command
+	bool Tune(const char* cmd);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "HNMAnalysis.h"
+#include <stdint.h>
+
+// sanity limit when loading, a period is only a few hundred samples
+static const uint32_t s_maxCount = 1 << 24;
+
+size_t HNMAnalysis::Bytes() const
+{
+	size_t bytes = sizeof(HNMAnalysis);
+	for (size_t i = 0; i < size(); i++)
+	{
+		const HNMPeriod& period = (*this)[i];
+		bytes += sizeof(HNMPeriod) + (period.HarmWindow.m_data.size() + period.NoiseSpectrum.m_data.size())*sizeof(float);
+	}
+	return bytes;
+}
+
+static bool WriteFloats(FILE* fp, float halfWidth, const VoiceUtil::ScratchVector& data)
+{
+	uint32_t count = (uint32_t)data.size();
+	if (fwrite(&halfWidth, sizeof(float), 1, fp) != 1) return false;
+	if (fwrite(&count, sizeof(uint32_t), 1, fp) != 1) return false;
+	return count == 0 || fwrite(data.data(), sizeof(float), count, fp) == count;
+}
+
+static bool ReadFloats(FILE* fp, float& halfWidth, VoiceUtil::ScratchVector& data)
+{
+	uint32_t count;
+	if (fread(&halfWidth, sizeof(float), 1, fp) != 1) return false;
+	if (fread(&count, sizeof(uint32_t), 1, fp) != 1 || count > s_maxCount) return false;
+	data.resize(count);
+	return count == 0 || fread(data.data(), sizeof(float), count, fp) == count;
+}
+
+bool HNMAnalysis::Save(FILE* fp) const
+{
+	uint32_t count = (uint32_t)size();
+	if (fwrite(&count, sizeof(uint32_t), 1, fp) != 1) return false;
+	for (size_t i = 0; i < size(); i++)
+	{
+		const HNMPeriod& period = (*this)[i];
+		uint32_t srcPos = period.m_srcPos;
+		if (fwrite(&srcPos, sizeof(uint32_t), 1, fp) != 1) return false;
+		if (!WriteFloats(fp, period.HarmWindow.m_halfWidth, period.HarmWindow.m_data)) return false;
+		if (!WriteFloats(fp, period.NoiseSpectrum.m_halfWidth, period.NoiseSpectrum.m_data)) return false;
+	}
+	return true;
+}
+
+bool HNMAnalysis::Load(FILE* fp)
+{
+	uint32_t count;
+	if (fread(&count, sizeof(uint32_t), 1, fp) != 1 || count > s_maxCount) return false;
+	resize(count);
+	for (size_t i = 0; i < size(); i++)
+	{
+		HNMPeriod& period = (*this)[i];
+		uint32_t srcPos;
+		if (fread(&srcPos, sizeof(uint32_t), 1, fp) != 1) return false;
+		period.m_srcPos = srcPos;
+		if (!ReadFloats(fp, period.HarmWindow.m_halfWidth, period.HarmWindow.m_data)) return false;
+		if (!ReadFloats(fp, period.NoiseSpectrum.m_halfWidth, period.NoiseSpectrum.m_data)) return false;
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+#ifndef _HNMAnalysis_h
+#define _HNMAnalysis_h
+
+#include <vector>
+#include <stdio.h>
+#include <Deferred.h>
+#include "VoiceUtil.h"
+
+class HNMParameterSet
+{
+public:
+	VoiceUtil::SymmetricWindow HarmWindow;
+	VoiceUtil::AmpSpectrum NoiseSpectrum;
+
+	void Scale(const HNMParameterSet& src, float targetHalfWidth)
+	{
+		HarmWindow.Repitch_FormantPreserved(src.HarmWindow, targetHalfWidth);
+		NoiseSpectrum.Scale(src.NoiseSpectrum, targetHalfWidth);
+	}
+
+	void Interpolate(const HNMParameterSet& param0, const HNMParameterSet& param1, float k)
+	{
+		HarmWindow.Interpolate(param0.HarmWindow, param1.HarmWindow, k, param0.HarmWindow.m_halfWidth);
+		NoiseSpectrum.Interpolate(param0.NoiseSpectrum, param1.NoiseSpectrum, k, param0.NoiseSpectrum.m_halfWidth);
+	}
+};
+
+// analysis of the period starting at m_srcPos of the source
+class HNMPeriod : public HNMParameterSet
+{
+public:
+	unsigned m_srcPos;
+};
+
+/*
+	Period-by-period HNM analysis of a source.
+	It only depends on the oto entry and the part of the source analyzed, not on the
+	pitch or duration sung, so it can be reused across notes, and stored in a .hnm file.
+*/
+class HNMAnalysis : public std::vector<HNMPeriod>
+{
+public:
+	size_t Bytes() const;
+
+	// binary format, versioned by the caller
+	bool Save(FILE* fp) const;
+	bool Load(FILE* fp);
+};
+
+typedef Deferred<HNMAnalysis> HNMAnalysis_deferred;
+
+#endif
@@ -0,0 +1,737 @@
+#include "LyricConverter.h"
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <list>
+
+struct StringRule
+{
+	const char* from;
+	const char* to;
+};
+
+/*
+	Japanese VCV: the vowel of each kana of the 単独音 lyrics, from JPVCVConverter.py,
+	written as escapes so the source doesn't depend on the charset of the compiler
+*/
+static const StringRule s_kanaVowels[] =
+{
+	{ u8"\u3042", "a" }, { u8"\u3044", "i" }, { u8"\u3046", "u" }, { u8"\u3048", "e" }, { u8"\u304a", "o" },
+	{ u8"\u304b", "a" }, { u8"\u304d", "i" }, { u8"\u304f", "u" }, { u8"\u3051", "e" }, { u8"\u3053", "o" },
+	{ u8"\u304c", "a" }, { u8"\u304e", "i" }, { u8"\u3050", "u" }, { u8"\u3052", "e" }, { u8"\u3054", "o" },
+	{ u8"\u3055", "a" }, { u8"\u3057", "i" }, { u8"\u3059", "u" }, { u8"\u305b", "e" }, { u8"\u305d", "o" },
+	{ u8"\u3056", "a" }, { u8"\u3058", "i" }, { u8"\u305a", "u" }, { u8"\u305c", "e" }, { u8"\u305e", "o" },
+	{ u8"\u305f", "a" }, { u8"\u3061", "i" }, { u8"\u3064", "u" }, { u8"\u3066", "e" }, { u8"\u3068", "o" },
+	{ u8"\u3060", "a" }, { u8"\u3062", "i" }, { u8"\u3065", "u" }, { u8"\u3067", "e" }, { u8"\u3069", "o" },
+	{ u8"\u306a", "a" }, { u8"\u306b", "i" }, { u8"\u306c", "u" }, { u8"\u306d", "e" }, { u8"\u306e", "o" },
+	{ u8"\u306f", "a" }, { u8"\u3072", "i" }, { u8"\u3075", "u" }, { u8"\u3078", "e" }, { u8"\u307b", "o" },
+	{ u8"\u3070", "a" }, { u8"\u3073", "i" }, { u8"\u3076", "u" }, { u8"\u3079", "e" }, { u8"\u307c", "o" },
+	{ u8"\u3071", "a" }, { u8"\u3074", "i" }, { u8"\u3077", "u" }, { u8"\u307a", "e" }, { u8"\u307d", "o" },
+	{ u8"\u307e", "a" }, { u8"\u307f", "i" }, { u8"\u3080", "u" }, { u8"\u3081", "e" }, { u8"\u3082", "o" },
+	{ u8"\u3084", "a" }, { u8"\u3086", "u" }, { u8"\u3088", "o" },
+	{ u8"\u3089", "a" }, { u8"\u308a", "i" }, { u8"\u308b", "u" }, { u8"\u308c", "e" }, { u8"\u308d", "o" },
+	{ u8"\u308f", "a" },
+	{ u8"\u304d\u3083", "a" }, { u8"\u304e\u3083", "a" }, { u8"\u3057\u3083", "a" }, { u8"\u3058\u3083", "a" },
+	{ u8"\u3061\u3083", "a" }, { u8"\u306b\u3083", "a" }, { u8"\u3072\u3083", "a" }, { u8"\u3073\u3083", "a" },
+	{ u8"\u3074\u3083", "a" }, { u8"\u307f\u3083", "a" }, { u8"\u308a\u3083", "a" },
+	{ u8"\u3046\u3043", "i" }, { u8"\u3059\u3043", "i" }, { u8"\u305a\u3043", "i" }, { u8"\u3064\u3043", "i" },
+	{ u8"\u3066\u3043", "i" }, { u8"\u3067\u3043", "i" }, { u8"\u3075\u3043", "i" },
+	{ u8"\u3068\u3045", "u" }, { u8"\u3069\u3045", "u" },
+	{ u8"\u304d\u3085", "u" }, { u8"\u304e\u3085", "u" }, { u8"\u3057\u3085", "u" }, { u8"\u3058\u3085", "u" },
+	{ u8"\u3061\u3085", "u" }, { u8"\u3066\u3085", "u" }, { u8"\u3067\u3085", "u" }, { u8"\u306b\u3085", "u" },
+	{ u8"\u3072\u3085", "u" }, { u8"\u3073\u3085", "u" }, { u8"\u3074\u3085", "u" }, { u8"\u307f\u3085", "u" },
+	{ u8"\u308a\u3085", "u" },
+	{ u8"\u3044\u3047", "e" }, { u8"\u3046\u3047", "e" }, { u8"\u304d\u3047", "e" }, { u8"\u304e\u3047", "e" },
+	{ u8"\u3057\u3047", "e" }, { u8"\u3058\u3047", "e" }, { u8"\u3061\u3047", "e" }, { u8"\u3064\u3047", "e" },
+	{ u8"\u306b\u3047", "e" }, { u8"\u3072\u3047", "e" }, { u8"\u3073\u3047", "e" }, { u8"\u3074\u3047", "e" },
+	{ u8"\u3075\u3047", "e" }, { u8"\u307f\u3047", "e" }, { u8"\u308a\u3047", "e" },
+	{ u8"\u3046\u3049", "o" }, { u8"\u3064\u3049", "o" }, { u8"\u3075\u3049", "o" }, { u8"\u304d\u3087", "o" },
+	{ u8"\u304e\u3087", "o" }, { u8"\u3057\u3087", "o" }, { u8"\u3058\u3087", "o" }, { u8"\u3061\u3087", "o" },
+	{ u8"\u306b\u3087", "o" }, { u8"\u3072\u3087", "o" }, { u8"\u3073\u3087", "o" }, { u8"\u3074\u3087", "o" },
+	{ u8"\u307f\u3087", "o" }, { u8"\u308a\u3087", "o" },
+	{ u8"\u3092", "o" }, { u8"\u3093", "n" },
+	{ nullptr, nullptr }
+};
+
+/*
+	Splitting a PinYin syllable into its consonant and vowel, as getCV()/getVowel() of the scripts:
+	the consonant is what comes before the first of "aeiouv", then
+	- "syllableVowels" give the vowels of irregular syllables, all tested in order
+	- "vowelRemaps" rename the vowels, all tested in order on the renamed vowel
+	- "consonantRules" rename the consonant, the first match is used
+*/
+struct ConsonantRule
+{
+	const char* consonant;
+	const char* vowel;
+	bool vowelPrefix; // "vowel" only needs to start the vowel
+	const char* result;
+};
+
+struct PinyinTable
+{
+	const StringRule* syllableVowels;
+	const StringRule* vowelRemaps;
+	const ConsonantRule* consonantRules;
+};
+
+static const StringRule s_tsuroSyllables[] =
+{
+	{ "zhi", "ir" }, { "chi", "ir" }, { "shi", "ir" }, { "ri", "ir" },
+	{ "zi", "iz" }, { "ci", "iz" }, { "si", "iz" },
+	{ "ju", "v" }, { "qu", "v" }, { "xu", "v" }, { "yu", "v" },
+	{ "ye", "ie" },
+	{ nullptr, nullptr }
+};
+
+static const StringRule s_tsuroVowels[] =
+{
+	{ "ia", "a" }, { "iao", "ao" }, { "ian", "an" }, { "iang", "ang" }, { "iong", "ong" }, { "iu", "ou" },
+	{ "ua", "a" }, { "uai", "ai" }, { "uan", "an" }, { "ui", "ei" }, { "uang", "ang" }, { "un", "en" }, { "uo", "o" },
+	{ nullptr, nullptr }
+};
+
+static const ConsonantRule s_noConsonantRules[] =
+{
+	{ nullptr, nullptr, false, nullptr }
+};
+
+static const PinyinTable s_tsuroTable = { s_tsuroSyllables, s_tsuroVowels, s_noConsonantRules };
+
+static const StringRule s_cvvcSyllables[] =
+{
+	{ "zhi", "ir" }, { "chi", "ir" }, { "shi", "ir" }, { "ri", "ir" },
+	{ "zi", "i0" }, { "ci", "i0" }, { "si", "i0" },
+	{ "ju", "v" }, { "qu", "v" }, { "xu", "v" }, { "yu", "v" },
+	{ "ye", "e0" },
+	{ nullptr, nullptr }
+};
+
+static const StringRule s_cvvcVowels[] =
+{
+	{ "ia", "a" }, { "iao", "ao" }, { "ian", "an" }, { "iang", "ang" }, { "ie", "e0" }, { "iong", "ong" }, { "iu", "ou" },
+	{ "ua", "a" }, { "uai", "ai" }, { "uan", "an" }, { "ui", "ei" }, { "uang", "ang" }, { "un", "en" }, { "uo", "o" },
+	{ "ue", "e0" },
+	{ nullptr, nullptr }
+};
+
+static const ConsonantRule s_cvvcConsonants[] =
+{
+	{ "j", "u", true, "jw" }, { "j", "", true, "jy" },
+	{ "q", "u", true, "qw" }, { "q", "", true, "qy" },
+	{ "x", "u", true, "xw" }, { "x", "", true, "xy" },
+	{ "y", "u", true, "v" },
+	{ nullptr, nullptr, false, nullptr }
+};
+
+static const PinyinTable s_cvvcTable = { s_cvvcSyllables, s_cvvcVowels, s_cvvcConsonants };
+
+static const StringRule s_xiayySyllables[] =
+{
+	{ "zhi", "h-i" }, { "chi", "h-i" }, { "shi", "h-i" }, { "ri", "h-i" },
+	{ "zi", "-i" }, { "ci", "-i" }, { "si", "-i" },
+	{ "ju", "v" }, { "qu", "v" }, { "xu", "v" }, { "yu", "v" },
+	{ "ye", "eh" },
+	{ nullptr, nullptr }
+};
+
+static const StringRule s_xiayyVowels[] =
+{
+	{ "ia", "ya" }, { "iao", "yao" }, { "ian", "yan" }, { "iang", "yang" }, { "ie", "eh" }, { "in", "en" }, { "ing", "eng" },
+	{ "ong", "weng" }, { "iong", "weng" }, { "iu", "you" },
+	{ "ua", "wa" }, { "uai", "wai" }, { "uan", "wan" }, { "ui", "wei" }, { "uang", "wang" }, { "un", "wen" }, { "uo", "wo" },
+	{ "ue", "ueh" },
+	{ "i", "y" }, { "u", "w" }, { "v", "yu" },
+	{ nullptr, nullptr }
+};
+
+static const ConsonantRule s_xiayyConsonants[] =
+{
+	{ "", "a", false, "ah" }, { "", "er", false, "ah" }, { "", "u", false, "w" }, { "", "y", false, "y" },
+	{ nullptr, nullptr, false, nullptr }
+};
+
+static const PinyinTable s_xiayyTable = { s_xiayySyllables, s_xiayyVowels, s_xiayyConsonants };
+
+static void SplitPinyin(const PinyinTable& table, const std::string& lyric, std::string& consonant, std::string& vowel)
+{
+	size_t split = lyric.find_first_of("aeiouv");
+	if (split == std::string::npos) split = lyric.length();
+	consonant = lyric.substr(0, split);
+	vowel = lyric.substr(split);
+
+	for (const StringRule* rule = table.syllableVowels; rule->from != nullptr; rule++)
+		if (lyric == rule->from) vowel = rule->to;
+
+	for (const StringRule* rule = table.vowelRemaps; rule->from != nullptr; rule++)
+		if (vowel == rule->from) vowel = rule->to;
+
+	for (const ConsonantRule* rule = table.consonantRules; rule->consonant != nullptr; rule++)
+	{
+		if (consonant != rule->consonant) continue;
+		bool match = rule->vowelPrefix ? vowel.compare(0, strlen(rule->vowel), rule->vowel) == 0 : vowel == rule->vowel;
+		if (match)
+		{
+			consonant = rule->result;
+			break;
+		}
+	}
+}
+
+// VCV: each lyric is preceded by the vowel of the previous syllable, or by "-" at the start of a sentence
+class VCVConverter : public LyricConverter
+{
+public:
+	virtual void Convert(const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& out) const
+	{
+		out.resize(lyrics.size());
+		for (size_t i = 0; i < lyrics.size(); i++)
+		{
+			std::string prev = i > 0 ? _vowel(lyrics[i - 1]) : std::string("-");
+			ConvertedLyric converted = { prev + " " + lyrics[i], 1.0f, true };
+			out[i].assign(1, converted);
+		}
+	}
+
+protected:
+	virtual std::string _vowel(const std::string& lyric) const = 0;
+};
+
+class JPVCVConverter : public VCVConverter
+{
+public:
+	JPVCVConverter(const StringRule* kanaVowels, const Encoder& encode)
+	{
+		for (const StringRule* rule = kanaVowels; rule->from != nullptr; rule++)
+			m_vowels[encode(rule->from)] = rule->to;
+	}
+
+protected:
+	virtual std::string _vowel(const std::string& lyric) const
+	{
+		// the script fails on unknown lyrics, here the next syllable starts like a new sentence
+		std::map<std::string, std::string>::const_iterator iter = m_vowels.find(lyric);
+		return iter != m_vowels.end() ? iter->second : std::string("-");
+	}
+
+private:
+	std::map<std::string, std::string> m_vowels;
+};
+
+class PinyinVCVConverter : public VCVConverter
+{
+public:
+	PinyinVCVConverter(const PinyinTable& table) : m_table(table) {}
+
+protected:
+	virtual std::string _vowel(const std::string& lyric) const
+	{
+		std::string consonant, vowel;
+		SplitPinyin(m_table, lyric, consonant, vowel);
+		return vowel;
+	}
+
+private:
+	const PinyinTable& m_table;
+};
+
+/*
+	CVVC: a syllable starting with a vowel is preceded by the vowel of the previous syllable,
+	and the last 1/8 of each syllable goes to the transition from its vowel to the consonant
+	of the next syllable.
+	"endings" give the consonant of the transition closing the sentence, after some vowels.
+	No transition is inserted between 2 "glides".
+*/
+class PinyinCVVCConverter : public LyricConverter
+{
+public:
+	PinyinCVVCConverter(const PinyinTable& table, const StringRule* endings, const char* const* glides)
+		: m_table(table), m_endings(endings), m_glides(glides) {}
+
+	virtual void Convert(const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& out) const
+	{
+		size_t count = lyrics.size();
+		std::vector<std::string> consonants(count);
+		std::vector<std::string> vowels(count);
+		for (size_t i = 0; i < count; i++)
+			SplitPinyin(m_table, lyrics[i], consonants[i], vowels[i]);
+
+		out.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			std::string lyric = lyrics[i];
+			if (i == 0)
+				lyric = "- " + lyric;
+			else if (consonants[i] == "")
+				lyric = vowels[i - 1] + " " + lyric;
+
+			std::string next;
+			if (i + 1 < count)
+			{
+				if (consonants[i + 1] != "" && !(_isGlide(vowels[i]) && _isGlide(consonants[i + 1])))
+					next = consonants[i + 1];
+			}
+			else
+			{
+				for (const StringRule* rule = m_endings; rule->from != nullptr; rule++)
+				{
+					if (vowels[i] == rule->from)
+					{
+						next = rule->to;
+						break;
+					}
+				}
+			}
+
+			ConvertedSyllable& syllable = out[i];
+			syllable.clear();
+			if (next == "")
+			{
+				ConvertedLyric cv = { lyric, 1.0f, true };
+				syllable.push_back(cv);
+			}
+			else
+			{
+				ConvertedLyric cv = { lyric, 0.875f, true };
+				ConvertedLyric vc = { vowels[i] + " " + next, 0.125f, false };
+				syllable.push_back(cv);
+				syllable.push_back(vc);
+			}
+		}
+	}
+
+private:
+	bool _isGlide(const std::string& s) const
+	{
+		for (const char* const* glide = m_glides; *glide != nullptr; glide++)
+			if (s == *glide) return true;
+		return false;
+	}
+
+	const PinyinTable& m_table;
+	const StringRule* m_endings;
+	const char* const* m_glides;
+};
+
+static const StringRule s_cvvcEndings[] =
+{
+	{ "ai", "y" }, { "ei", "y" }, { "ou", "w" },
+	{ nullptr, nullptr }
+};
+
+static const StringRule s_noEndings[] =
+{
+	{ nullptr, nullptr }
+};
+
+static const char* const s_noGlides[] = { nullptr };
+static const char* const s_xiayyGlides[] = { "w", "y", nullptr };
+
+/*
+	English: the phonetic symbols of the whole sentence are re-segmented greedily into
+	the longest lyrics found in the voice-bank, each lyric going to the syllable of the
+	last vowel it covers. Port of TTEnglishConverter.py/VCCVEnglishConverter.py.
+*/
+class EnglishConverter : public LyricConverter
+{
+public:
+	EnglishConverter(const char* const* vowels, const char* const* atoms, const std::vector<std::string>& bankLyrics)
+	{
+		for (size_t i = 0; i < bankLyrics.size(); i++)
+		{
+			const std::string& lyric = bankLyrics[i];
+			m_lyrics.insert(lyric);
+			for (size_t j = 0; j < lyric.length(); j++)
+				if (lyric[j] != ' ') m_lyricPrefixes.insert(lyric.substr(0, j + 1));
+		}
+
+		for (const char* const* vowel = vowels; *vowel != nullptr; vowel++)
+		{
+			std::string v = *vowel;
+			for (size_t j = 0; j < v.length(); j++)
+				m_vowelPrefixes.insert(v.substr(0, j + 1));
+		}
+
+		for (const char* const* atom = atoms; *atom != nullptr; atom++)
+			m_atoms.insert(*atom);
+	}
+
+	virtual void Convert(const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& out) const
+	{
+		typedef std::vector<std::string> Atoms;
+		int count = (int)lyrics.size();
+
+		// symbols of each syllable, multi-character ones kept together
+		std::vector<Atoms> in(count);
+		for (int k = 0; k < count; k++)
+		{
+			const std::string& lyric = lyrics[k];
+			size_t i = 0;
+			while (i < lyric.length())
+			{
+				std::string atom;
+				while (i < lyric.length() && (atom == "" || m_atoms.count(atom + lyric[i]) > 0))
+				{
+					atom += lyric[i];
+					i++;
+				}
+				in[k].push_back(atom);
+			}
+		}
+
+		// range of the vowel symbols in each syllable, -1 when there's none
+		std::vector<int> vowelStart(count), vowelEnd(count);
+		for (int k = 0; k < count; k++)
+		{
+			const Atoms& atoms = in[k];
+			int start = -1;
+			int end = -1;
+			for (int i = 0; i < (int)atoms.size(); i++)
+			{
+				if (start == -1 && m_vowelPrefixes.count(atoms[i]) > 0)
+					start = i;
+				if (start != -1 && m_vowelPrefixes.count(_join(atoms, start, i + 1)) > 0)
+					end = i + 1;
+			}
+			vowelStart[k] = start;
+			vowelEnd[k] = end;
+		}
+
+		struct Segment
+		{
+			std::string lyric;
+			int syllable;
+			bool isVowel;
+		};
+		std::vector<Segment> segments;
+
+		Pos cur = { 0, 0 };
+		std::string prefix = "-";
+		int iIn = 0;
+
+		while (_valid(in, cur))
+		{
+			// pass 1, drops the leading symbols of the prefix until it can be followed by the current symbol
+			while (prefix.length() > 0)
+			{
+				const std::string& atom = in[cur.syllable][cur.atom];
+				if (prefix == "-" || cur.atom > 0 || vowelStart[cur.syllable] == 0)
+				{
+					if (m_lyricPrefixes.count(prefix + atom) > 0) break;
+				}
+				if (m_lyricPrefixes.count(prefix + " " + atom) > 0) break;
+				prefix = prefix.substr(1);
+			}
+
+			// pass 2, the longest lyric starting with the prefix
+			Pos nextStart = cur;
+			std::string seg;
+			bool isVowel = false;
+
+			while (true)
+			{
+				seg = "";
+				std::string lastSeg = prefix;
+				Pos cur2 = cur;
+				isVowel = false;
+
+				while (true)
+				{
+					bool spaceMust = false;
+					std::string newChar;
+					if (!_valid(in, cur2))
+					{
+						newChar = "-";
+					}
+					else
+					{
+						newChar = in[cur2.syllable][cur2.atom];
+						if (lastSeg != "" && lastSeg != "-" && cur2.atom == 0 && vowelStart[cur2.syllable] > 0)
+							spaceMust = true;
+					}
+
+					std::string testSeg = lastSeg + newChar;
+					if (spaceMust || m_lyricPrefixes.count(testSeg) == 0)
+					{
+						testSeg = lastSeg + " " + newChar;
+						if (m_lyricPrefixes.count(testSeg) == 0) break;
+					}
+
+					lastSeg = testSeg;
+
+					if (m_lyrics.count(testSeg) > 0)
+					{
+						cur = cur2;
+						seg = testSeg;
+						if (cur.syllable < count && cur.atom >= vowelStart[cur.syllable] && cur.atom < vowelEnd[cur.syllable])
+						{
+							isVowel = true;
+							iIn = cur.syllable;
+						}
+					}
+
+					if (!_valid(in, cur2)) break;
+
+					cur2.atom++;
+					if (cur2.atom >= (int)in[cur2.syllable].size())
+					{
+						cur2.syllable++;
+						cur2.atom = 0;
+						if (seg != "") break;
+					}
+				}
+
+				if (seg.length() > 0 || prefix.length() == 0) break;
+				prefix = prefix.substr(1);
+			}
+
+			Segment segment = { seg, iIn, isVowel };
+			segments.push_back(segment);
+
+			if (!_valid(in, cur)) break;
+
+			cur.atom++;
+			if (cur.atom >= (int)in[cur.syllable].size())
+			{
+				cur.syllable++;
+				cur.atom = 0;
+			}
+
+			// the symbols consumed since the start of this lyric begin the next one
+			Pos pos = nextStart;
+			prefix = "";
+			while (pos.syllable < cur.syllable || (pos.syllable == cur.syllable && pos.atom < cur.atom))
+			{
+				if (pos.atom < (int)in[pos.syllable].size())
+					prefix += in[pos.syllable][pos.atom];
+				pos.atom++;
+				if (pos.atom >= (int)in[pos.syllable].size())
+				{
+					pos.syllable++;
+					pos.atom = 0;
+				}
+			}
+		}
+
+		// grouped by syllable like the scripts, which assume every syllable got a vowel
+		out.clear();
+		ConvertedSyllable syllable;
+		int iSyllable = 0;
+		for (size_t i = 0; i < segments.size(); i++)
+		{
+			const Segment& segment = segments[i];
+			if (segment.syllable != iSyllable)
+			{
+				out.push_back(syllable);
+				syllable.clear();
+				iSyllable = segment.syllable;
+			}
+			ConvertedLyric converted = { segment.lyric, segment.isVowel ? 0.4f : 0.1f, segment.isVowel };
+			syllable.push_back(converted);
+		}
+		out.push_back(syllable);
+		out.resize(lyrics.size());
+	}
+
+private:
+	struct Pos
+	{
+		int syllable;
+		int atom;
+	};
+
+	static bool _valid(const std::vector<std::vector<std::string> >& in, const Pos& pos)
+	{
+		return pos.syllable < (int)in.size() && pos.atom < (int)in[pos.syllable].size();
+	}
+
+	static std::string _join(const std::vector<std::string>& atoms, int begin, int end)
+	{
+		std::string ret;
+		for (int i = begin; i < end; i++) ret += atoms[i];
+		return ret;
+	}
+
+	std::set<std::string> m_lyrics;
+	std::set<std::string> m_lyricPrefixes;
+	std::set<std::string> m_vowelPrefixes;
+	std::set<std::string> m_atoms;
+};
+
+static const char* const s_ttVowels[] = { "eI", "aI", "aU", "OI", "oU", "3", "i", "I", "U", "u", "E", "{", "A", "V", "O", "@", nullptr };
+static const char* const s_ttAtoms[] = { "tS", "dZ", nullptr };
+
+static const char* const s_vccvVowels[] = { "a", "e", "i", "o", "u", "E", "9", "3", "@", "A", "I", "O", "8", "Q", "6", "x", "&", "1", "0", nullptr };
+static const char* const s_vccvAtoms[] = { "ch", "dh", "sh", "th", "zh", "ng", "Ang", nullptr };
+
+LyricConverter* LyricConverter::Create(const char* name, const std::vector<std::string>& bankLyrics, const Encoder& encode)
+{
+	if (strcmp(name, "jp_vcv") == 0)
+		return new JPVCVConverter(s_kanaVowels, encode);
+	if (strcmp(name, "tsuro_vcv") == 0)
+		return new PinyinVCVConverter(s_tsuroTable);
+	if (strcmp(name, "cvvc_chinese") == 0)
+		return new PinyinCVVCConverter(s_cvvcTable, s_cvvcEndings, s_noGlides);
+	if (strcmp(name, "xiayy") == 0)
+		return new PinyinCVVCConverter(s_xiayyTable, s_noEndings, s_xiayyGlides);
+	if (strcmp(name, "tt_english") == 0)
+		return new EnglishConverter(s_ttVowels, s_ttAtoms, bankLyrics);
+	if (strcmp(name, "vccv_english") == 0)
+		return new EnglishConverter(s_vccvVowels, s_vccvAtoms, bankLyrics);
+	return Load(name, bankLyrics, encode);
+}
+
+/*
+	Tables read from a rule-table file, in the layout of the compiled-in ones.
+	The strings are kept in a list, so the rules can point to them.
+*/
+class RuleTableFile
+{
+public:
+	std::string m_type;
+	std::vector<StringRule> m_syllables;
+	std::vector<StringRule> m_vowels;
+	std::vector<ConsonantRule> m_consonants;
+	std::vector<StringRule> m_endings;
+	std::vector<const char*> m_glides;
+	std::vector<const char*> m_vowelSymbols;
+	std::vector<const char*> m_atoms;
+	PinyinTable m_table;
+
+	bool Load(const char* filename)
+	{
+		FILE* fp = fopen(filename, "r");
+		if (!fp) return false;
+
+		bool ok = true;
+		std::string section;
+		char line[1024];
+		for (unsigned lineNum = 1; ok && fgets(line, 1024, fp); lineNum++)
+		{
+			std::vector<std::string> tokens;
+			_tokenize(line, tokens);
+			if (tokens.size() == 0) continue;
+
+			size_t count = tokens.size();
+			const std::string& first = tokens[0];
+			if (first[0] == '[' && first[first.length() - 1] == ']' && count == 1)
+				section = first.substr(1, first.length() - 2);
+			else if (section == "" && first == "type" && count == 2)
+				m_type = tokens[1];
+			else if ((section == "syllables" || section == "vowels" || section == "endings") && count == 2)
+			{
+				StringRule rule = { _str(tokens[0]), _str(tokens[1]) };
+				(section == "syllables" ? m_syllables : section == "vowels" ? m_vowels : m_endings).push_back(rule);
+			}
+			else if (section == "consonants" && count == 3)
+			{
+				// a vowel ending with "*" only needs to start the vowel
+				std::string vowel = tokens[1];
+				bool prefix = vowel.length() > 0 && vowel[vowel.length() - 1] == '*';
+				if (prefix) vowel.resize(vowel.length() - 1);
+				ConsonantRule rule = { _str(tokens[0]), _str(vowel), prefix, _str(tokens[2]) };
+				m_consonants.push_back(rule);
+			}
+			else if ((section == "glides" || section == "vowel_symbols" || section == "atoms") && count == 1)
+				(section == "glides" ? m_glides : section == "vowel_symbols" ? m_vowelSymbols : m_atoms).push_back(_str(tokens[0]));
+			else
+			{
+				printf("%s, line %u: invalid rule\n", filename, lineNum);
+				ok = false;
+			}
+		}
+		fclose(fp);
+		if (!ok) return false;
+
+		StringRule endRule = { nullptr, nullptr };
+		m_syllables.push_back(endRule);
+		m_vowels.push_back(endRule);
+		m_endings.push_back(endRule);
+		ConsonantRule endConsonantRule = { nullptr, nullptr, false, nullptr };
+		m_consonants.push_back(endConsonantRule);
+		m_glides.push_back(nullptr);
+		m_vowelSymbols.push_back(nullptr);
+		m_atoms.push_back(nullptr);
+
+		m_table.syllableVowels = m_syllables.data();
+		m_table.vowelRemaps = m_vowels.data();
+		m_table.consonantRules = m_consonants.data();
+		return true;
+	}
+
+private:
+	// split at white spaces, '#' starts a comment and "" is an empty string
+	static void _tokenize(const char* line, std::vector<std::string>& tokens)
+	{
+		std::string token;
+		bool inToken = false;
+		for (const char* p = line; *p != 0 && *p != '#'; p++)
+		{
+			if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			{
+				if (inToken) tokens.push_back(token == "\"\"" ? std::string() : token);
+				token = "";
+				inToken = false;
+			}
+			else
+			{
+				token += *p;
+				inToken = true;
+			}
+		}
+		if (inToken) tokens.push_back(token == "\"\"" ? std::string() : token);
+	}
+
+	const char* _str(const std::string& s)
+	{
+		m_strings.push_back(s);
+		return m_strings.back().data();
+	}
+
+	std::list<std::string> m_strings;
+};
+
+// a converter built on the tables of a file, which it keeps alive
+class FileLyricConverter : public LyricConverter
+{
+public:
+	FileLyricConverter() : m_converter(nullptr) {}
+	virtual ~FileLyricConverter()
+	{
+		delete m_converter;
+	}
+
+	virtual void Convert(const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& out) const
+	{
+		m_converter->Convert(lyrics, out);
+	}
+
+	RuleTableFile m_tables;
+	LyricConverter* m_converter;
+};
+
+LyricConverter* LyricConverter::Load(const char* filename, const std::vector<std::string>& bankLyrics, const Encoder& encode)
+{
+	FileLyricConverter* converter = new FileLyricConverter;
+	RuleTableFile& tables = converter->m_tables;
+	if (tables.Load(filename))
+	{
+		if (tables.m_type == "vcv_kana")
+			converter->m_converter = new JPVCVConverter(tables.m_vowels.data(), encode);
+		else if (tables.m_type == "vcv_pinyin")
+			converter->m_converter = new PinyinVCVConverter(tables.m_table);
+		else if (tables.m_type == "cvvc_pinyin")
+			converter->m_converter = new PinyinCVVCConverter(tables.m_table, tables.m_endings.data(), tables.m_glides.data());
+		else if (tables.m_type == "english")
+			converter->m_converter = new EnglishConverter(tables.m_vowelSymbols.data(), tables.m_atoms.data(), bankLyrics);
+		else
+			printf("%s: unknown converter type \"%s\"\n", filename, tables.m_type.data());
+	}
+	if (converter->m_converter == nullptr)
+	{
+		delete converter;
+		return nullptr;
+	}
+	return converter;
+}
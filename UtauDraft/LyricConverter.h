@@ -0,0 +1,60 @@
+#ifndef _LyricConverter_h
+#define _LyricConverter_h
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct ConvertedLyric
+{
+	std::string lyric;
+	float weight;	// ratio taken within the syllable, relative to the other lyrics of the syllable
+	bool isVowel;
+};
+
+typedef std::vector<ConvertedLyric> ConvertedSyllable;
+
+/*
+	Native versions of the lyric converters shipped as Python scripts, driven by the same
+	rule tables. They give the same lyrics as the scripts and run without the GIL, so the
+	sentences can be converted concurrently.
+*/
+class LyricConverter
+{
+public:
+	virtual ~LyricConverter() {}
+
+	// "out" receives one syllable for each of "lyrics", an empty syllable keeps the input lyric
+	virtual void Convert(const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& out) const = 0;
+
+	// converts a UTF-8 string of the tables to the charset of the lyrics
+	typedef std::function<std::string(const char*)> Encoder;
+
+	/*
+		"name" is one of "jp_vcv", "tsuro_vcv", "cvvc_chinese", "xiayy", "tt_english" and "vccv_english",
+		any other name is loaded as a rule-table file.
+		The English converters segment the lyrics using "bankLyrics", all the lyrics of the voice-bank,
+		where the scripts use a set dumped from a specific oto.ini.
+		Returns nullptr for an unknown name that isn't a valid rule-table file either.
+	*/
+	static LyricConverter* Create(const char* name, const std::vector<std::string>& bankLyrics, const Encoder& encode);
+
+	/*
+		Rule-table file, one rule per line, '#' starts a comment and "" is an empty string:
+
+		type <vcv_kana|vcv_pinyin|cvvc_pinyin|english>
+		[syllables]      <syllable> <vowel>             # PinYin, vowels of irregular syllables
+		[vowels]         <vowel> <renamed vowel>        # PinYin vowel remaps, or kana and their vowels (vcv_kana)
+		[consonants]     <consonant> <vowel> <renamed>  # PinYin, a vowel ending with '*' only starts the vowel
+		[endings]        <vowel> <consonant>            # cvvc_pinyin, transition closing a sentence
+		[glides]         <symbol>                       # cvvc_pinyin, no transition between 2 of them
+		[vowel_symbols]  <symbol>                       # english
+		[atoms]          <symbol>                       # english, multi-character consonants
+
+		The rules work as those of the built-in converters of the same type, strings are UTF-8.
+		Returns nullptr if the file can't be read, or if it is invalid after printing the error.
+	*/
+	static LyricConverter* Load(const char* filename, const std::vector<std::string>& bankLyrics, const Encoder& encode);
+};
+
+#endif
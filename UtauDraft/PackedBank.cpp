@@ -0,0 +1,263 @@
+#include "PackedBank.h"
+#include "UtauDraft.h"
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <FileStamp.h>
+
+static const char s_magic[4] = { 'S', 'D', 'V', 'B' };
+static const uint32_t s_version = 1;
+
+struct PackedBank::Header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t hashSize; // power of 2, slots hold entry index + 1, 0 for empty
+	uint64_t entriesOffset;
+	uint64_t hashOffset;
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+	uint64_t fileSize;
+};
+
+static uint32_t HashLyric(const char* lyric)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (const char* p = lyric; *p != 0; p++)
+	{
+		hash ^= (unsigned char)*p;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// writes data at the end of fp, 8-byte aligned, returns its offset
+// pos tracks the size of the file, ftell() is 32-bit on some platforms
+static bool WriteAligned(FILE* fp, uint64_t& pos, const void* data, size_t size, uint64_t& offset)
+{
+	static const char s_zeros[8] = { 0 };
+	size_t pad = (size_t)((8 - pos % 8) % 8);
+	if (pad > 0 && fwrite(s_zeros, 1, pad, fp) != pad) return false;
+	offset = pos + pad;
+	pos = offset + size;
+	return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+bool PackedBank::Build(const OtoMap& otoMap, const char* bankPath, const char* filename)
+{
+	std::string tmpFilename = std::string(filename) + ".tmp";
+	FILE* fp = fopen(tmpFilename.data(), "wb");
+	if (!fp)
+	{
+		printf("Failed to create %s\n", tmpFilename.data());
+		return false;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof(Header));
+	bool ok = fwrite(&header, sizeof(Header), 1, fp) == 1;
+	uint64_t pos = sizeof(Header);
+
+	// decoded files are shared by the entries that cut from the same wav
+	UtauSourceCache cache;
+	std::vector<PackedBankEntry> entries;
+	std::string strings(1, '\0');
+	std::string prefix = std::string(bankPath) + "/";
+
+	OtoMap::const_iterator iter;
+	for (iter = otoMap.begin(); ok && iter != otoMap.end(); iter++)
+	{
+		const VoiceLocation& loc = iter->second;
+
+		std::string frq_path = loc.filename.substr(0, loc.filename.length() - 4) + "_wav.frq";
+		FrqData_deferred frq;
+		if (!cache.GetFrq(frq_path, frq))
+		{
+			printf("%s not found, %s skipped.\n", frq_path.data(), iter->first.data());
+			continue;
+		}
+		Buffer_deferred whole;
+		if (!cache.GetWav(loc.filename, whole))
+		{
+			printf("%s not found, %s skipped.\n", loc.filename.data(), iter->first.data());
+			continue;
+		}
+
+		PackedBankEntry entry;
+		memset(&entry, 0, sizeof(PackedBankEntry));
+
+		Buffer source;
+		UtauSourceFetcher::CutWavLoc(*whole, loc, source, entry.srcbegin, entry.srcend);
+		entry.numSamples = (uint32_t)source.m_data.size();
+		entry.sampleRate = source.m_sampleRate;
+		ok = WriteAligned(fp, pos, source.m_data.data(), source.m_data.size()*sizeof(float), entry.samplesOffset);
+
+		entry.numFrqPoints = (uint32_t)frq->size();
+		entry.frqWindowInterval = frq->m_window_interval;
+		entry.frqKeyFreq = frq->m_key_freq;
+		ok = ok && WriteAligned(fp, pos, frq->data(), frq->size()*sizeof(FrqDataPoint), entry.frqOffset);
+
+		entry.offset = loc.offset;
+		entry.consonant = loc.consonant;
+		entry.cutoff = loc.cutoff;
+		entry.preutterance = loc.preutterance;
+		entry.overlap = loc.overlap;
+
+		entry.lyricOffset = (uint32_t)strings.length();
+		strings.append(iter->first.data(), iter->first.length() + 1);
+
+		std::string relName = loc.filename;
+		if (relName.compare(0, prefix.length(), prefix) == 0)
+			relName = relName.substr(prefix.length());
+		entry.filenameOffset = (uint32_t)strings.length();
+		strings.append(relName.data(), relName.length() + 1);
+
+		entries.push_back(entry);
+	}
+
+	unsigned hashSize = 1;
+	while (hashSize < (unsigned)entries.size() * 2) hashSize <<= 1;
+	std::vector<uint32_t> hashTable(hashSize, 0);
+	for (unsigned i = 0; i < (unsigned)entries.size(); i++)
+	{
+		uint32_t slot = HashLyric(strings.data() + entries[i].lyricOffset) & (hashSize - 1);
+		while (hashTable[slot] != 0) slot = (slot + 1) & (hashSize - 1);
+		hashTable[slot] = i + 1;
+	}
+
+	memcpy(header.magic, s_magic, 4);
+	header.version = s_version;
+	header.numEntries = (uint32_t)entries.size();
+	header.hashSize = hashSize;
+	header.stringsSize = strings.length();
+	ok = ok && WriteAligned(fp, pos, entries.data(), entries.size()*sizeof(PackedBankEntry), header.entriesOffset);
+	ok = ok && WriteAligned(fp, pos, hashTable.data(), hashTable.size()*sizeof(uint32_t), header.hashOffset);
+	ok = ok && WriteAligned(fp, pos, strings.data(), strings.length(), header.stringsOffset);
+	header.fileSize = pos;
+	ok = ok && fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(Header), 1, fp) == 1;
+	ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+	if (ok) remove(filename);
+#endif
+	if (!ok || rename(tmpFilename.data(), filename) != 0)
+	{
+		printf("Failed to write %s\n", filename);
+		remove(tmpFilename.data());
+		return false;
+	}
+	return true;
+}
+
+bool PackedBank::Open(const char* bankPath, const char* filename)
+{
+	Close();
+	if (!m_file.OpenRead(filename)) return false;
+
+	const char* data = (const char*)m_file.Data();
+	uint64_t size = (uint64_t)m_file.Size();
+	if (data == nullptr || size < sizeof(Header))
+	{
+		Close();
+		return false;
+	}
+
+	const Header* header = (const Header*)data;
+	bool valid = memcmp(header->magic, s_magic, 4) == 0 && header->version == s_version && header->fileSize == size &&
+		header->hashSize > 0 && (header->hashSize & (header->hashSize - 1)) == 0 &&
+		header->entriesOffset + (uint64_t)header->numEntries*sizeof(PackedBankEntry) <= size &&
+		header->hashOffset + (uint64_t)header->hashSize*sizeof(uint32_t) <= size &&
+		header->stringsSize > 0 && header->stringsOffset + header->stringsSize <= size &&
+		data[header->stringsOffset + header->stringsSize - 1] == 0;
+
+	const PackedBankEntry* entries = (const PackedBankEntry*)(data + header->entriesOffset);
+	for (unsigned i = 0; valid && i < header->numEntries; i++)
+	{
+		const PackedBankEntry& entry = entries[i];
+		valid = entry.samplesOffset + (uint64_t)entry.numSamples*sizeof(float) <= size &&
+			entry.frqOffset + (uint64_t)entry.numFrqPoints*sizeof(FrqDataPoint) <= size &&
+			entry.lyricOffset < header->stringsSize && entry.filenameOffset < header->stringsSize;
+	}
+
+	if (!valid)
+	{
+		printf("%s is not a valid packed voice-bank, ignored.\n", filename);
+		Close();
+		return false;
+	}
+
+	m_header = header;
+	m_entries = entries;
+	m_hashTable = (const uint32_t*)(data + header->hashOffset);
+	m_strings = data + header->stringsOffset;
+	m_bankPath = bankPath;
+	m_stamp = std::string(filename) + "|" + FileStamp(filename);
+	return true;
+}
+
+void PackedBank::Close()
+{
+	m_header = nullptr;
+	m_file.Close();
+}
+
+unsigned PackedBank::NumberOfEntries() const
+{
+	return m_header != nullptr ? m_header->numEntries : 0;
+}
+
+int PackedBank::Find(const char* lyric) const
+{
+	if (m_header == nullptr) return -1;
+	uint32_t mask = m_header->hashSize - 1;
+	uint32_t slot = HashLyric(lyric) & mask;
+	for (uint32_t probe = 0; probe < m_header->hashSize; probe++, slot = (slot + 1) & mask)
+	{
+		uint32_t id = m_hashTable[slot];
+		if (id == 0 || id > m_header->numEntries) return -1;
+		if (strcmp(Lyric(id - 1), lyric) == 0) return (int)(id - 1);
+	}
+	return -1;
+}
+
+const PackedBankEntry& PackedBank::Entry(unsigned i) const
+{
+	return m_entries[i];
+}
+
+const char* PackedBank::Lyric(unsigned i) const
+{
+	return m_strings + m_entries[i].lyricOffset;
+}
+
+std::string PackedBank::FileName(unsigned i) const
+{
+	return m_bankPath + "/" + (m_strings + m_entries[i].filenameOffset);
+}
+
+void PackedBank::GetLocation(unsigned i, VoiceLocation& loc) const
+{
+	const PackedBankEntry& entry = m_entries[i];
+	loc.filename = FileName(i);
+	loc.offset = entry.offset;
+	loc.consonant = entry.consonant;
+	loc.cutoff = entry.cutoff;
+	loc.preutterance = entry.preutterance;
+	loc.overlap = entry.overlap;
+}
+
+const float* PackedBank::Samples(unsigned i) const
+{
+	return (const float*)((const char*)m_file.Data() + m_entries[i].samplesOffset);
+}
+
+void PackedBank::GetFrq(unsigned i, FrqData& frq) const
+{
+	const PackedBankEntry& entry = m_entries[i];
+	const FrqDataPoint* points = (const FrqDataPoint*)((const char*)m_file.Data() + entry.frqOffset);
+	frq.assign(points, points + entry.numFrqPoints);
+	frq.m_window_interval = entry.frqWindowInterval;
+	frq.m_key_freq = entry.frqKeyFreq;
+}
@@ -0,0 +1,83 @@
+#ifndef _PackedBank_h
+#define _PackedBank_h
+
+#include <string>
+#include <stdint.h>
+#include <MappedFile.h>
+
+#include "OtoMap.h"
+#include "FrqData.h"
+
+// oto entry as stored in the packed file
+struct PackedBankEntry
+{
+	uint64_t samplesOffset;
+	uint64_t frqOffset;
+	uint32_t lyricOffset;		// into the string pool, 0-terminated
+	uint32_t filenameOffset;	// into the string pool, relative to the voice-bank
+	uint32_t numSamples;
+	uint32_t numFrqPoints;
+	uint32_t sampleRate;
+	int32_t frqWindowInterval;
+	double frqKeyFreq;
+	float offset;
+	float consonant;
+	float cutoff;
+	float preutterance;
+	float overlap;
+	float srcbegin;
+	float srcend;
+	uint32_t reserved;
+};
+
+/*
+	Single-file form of a voice-bank, built from the raw folder by Build().
+	Holds a hashed lyric index, the normalized samples of each oto entry already cut to
+	offset/cutoff, and the .frq curves. The file is only mapped, so loading it and
+	fetching a syllable don't read or parse anything.
+	The file is not updated by itself, it has to be built again after the bank is edited.
+*/
+class PackedBank
+{
+public:
+	static const char* DefaultFileName() { return "voicebank.sdpack"; }
+
+	// bankPath is the root of the voice-bank, file names of otoMap are stored relative to it
+	static bool Build(const OtoMap& otoMap, const char* bankPath, const char* filename);
+
+	bool Open(const char* bankPath, const char* filename);
+	void Close();
+	bool IsOpen() const { return m_header != nullptr; }
+
+	unsigned NumberOfEntries() const;
+	// index of the entry of the lyric, looked up in the FNV-1a hash table with linear probing, -1 if not found
+	int Find(const char* lyric) const;
+
+	const PackedBankEntry& Entry(unsigned i) const;
+	const char* Lyric(unsigned i) const;
+	std::string FileName(unsigned i) const;
+	void GetLocation(unsigned i, VoiceLocation& loc) const;
+	const float* Samples(unsigned i) const;
+	void GetFrq(unsigned i, FrqData& frq) const;
+
+	// size and modification time of the packed file, for cache keys
+	const std::string& Stamp() const { return m_stamp; }
+
+	PackedBank() : m_header(nullptr) {}
+
+private:
+	struct Header;
+	const Header* m_header;
+	const PackedBankEntry* m_entries;
+	const uint32_t* m_hashTable;
+	const char* m_strings;
+
+	std::string m_bankPath;
+	std::string m_stamp;
+	MappedFile m_file;
+
+	PackedBank(const PackedBank &);
+	PackedBank &operator=(const PackedBank &);
+};
+
+#endif
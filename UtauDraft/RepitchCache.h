@@ -0,0 +1,68 @@
+#ifndef _RepitchCache_h
+#define _RepitchCache_h
+
+/*
+	Keeps the last few repitched source windows (or parameter sets) of a synthesis loop,
+	keyed by the sequence they come from, their index in it and the target half-width.
+	On a held note consecutive output periods use the same source periods at the same
+	pitch, so most of them are found here instead of being repitched again.
+	The result only depends on the key, so the output is the same as without the cache.
+*/
+template <class T, unsigned NumSlots = 6>
+class RepitchCache
+{
+public:
+	RepitchCache() : m_clock(0)
+	{
+		for (unsigned i = 0; i < NumSlots; i++)
+		{
+			m_slots[i].seq = nullptr;
+			m_slots[i].lastUse = 0;
+		}
+	}
+
+	// repitch(T& dst, float halfWidth) is called on a miss, to fill the least recently used slot
+	// the returned reference stays valid for the next NumSlots - 1 calls
+	template <class Repitch>
+	const T& Get(const void* seq, unsigned id, float halfWidth, Repitch repitch)
+	{
+		m_clock++;
+		unsigned victim = 0;
+		for (unsigned i = 0; i < NumSlots; i++)
+		{
+			Slot& slot = m_slots[i];
+			if (slot.seq == seq && slot.id == id && slot.halfWidth == halfWidth)
+			{
+				slot.lastUse = m_clock;
+				return slot.value;
+			}
+			if (slot.lastUse < m_slots[victim].lastUse) victim = i;
+		}
+
+		Slot& slot = m_slots[victim];
+		slot.seq = seq;
+		slot.id = id;
+		slot.halfWidth = halfWidth;
+		slot.lastUse = m_clock;
+		repitch(slot.value, halfWidth);
+		return slot.value;
+	}
+
+private:
+	struct Slot
+	{
+		const void* seq;
+		unsigned id;
+		float halfWidth;
+		unsigned lastUse;
+		T value;
+	};
+
+	Slot m_slots[NumSlots];
+	unsigned m_clock;
+
+	RepitchCache(const RepitchCache &);
+	RepitchCache &operator=(const RepitchCache &);
+};
+
+#endif
@@ -24,8 +24,23 @@ void SentenceGenerator_CPU::_generatePiece(const UtauSourceFetcher& srcFetcher,
 }
 
 
+static unsigned PieceNoiseSeed(const std::string& lyric, unsigned pieceId, unsigned length)
+{
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	for (size_t i = 0; i < lyric.length(); i++)
+	{
+		hash ^= (unsigned char)lyric[i];
+		hash *= 16777619u;
+	}
+	return hash ^ (pieceId * 0x9E3779B9u) ^ (length * 0x85EBCA6Bu);
+}
+
 void SentenceGenerator_CPU::GenerateSentence(const UtauSourceFetcher& srcFetcher, unsigned numPieces, const std::string* lyrics, const unsigned* isVowel, const unsigned* lengths, const float *freqAllMap, NoteBuffer* noteBuf)
 {
+	// windows and spectra created for the sentence are all released in one step at the end
+	ScratchArena::Scope scratchScope;
+
 	unsigned noteBufPos = 0;
 	float phase = 0.0f;
 
@@ -41,6 +56,7 @@ void SentenceGenerator_CPU::GenerateSentence(const UtauSourceFetcher& srcFetcher
 			lyric_next = lyrics[j + 1].data();
 		}
 
+		_noiseSeed = PieceNoiseSeed(lyrics[j], j, uSumLen);
 		_generatePiece(srcFetcher, lyrics[j].data(), lyric_next, uSumLen, freqMap, noteBuf, noteBufPos, phase, j == 0, isVowel[j] != 0);
 
 		noteBufPos += uSumLen;
@@ -9,6 +9,10 @@ public:
 	virtual void GenerateSentence(const UtauSourceFetcher& srcFetcher, unsigned numPieces, const std::string* lyrics, const unsigned* isVowel, const unsigned* lengths, const float *freqAllMap, NoteBuffer* noteBuf);
 
 protected:
+	// noise seed of the piece being generated, derived from its lyric, index and length,
+	// so the output doesn't depend on what was rendered before
+	unsigned _noiseSeed;
+
 	virtual void GeneratePiece(bool isVowel, unsigned uSumLen, const float* freqMap, float& phase, Buffer& dstBuf, bool firstNote, bool hasNextNote, const SourceInfo& srcInfo, const SourceInfo& srcInfo_next, const SourceDerivedInfo& srcDerInfo) = 0;
 
 private:
@@ -1,4 +1,263 @@
 #include "SentenceGenerator_HNM.h"
+#include "UtauSourceCache.h"
+#include "RepitchCache.h"
+
+// part of a source to analyze, and how its periods are classified
+struct HNMAnalysisRange
+{
+	unsigned startPos;
+	float endPos;
+	bool isVowel;
+	float vowelBefore; // periods before this are treated as vowel, when isVowel
+	float vowelAfter; // periods from this on are treated as vowel, when isVowel
+	float keepVoicedFrom; // from here on, maxVoiced doesn't fall, when isVowel
+};
+
+// range of the source of the note itself
+static HNMAnalysisRange AnalysisRange(bool isVowel, bool firstNote, const SourceDerivedInfo& srcDerInfo)
+{
+	float fStartPos = firstNote ? srcDerInfo.overlap_pos : srcDerInfo.preutter_pos;
+	if (fStartPos < 0.0f) fStartPos = 0.0f;
+
+	HNMAnalysisRange range;
+	range.startPos = (unsigned)fStartPos;
+	range.endPos = isVowel ? FLT_MAX : srcDerInfo.fixed_end;
+	range.isVowel = isVowel;
+	range.vowelBefore = srcDerInfo.overlap_pos;
+	range.vowelAfter = srcDerInfo.fixed_end;
+	range.keepVoicedFrom = srcDerInfo.preutter_pos;
+	return range;
+}
+
+// head of the source of the next note, which the note transitions into
+static HNMAnalysisRange AnalysisRangeNext(bool isVowel, const SourceDerivedInfo& srcDerInfo)
+{
+	HNMAnalysisRange range;
+	range.startPos = 0;
+	range.endPos = srcDerInfo.preutter_pos_next;
+	range.isVowel = isVowel;
+	range.vowelBefore = srcDerInfo.overlap_pos_next;
+	range.vowelAfter = FLT_MAX;
+	range.keepVoicedFrom = srcDerInfo.preutter_pos_next;
+	return range;
+}
+
+// the periods are found serially, each is then analyzed independently, except for the
+// voiced limit, which can only be carried from one period to the next afterwards
+void SentenceGenerator_HNM::_analyze(const SourceInfo& srcInfo, const HNMAnalysisRange& range, HNMAnalysis& periods)
+{
+	std::vector<unsigned> srcPositions;
+	std::vector<float> srcSampleFreqs;
+
+	float fPeriodCount = 0.0f;
+	for (unsigned srcPos = range.startPos; srcPos < srcInfo.source.m_data.size() && (float)srcPos < range.endPos; srcPos++)
+	{
+		float srcSampleFreq;
+		float srcFreqPos = (srcInfo.srcbegin + (float)srcPos) / (float)srcInfo.frq.m_window_interval;
+		unsigned uSrcFreqPos = (unsigned)srcFreqPos;
+		float fracSrcFreqPos = srcFreqPos - (float)uSrcFreqPos;
+
+		float freq1 = (float)srcInfo.frq[uSrcFreqPos].freq;
+		if (freq1 <= 55.0f) freq1 = (float)srcInfo.frq.m_key_freq;
+
+		float freq2 = (float)srcInfo.frq[uSrcFreqPos + 1].freq;
+		if (freq2 <= 55.0f) freq2 = (float)srcInfo.frq.m_key_freq;
+
+		float sampleFreq1 = freq1 / (float)srcInfo.source.m_sampleRate;
+		float sampleFreq2 = freq2 / (float)srcInfo.source.m_sampleRate;
+
+		srcSampleFreq = sampleFreq1*(1.0f - fracSrcFreqPos) + sampleFreq2*fracSrcFreqPos;
+
+		unsigned paramId = (unsigned)fPeriodCount;
+		if (paramId >= srcPositions.size())
+		{
+			srcPositions.push_back(srcPos);
+			srcSampleFreqs.push_back(srcSampleFreq);
+		}
+		fPeriodCount += srcSampleFreq;
+	}
+
+	unsigned numPeriods = (unsigned)srcPositions.size();
+	std::vector<unsigned> maxVoiceds(numPeriods);
+	std::vector<AmpSpectrum> harmSpecs(numPeriods);
+	periods.resize(numPeriods);
+
+	ForEach(numPeriods, [&](unsigned paramId)
+	{
+		unsigned srcPos = srcPositions[paramId];
+		float srcSampleFreq = srcSampleFreqs[paramId];
+
+		bool isVowel = range.isVowel && ((float)srcPos >= range.vowelAfter || (float)srcPos < range.vowelBefore);
+		unsigned maxVoiced = 0;
+
+		if (!isVowel)
+		{
+			float halfWinlen = 3.0f / srcSampleFreq;
+			Window capture;
+			capture.CreateFromBuffer(srcInfo.source, (float)srcPos, halfWinlen);
+
+			AmpSpectrum capSpec;
+			capSpec.CreateFromWindow(capture);
+
+			unsigned char voiced_cache[3] = { 0, 0, 0 };
+			unsigned char cache_pos = 0;
+
+			for (unsigned i = 3; i + 1 < capSpec.m_data.size(); i += 3)
+			{
+				double absv0 = capSpec.m_data[i];
+				double absv1 = capSpec.m_data[i - 1];
+				double absv2 = capSpec.m_data[i + 1];
+
+				double rate = absv0 / (absv0 + absv1 + absv2);
+
+				if (rate > 0.7)
+				{
+					voiced_cache[cache_pos] = 1;
+				}
+				else
+				{
+					voiced_cache[cache_pos] = 0;
+				}
+
+				cache_pos = (cache_pos + 1) % 3;
+
+				if (voiced_cache[0] + voiced_cache[1] + voiced_cache[2] > 1)
+				{
+					maxVoiced = i / 3;
+				}
+			}
+		}
+		maxVoiceds[paramId] = maxVoiced;
+
+		float srcHalfWinWidth = 1.0f / srcSampleFreq;
+		Window srcWin;
+		srcWin.CreateFromBuffer(srcInfo.source, (float)srcPos, srcHalfWinWidth);
+
+		harmSpecs[paramId].CreateFromWindow(srcWin);
+		periods[paramId].NoiseSpectrum.Allocate(srcWin.m_halfWidth);
+		periods[paramId].m_srcPos = srcPos;
+	});
+
+	unsigned lastmaxVoiced = 0;
+	for (unsigned paramId = 0; paramId < numPeriods; paramId++)
+	{
+		unsigned& maxVoiced = maxVoiceds[paramId];
+		if (range.isVowel && (float)srcPositions[paramId] >= range.keepVoicedFrom && maxVoiced < lastmaxVoiced)
+			maxVoiced = lastmaxVoiced;
+
+		lastmaxVoiced = maxVoiced;
+	}
+
+	ForEach(numPeriods, [&](unsigned paramId)
+	{
+		unsigned srcPos = srcPositions[paramId];
+		bool isVowel = range.isVowel && ((float)srcPos >= range.vowelAfter || (float)srcPos < range.vowelBefore);
+		unsigned maxVoiced = maxVoiceds[paramId];
+		HNMPeriod& period = periods[paramId];
+		AmpSpectrum& harmSpec = harmSpecs[paramId];
+
+		if (!isVowel)
+		{
+			for (unsigned i = maxVoiced + 1; i < (unsigned)harmSpec.m_data.size(); i++)
+			{
+				float amplitude = harmSpec.m_data[i];
+				harmSpec.m_data[i] = 0.0f;
+				if (i < (unsigned)period.NoiseSpectrum.m_data.size())
+				{
+					period.NoiseSpectrum.m_data[i] = amplitude;
+				}
+			}
+		}
+		period.HarmWindow.CreateFromAmpSpec(harmSpec);
+	});
+}
+
+// the analysis of a range only depends on the source files, the cut of the oto entry and the range itself
+static std::string HNMAnalysisKey(const SourceInfo& srcInfo, const HNMAnalysisRange& range)
+{
+	char params[256];
+	sprintf(params, "|%a|%u|%u|%a|%d|%a|%a|%a", srcInfo.srcbegin, (unsigned)srcInfo.source.m_data.size(), range.startPos, range.endPos,
+		range.isVowel ? 1 : 0, range.vowelBefore, range.vowelAfter, range.keepVoicedFrom);
+
+	return srcInfo.loc.filename + "|" + srcInfo.stamp + params;
+}
+
+HNMAnalysis_deferred SentenceGenerator_HNM::_fetchAnalysis(const SourceInfo& srcInfo, const HNMAnalysisRange& range)
+{
+	HNMAnalysis_deferred analysis;
+	if (_sourceCache == nullptr)
+	{
+		_analyze(srcInfo, range, *analysis);
+		return analysis;
+	}
+
+	// cached analyses outlive the sentence, so they are kept out of its scratch pool
+	ScratchArena::Suspend suspend;
+	std::string key = HNMAnalysisKey(srcInfo, range);
+	if (!_sourceCache->GetHNMAnalysis(key, analysis))
+	{
+		_analyze(srcInfo, range, *analysis);
+		_sourceCache->AddHNMAnalysis(key, analysis);
+	}
+	return analysis;
+}
+
+// the sources are fetched as by GenerateSentence(), the length given to DeriveInfo() only affects the weights
+void SentenceGenerator_HNM::PrefetchAnalyses(const UtauSourceFetcher& srcFetcher, unsigned numPieces, const std::string* lyrics, const unsigned* isVowel)
+{
+	for (unsigned j = 0; j < numPieces; j++)
+	{
+		bool _isVowel = isVowel[j] != 0;
+		bool hasNextNote = j < numPieces - 1;
+
+		SourceInfo srcInfo;
+		SourceInfo srcInfo_next;
+		if (!srcFetcher.FetchSourceInfo(lyrics[j].data(), srcInfo, !_isVowel ? _constVC : -1.0f)) continue;
+		if (hasNextNote && !srcFetcher.FetchSourceInfo(lyrics[j + 1].data(), srcInfo_next)) continue;
+
+		SourceDerivedInfo srcDerInfo;
+		srcDerInfo.DeriveInfo(j == 0, hasNextNote, 1, srcInfo, srcInfo_next, _isVowel);
+
+		_fetchAnalysis(srcInfo, AnalysisRange(_isVowel, j == 0, srcDerInfo));
+		if (hasNextNote)
+			_fetchAnalysis(srcInfo_next, AnalysisRangeNext(_isVowel, srcDerInfo));
+	}
+}
+
+// one output window of the synthesis loop
+struct HNMGrain
+{
+	float center;
+	float destHalfWinLen;
+	unsigned paramId0;
+	unsigned paramId1;
+	float k;
+	bool inTransition;
+	unsigned paramId0_next;
+	unsigned paramId1_next;
+	float k_next;
+	float k2; // weight of the next note
+
+	bool hasHarm;
+	SymmetricWindow harm;
+	bool hasNoise;
+	Window noise;
+};
+
+static const unsigned s_grainsPerBlock = 32;
+
+static inline float InterpolationWeight(float pos, float pos0, float pos1)
+{
+	if (pos >= pos1) return 1.0f;
+	if (pos <= pos0) return 0.0f;
+	return (pos - pos0) / (pos1 - pos0);
+}
+
+void SentenceGenerator_HNM::ForEach(unsigned count, const std::function<void(unsigned)>& func)
+{
+	for (unsigned i = 0; i < count; i++)
+		func(i);
+}
 
 void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const float* freqMap, float& phase, Buffer& dstBuf, bool firstNote, bool hasNextNote, const SourceInfo& srcInfo, const SourceInfo& srcInfo_next, const SourceDerivedInfo& srcDerInfo)
 {
@@ -34,36 +293,6 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 	tempBuf.m_data.resize(uTempLen);
 	tempBuf.SetZero();
 
-	class ParameterSet
-	{
-	public:
-		SymmetricWindow HarmWindow;
-		AmpSpectrum NoiseSpectrum;
-
-		void Scale(const ParameterSet& src, float targetHalfWidth)
-		{
-			HarmWindow.Repitch_FormantPreserved(src.HarmWindow, targetHalfWidth);
-			NoiseSpectrum.Scale(src.NoiseSpectrum, targetHalfWidth);
-		}
-
-		void Interpolate(const ParameterSet& param0, const ParameterSet& param1, float k)
-		{
-			HarmWindow.Interpolate(param0.HarmWindow, param1.HarmWindow, k, param0.HarmWindow.m_halfWidth);
-			NoiseSpectrum.Interpolate(param0.NoiseSpectrum, param1.NoiseSpectrum, k, param0.NoiseSpectrum.m_halfWidth);
-		}
-	};
-
-	class ParameterSetWithPos : public ParameterSet
-	{
-	public:
-		float m_pos;
-	};
-
-	std::vector<ParameterSetWithPos> parameters;
-
-	float fPeriodCount = 0.0f;
-	unsigned lastmaxVoiced = 0;
-
 	float fStartPos = firstNote ? srcDerInfo.overlap_pos : srcDerInfo.preutter_pos;
 	float logicalPos = 0.0f;
 
@@ -72,102 +301,18 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 		logicalPos += (-fStartPos)*(firstNote ? srcDerInfo.headerWeight : srcDerInfo.fixed_Weight);
 		fStartPos = 0.0f;
 	}
-	unsigned startPos = (unsigned)fStartPos;
-
-	for (unsigned srcPos = startPos; srcPos < srcInfo.source.m_data.size(); srcPos++)
-	{
-		if ((float)srcPos >= srcDerInfo.fixed_end && !_isVowel) break;
-		float srcSampleFreq;
-		float srcFreqPos = (srcInfo.srcbegin + (float)srcPos) / (float)srcInfo.frq.m_window_interval;
-		unsigned uSrcFreqPos = (unsigned)srcFreqPos;
-		float fracSrcFreqPos = srcFreqPos - (float)uSrcFreqPos;
 
-		float freq1 = (float)srcInfo.frq[uSrcFreqPos].freq;
-		if (freq1 <= 55.0f) freq1 = (float)srcInfo.frq.m_key_freq;
-
-		float freq2 = (float)srcInfo.frq[uSrcFreqPos + 1].freq;
-		if (freq2 <= 55.0f) freq2 = (float)srcInfo.frq.m_key_freq;
-
-		float sampleFreq1 = freq1 / (float)srcInfo.source.m_sampleRate;
-		float sampleFreq2 = freq2 / (float)srcInfo.source.m_sampleRate;
-
-		srcSampleFreq = sampleFreq1*(1.0f - fracSrcFreqPos) + sampleFreq2*fracSrcFreqPos;
-
-		unsigned paramId = (unsigned)fPeriodCount;
-		if (paramId >= parameters.size())
-		{
-			bool isVowel = _isVowel && ((float)srcPos >= srcDerInfo.fixed_end || (float)srcPos < srcDerInfo.overlap_pos);
-			unsigned maxVoiced = 0;
+	HNMAnalysisRange range = AnalysisRange(_isVowel, firstNote, srcDerInfo);
+	HNMAnalysis_deferred analysis = _fetchAnalysis(srcInfo, range);
+	const HNMAnalysis& parameters = *analysis;
 
-			if (!isVowel)
-			{
-				float halfWinlen = 3.0f / srcSampleFreq;
-				Window capture;
-				capture.CreateFromBuffer(srcInfo.source, (float)srcPos, halfWinlen);
-
-				AmpSpectrum capSpec;
-				capSpec.CreateFromWindow(capture);
-
-				unsigned char voiced_cache[3] = { 0, 0, 0 };
-				unsigned char cache_pos = 0;
-
-				for (unsigned i = 3; i + 1 < capSpec.m_data.size(); i += 3)
-				{
-					double absv0 = capSpec.m_data[i];
-					double absv1 = capSpec.m_data[i - 1];
-					double absv2 = capSpec.m_data[i + 1];
-
-					double rate = absv0 / (absv0 + absv1 + absv2);
-
-					if (rate > 0.7)
-					{
-						voiced_cache[cache_pos] = 1;
-					}
-					else
-					{
-						voiced_cache[cache_pos] = 0;
-					}
-
-					cache_pos = (cache_pos + 1) % 3;
-
-					if (voiced_cache[0] + voiced_cache[1] + voiced_cache[2] > 1)
-					{
-						maxVoiced = i / 3;
-					}
-				}
-			}
-			if (_isVowel && (float)srcPos >= srcDerInfo.preutter_pos && maxVoiced < lastmaxVoiced)
-				maxVoiced = lastmaxVoiced;
-
-			lastmaxVoiced = maxVoiced;
-
-			ParameterSetWithPos paramSet;
-
-			float srcHalfWinWidth = 1.0f / srcSampleFreq;
-			Window srcWin;
-			srcWin.CreateFromBuffer(srcInfo.source, (float)srcPos, srcHalfWinWidth);
-
-			AmpSpectrum harmSpec;
-			harmSpec.CreateFromWindow(srcWin);
-			paramSet.NoiseSpectrum.Allocate(srcWin.m_halfWidth);
-
-			if (!isVowel)
-			{
-				for (unsigned i = maxVoiced + 1; i < (unsigned)harmSpec.m_data.size(); i++)
-				{
-					float amplitude = harmSpec.m_data[i];
-					harmSpec.m_data[i] = 0.0f;
-					if (i < (unsigned)paramSet.NoiseSpectrum.m_data.size())
-					{
-						paramSet.NoiseSpectrum.m_data[i] = amplitude;
-					}
-				}
-			}
-			paramSet.HarmWindow.CreateFromAmpSpec(harmSpec);
-			paramSet.m_pos = logicalPos;
-			parameters.push_back(paramSet);
-		}
-		fPeriodCount += srcSampleFreq;
+	// logical positions of the periods, these depend on the note, so are not cached
+	std::vector<float> paramPos(parameters.size());
+	unsigned paramId = 0;
+	for (unsigned srcPos = range.startPos; paramId < parameters.size(); srcPos++)
+	{
+		if (parameters[paramId].m_srcPos == srcPos)
+			paramPos[paramId++] = logicalPos;
 
 		if (firstNote && (float)srcPos < srcDerInfo.preutter_pos)
 		{
@@ -183,116 +328,33 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 		}
 	}
 
-	std::vector<ParameterSetWithPos> parameters_next;
+	HNMAnalysis_deferred analysis_next;
+	std::vector<float> paramPos_next;
 
 	if (hasNextNote)
 	{
-		float fPeriodCount = 0.0f;
-		float logicalPos = 1.0f - srcDerInfo.preutter_pos_next*srcDerInfo.fixed_Weight;
+		analysis_next = _fetchAnalysis(srcInfo_next, AnalysisRangeNext(_isVowel, srcDerInfo));
 
-		unsigned lastmaxVoiced = 0;
-		for (unsigned srcPos = 0; (float)srcPos < srcDerInfo.preutter_pos_next; srcPos++)
+		float logicalPos = 1.0f - srcDerInfo.preutter_pos_next*srcDerInfo.fixed_Weight;
+		paramPos_next.resize(analysis_next->size());
+		unsigned paramId = 0;
+		for (unsigned srcPos = 0; paramId < analysis_next->size(); srcPos++)
 		{
-			float srcSampleFreq;
-			float srcFreqPos = (srcInfo_next.srcbegin + (float)srcPos) / (float)srcInfo_next.frq.m_window_interval;
-			unsigned uSrcFreqPos = (unsigned)srcFreqPos;
-			float fracSrcFreqPos = srcFreqPos - (float)uSrcFreqPos;
-
-			float freq1 = (float)srcInfo_next.frq[uSrcFreqPos].freq;
-			if (freq1 <= 55.0f) freq1 = (float)srcInfo_next.frq.m_key_freq;
-
-			float freq2 = (float)srcInfo_next.frq[uSrcFreqPos + 1].freq;
-			if (freq2 <= 55.0f) freq2 = (float)srcInfo_next.frq.m_key_freq;
-
-			float sampleFreq1 = freq1 / (float)srcInfo_next.source.m_sampleRate;
-			float sampleFreq2 = freq2 / (float)srcInfo_next.source.m_sampleRate;
-
-			srcSampleFreq = sampleFreq1*(1.0f - fracSrcFreqPos) + sampleFreq2*fracSrcFreqPos;
-
-			unsigned paramId = (unsigned)fPeriodCount;
-			if (paramId >= parameters_next.size())
-			{
-				bool isVowel = _isVowel && (float)srcPos < srcDerInfo.overlap_pos_next;
-				unsigned maxVoiced = 0;
-
-				if (!isVowel)
-				{
-					float halfWinlen = 3.0f / srcSampleFreq;
-					Window capture;
-					capture.CreateFromBuffer(srcInfo_next.source, (float)srcPos, halfWinlen);
-
-					AmpSpectrum capSpec;
-					capSpec.CreateFromWindow(capture);
-
-					unsigned char voiced_cache[3] = { 0, 0, 0 };
-					unsigned char cache_pos = 0;
-
-					for (unsigned i = 3; i + 1 < capSpec.m_data.size(); i += 3)
-					{
-						double absv0 = capSpec.m_data[i];
-						double absv1 = capSpec.m_data[i - 1];
-						double absv2 = capSpec.m_data[i + 1];
-
-						double rate = absv0 / (absv0 + absv1 + absv2);
-
-						if (rate > 0.7)
-						{
-							voiced_cache[cache_pos] = 1;
-						}
-						else
-						{
-							voiced_cache[cache_pos] = 0;
-						}
-
-						cache_pos = (cache_pos + 1) % 3;
-
-						if (voiced_cache[0] + voiced_cache[1] + voiced_cache[2] > 1)
-						{
-							maxVoiced = i / 3;
-						}
-					}
-				}
-				if (_isVowel && (float)srcPos >= srcDerInfo.preutter_pos_next && maxVoiced < lastmaxVoiced)
-					maxVoiced = lastmaxVoiced;
-
-				lastmaxVoiced = maxVoiced;
-
-				ParameterSetWithPos paramSet;
-
-				float srcHalfWinWidth = 1.0f / srcSampleFreq;
-				Window srcWin;
-				srcWin.CreateFromBuffer(srcInfo_next.source, (float)srcPos, srcHalfWinWidth);
-
-				AmpSpectrum harmSpec;
-				harmSpec.CreateFromWindow(srcWin);
-				paramSet.NoiseSpectrum.Allocate(srcWin.m_halfWidth);
-
-				if (!isVowel)
-				{
-					for (unsigned i = maxVoiced + 1; i < (unsigned)harmSpec.m_data.size(); i++)
-					{
-						float amplitude = harmSpec.m_data[i];
-						harmSpec.m_data[i] = 0.0f;
-						if (i < (unsigned)paramSet.NoiseSpectrum.m_data.size())
-						{
-							paramSet.NoiseSpectrum.m_data[i] = amplitude;
-						}
-					}
-				}
-				paramSet.HarmWindow.CreateFromAmpSpec(harmSpec);
-				paramSet.m_pos = logicalPos;
-				parameters_next.push_back(paramSet);
-			}
-
-			fPeriodCount += srcSampleFreq;
+			if ((*analysis_next)[paramId].m_srcPos == srcPos)
+				paramPos_next[paramId++] = logicalPos;
 			logicalPos += srcDerInfo.fixed_Weight;
 		}
 	}
+	const HNMAnalysis& parameters_next = *analysis_next;
 
 	if (parameters_next.size() == 0) hasNextNote = false;
 
 	float tempHalfWinLen = 1.0f / minSampleFreq;
 
+	// the source periods and weights of each output window are found serially, as they only advance,
+	// the grains are then synthesized independently, and overlap-added in order
+	std::vector<HNMGrain> grains;
+
 	unsigned paramId0 = 0;
 	unsigned paramId0_next = 0;
 	unsigned pos_final = 0;
@@ -311,7 +373,7 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 		bool in_transition = hasNextNote && _transition > 0.0f && _transition < 1.0f && fParamPos >= transitionStart;
 
 		unsigned paramId1 = paramId0 + 1;
-		while (paramId1 < parameters.size() && parameters[paramId1].m_pos < fParamPos)
+		while (paramId1 < parameters.size() && paramPos[paramId1] < fParamPos)
 		{
 			paramId0++;
 			paramId1 = paramId0 + 1;
@@ -322,7 +384,7 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 
 		if (in_transition)
 		{
-			while (paramId1_next < parameters_next.size() && parameters_next[paramId1_next].m_pos < fParamPos)
+			while (paramId1_next < parameters_next.size() && paramPos_next[paramId1_next] < fParamPos)
 			{
 				paramId0_next++;
 				paramId1_next = paramId0_next + 1;
@@ -330,99 +392,116 @@ void SentenceGenerator_HNM::GeneratePiece(bool _isVowel, unsigned uSumLen, const
 			if (paramId1_next == parameters_next.size()) paramId1_next = paramId0_next;
 		}
 
-		ParameterSetWithPos& param0 = parameters[paramId0];
-		ParameterSetWithPos& param1 = parameters[paramId1];
+		grains.emplace_back();
+		HNMGrain& grain = grains.back();
+		grain.center = fTmpWinCenter;
+		grain.paramId0 = paramId0;
+		grain.paramId1 = paramId1;
+		grain.k = InterpolationWeight(fParamPos, paramPos[paramId0], paramPos[paramId1]);
+		grain.destHalfWinLen = powf(2.0f, _gender) / freqMap[pos_final];
+		grain.inTransition = in_transition;
 
-		float k;
-		if (fParamPos >= param1.m_pos) k = 1.0f;
-		else if (fParamPos <= param0.m_pos) k = 0.0f;
-		else
+		if (in_transition)
 		{
-			k = (fParamPos - param0.m_pos) / (param1.m_pos - param0.m_pos);
+			grain.paramId0_next = paramId0_next;
+			grain.paramId1_next = paramId1_next;
+			grain.k_next = InterpolationWeight(fParamPos, paramPos_next[paramId0_next], paramPos_next[paramId1_next]);
+
+			float x = (fParamPos - transitionEnd) / (transitionEnd*_transition);
+			if (x > 0.0f) x = 0.0f;
+			grain.k2 = 0.5f*(cosf(x*(float)PI) + 1.0f);
 		}
+	}
 
-		float destSampleFreq;
-		destSampleFreq = freqMap[pos_final];
-		float destHalfWinLen = powf(2.0f, _gender) / destSampleFreq;
+	phase = (fTmpWinCenter - tempLen) / tempHalfWinLen;
 
-		ParameterSet scaledParam0;
-		ParameterSet scaledParam1;
+	// blocks of consecutive grains share a cache of scaled parameters, held notes mostly hit it
+	unsigned numGrains = (unsigned)grains.size();
+	unsigned numBlocks = (numGrains + s_grainsPerBlock - 1) / s_grainsPerBlock;
+	unsigned noiseSeed = _noiseSeed;
 
-		ParameterSet l_param;
-		ParameterSet* destParam = &l_param;
+	ForEach(numBlocks, [&](unsigned block)
+	{
+		RepitchCache<HNMParameterSet> scaledParams;
 
-		scaledParam0.Scale(param0, destHalfWinLen);
-		if (paramId0 == paramId1)
-		{
-			destParam = &scaledParam0;
-		}
-		else
+		unsigned end = min((block + 1)*s_grainsPerBlock, numGrains);
+		for (unsigned grainId = block*s_grainsPerBlock; grainId < end; grainId++)
 		{
-			scaledParam1.Scale(param1, destHalfWinLen);
-			l_param.Interpolate(scaledParam0, scaledParam1, k);
-		}
+			HNMGrain& grain = grains[grainId];
+			float destHalfWinLen = grain.destHalfWinLen;
 
-		ParameterSet* finalDestParam = destParam;
-		ParameterSet l_paramTransit;
+			const HNMPeriod& param0 = parameters[grain.paramId0];
+			const HNMPeriod& param1 = parameters[grain.paramId1];
 
-		if (in_transition)
-		{
-			ParameterSetWithPos& param0_next = parameters_next[paramId0_next];
-			ParameterSetWithPos& param1_next = parameters_next[paramId1_next];
+			HNMParameterSet l_param;
+			const HNMParameterSet* destParam = &l_param;
 
-			float k;
-			if (fParamPos >= param1_next.m_pos) k = 1.0f;
-			else if (fParamPos <= param0_next.m_pos) k = 0.0f;
+			const HNMParameterSet& scaledParam0 = scaledParams.Get(&parameters, grain.paramId0, destHalfWinLen,
+				[&param0](HNMParameterSet& dst, float halfWidth) { dst.Scale(param0, halfWidth); });
+			if (grain.paramId0 == grain.paramId1)
+			{
+				destParam = &scaledParam0;
+			}
 			else
 			{
-				k = (fParamPos - param0_next.m_pos) / (param1_next.m_pos - param0_next.m_pos);
+				const HNMParameterSet& scaledParam1 = scaledParams.Get(&parameters, grain.paramId1, destHalfWinLen,
+					[&param1](HNMParameterSet& dst, float halfWidth) { dst.Scale(param1, halfWidth); });
+				l_param.Interpolate(scaledParam0, scaledParam1, grain.k);
 			}
 
-			ParameterSet scaledParam0_next;
-			ParameterSet scaledParam1_next;
-
-			ParameterSet l_param_next;
-			ParameterSet* destParam_next = &l_param_next;
+			const HNMParameterSet* finalDestParam = destParam;
+			HNMParameterSet l_paramTransit;
 
-			scaledParam0_next.Scale(param0_next, destHalfWinLen);
-			if (paramId0_next == paramId1_next)
+			if (grain.inTransition)
 			{
-				destParam_next = &scaledParam0_next;
+				const HNMPeriod& param0_next = parameters_next[grain.paramId0_next];
+				const HNMPeriod& param1_next = parameters_next[grain.paramId1_next];
+
+				HNMParameterSet l_param_next;
+				const HNMParameterSet* destParam_next = &l_param_next;
+
+				const HNMParameterSet& scaledParam0_next = scaledParams.Get(&parameters_next, grain.paramId0_next, destHalfWinLen,
+					[&param0_next](HNMParameterSet& dst, float halfWidth) { dst.Scale(param0_next, halfWidth); });
+				if (grain.paramId0_next == grain.paramId1_next)
+				{
+					destParam_next = &scaledParam0_next;
+				}
+				else
+				{
+					const HNMParameterSet& scaledParam1_next = scaledParams.Get(&parameters_next, grain.paramId1_next, destHalfWinLen,
+						[&param1_next](HNMParameterSet& dst, float halfWidth) { dst.Scale(param1_next, halfWidth); });
+					l_param_next.Interpolate(scaledParam0_next, scaledParam1_next, grain.k_next);
+				}
+				finalDestParam = &l_paramTransit;
+
+				l_paramTransit.Interpolate(*destParam, *destParam_next, grain.k2);
 			}
-			else
+
+			grain.hasHarm = finalDestParam->HarmWindow.NonZero();
+			if (grain.hasHarm)
 			{
-				scaledParam1_next.Scale(param1_next, destHalfWinLen);
-				l_param_next.Interpolate(scaledParam0_next, scaledParam1_next, k);
+				if (finalDestParam->HarmWindow.m_halfWidth == tempHalfWinLen)
+					grain.harm = finalDestParam->HarmWindow;
+				else
+					grain.harm.Scale(finalDestParam->HarmWindow, tempHalfWinLen);
 			}
-			float x = (fParamPos - transitionEnd) / (transitionEnd*_transition);
-			if (x > 0.0f) x = 0.0f;
-			float k2 = 0.5f*(cosf(x*(float)PI) + 1.0f);
-			finalDestParam = &l_paramTransit;
-
-			l_paramTransit.Interpolate(*destParam, *destParam_next, k2);
-		}
 
-		if (finalDestParam->HarmWindow.NonZero())
-		{
-			SymmetricWindow l_destWin;
-			SymmetricWindow *destWin = &l_destWin;
-			if (finalDestParam->HarmWindow.m_halfWidth == tempHalfWinLen)
-				destWin = &finalDestParam->HarmWindow;
-			else
-				l_destWin.Scale(finalDestParam->HarmWindow, tempHalfWinLen);
-			destWin->MergeToBuffer(tempBuf, fTmpWinCenter);
+			grain.hasNoise = finalDestParam->NoiseSpectrum.NonZero();
+			if (grain.hasNoise)
+			{
+				NoiseRandom rng(noiseSeed, grainId);
+				grain.noise.CreateFromAmpSpec_noise(finalDestParam->NoiseSpectrum, tempHalfWinLen, &rng);
+			}
 		}
+	});
 
-		if (finalDestParam->NoiseSpectrum.NonZero())
-		{
-			Window destWin;
-			destWin.CreateFromAmpSpec_noise(finalDestParam->NoiseSpectrum, tempHalfWinLen);
-			destWin.MergeToBuffer(tempBuf, fTmpWinCenter);
-		}
+	for (unsigned grainId = 0; grainId < numGrains; grainId++)
+	{
+		const HNMGrain& grain = grains[grainId];
+		if (grain.hasHarm) grain.harm.MergeToBuffer(tempBuf, grain.center);
+		if (grain.hasNoise) grain.noise.MergeToBuffer(tempBuf, grain.center);
 	}
 
-	phase = (fTmpWinCenter - tempLen) / tempHalfWinLen;
-
 	for (unsigned pos = 0; pos < uSumLen; pos++)
 	{
 		float pos_tmpBuf = stretchingMap[pos];
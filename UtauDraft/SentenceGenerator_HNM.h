@@ -2,13 +2,26 @@
 #define _SentenceGenerator_HNM_h
 
 #include "SentenceGenerator_CPU.h"
+#include "HNMAnalysis.h"
+
+struct HNMAnalysisRange;
 
 class SentenceGenerator_HNM : public SentenceGenerator_CPU
 {
+public:
+	// puts the analyses GenerateSentence() will use into _sourceCache, which must be set.
+	// They don't depend on the lengths or the pitches of the notes
+	void PrefetchAnalyses(const UtauSourceFetcher& srcFetcher, unsigned numPieces, const std::string* lyrics, const unsigned* isVowel);
+
 protected:
 	virtual void GeneratePiece(bool isVowel, unsigned uSumLen, const float* freqMap, float& phase, Buffer& dstBuf, bool firstNote, bool hasNextNote, const SourceInfo& srcInfo, const SourceInfo& srcInfo_next, const SourceDerivedInfo& srcDerInfo);
 
+	// calls func(i) for i in [0, count), the calls are independent of each other
+	virtual void ForEach(unsigned count, const std::function<void(unsigned)>& func);
 
+private:
+	void _analyze(const SourceInfo& srcInfo, const HNMAnalysisRange& range, HNMAnalysis& periods);
+	HNMAnalysis_deferred _fetchAnalysis(const SourceInfo& srcInfo, const HNMAnalysisRange& range);
 };
 
 #endif
@@ -0,0 +1,7 @@
+#include <ThreadPool.h>
+#include "SentenceGenerator_MT.h"
+
+void SentenceGenerator_MT::ForEach(unsigned count, const std::function<void(unsigned)>& func)
+{
+	ThreadPool::Shared().ParallelFor(count, _numThreads, func);
+}
@@ -0,0 +1,23 @@
+#ifndef _SentenceGenerator_MT_h
+#define _SentenceGenerator_MT_h
+
+#include "SentenceGenerator_HNM.h"
+
+/*
+	HNM generator that spreads the analysis of the source periods and the synthesis of
+	the output grains over the threads of ThreadPool::Shared(), which are started once
+	and reused for every note. The grains are still overlap-added in order, and the
+	noise of each grain has its own seed, so the output is identical to SentenceGenerator_HNM.
+*/
+class SentenceGenerator_MT : public SentenceGenerator_HNM
+{
+public:
+	unsigned _numThreads; // 0: all the threads of the pool, one per core
+
+	SentenceGenerator_MT() : _numThreads(0) {}
+
+protected:
+	virtual void ForEach(unsigned count, const std::function<void(unsigned)>& func);
+};
+
+#endif
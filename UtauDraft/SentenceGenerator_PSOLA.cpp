@@ -1,4 +1,34 @@
 #include "SentenceGenerator_PSOLA.h"
+#include "RepitchCache.h"
+
+// source windows of a piece, their samples stored one after another in a single buffer
+class SourceWindowSequence
+{
+public:
+	SourceWindowSequence()
+	{
+		m_offsets.push_back(0);
+	}
+
+	unsigned size() const { return (unsigned)m_halfWidths.size(); }
+
+	void push_back(const SymmetricWindow& win)
+	{
+		m_data.insert(m_data.end(), win.m_data.begin(), win.m_data.end());
+		m_offsets.push_back((unsigned)m_data.size());
+		m_halfWidths.push_back(win.m_halfWidth);
+	}
+
+	void Repitch(unsigned i, SymmetricWindow& dst, float halfWidth) const
+	{
+		dst.Repitch_FormantPreserved(m_data.data() + m_offsets[i], m_offsets[i + 1] - m_offsets[i], m_halfWidths[i], halfWidth);
+	}
+
+private:
+	ScratchVector m_data;
+	std::vector<unsigned> m_offsets;
+	std::vector<float> m_halfWidths;
+};
 
 void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, const float* freqMap, float& phase, Buffer& dstBuf, bool firstNote, bool hasNextNote, const SourceInfo& srcInfo, const SourceInfo& srcInfo_next, const SourceDerivedInfo& srcDerInfo)
 {
@@ -34,13 +64,10 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 	tempBuf.m_data.resize(uTempLen);
 	tempBuf.SetZero();
 
-	class SymmetricWindowWithPosition : public SymmetricWindow
-	{
-	public:
-		float m_pos;
-	};
-
-	std::vector<SymmetricWindowWithPosition> windows;
+	// each window is built in srcSymWin, then its samples are appended to the sequence
+	SymmetricWindow srcSymWin;
+	SourceWindowSequence windows;
+	std::vector<float> windowPos;
 	float fPeriodCount = 0.0f;
 
 	float fStartPos = firstNote ? srcDerInfo.overlap_pos : srcDerInfo.preutter_pos;
@@ -80,12 +107,9 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 			Window srcWin;
 			srcWin.CreateFromBuffer(srcInfo.source, (float)srcPos, srcHalfWinWidth);
 
-			SymmetricWindowWithPosition symWin;
-			symWin.CreateFromAsymmetricWindow(srcWin);
-			symWin.m_pos = logicalPos;
-
-			windows.push_back(symWin);
-
+			srcSymWin.CreateFromAsymmetricWindow(srcWin);
+			windows.push_back(srcSymWin);
+			windowPos.push_back(logicalPos);
 		}
 		fPeriodCount += srcSampleFreq;
 
@@ -103,7 +127,8 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 		}
 	}
 
-	std::vector<SymmetricWindowWithPosition> windows_next;
+	SourceWindowSequence windows_next;
+	std::vector<float> windowPos_next;
 
 	if (hasNextNote)
 	{
@@ -135,11 +160,9 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 				Window srcWin;
 				srcWin.CreateFromBuffer(srcInfo_next.source, (float)srcPos, srcHalfWinWidth);
 
-				SymmetricWindowWithPosition symWin;
-				symWin.CreateFromAsymmetricWindow(srcWin);
-				symWin.m_pos = logicalPos;
-
-				windows_next.push_back(symWin);
+				srcSymWin.CreateFromAsymmetricWindow(srcWin);
+				windows_next.push_back(srcSymWin);
+				windowPos_next.push_back(logicalPos);
 			}
 			fPeriodCount += srcSampleFreq;
 			logicalPos += srcDerInfo.fixed_Weight;
@@ -150,6 +173,8 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 
 	float tempHalfWinLen = 1.0f / minSampleFreq;
 
+	RepitchCache<SymmetricWindow> shiftedWindows;
+
 	unsigned winId0 = 0;
 	unsigned winId0_next = 0;
 	unsigned pos_final = 0;
@@ -168,7 +193,7 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 		bool in_transition = hasNextNote && _transition > 0.0f && _transition < 1.0f && fWinPos >= transitionStart;
 
 		unsigned winId1 = winId0 + 1;
-		while (winId1 < windows.size() && windows[winId1].m_pos < fWinPos)
+		while (winId1 < windows.size() && windowPos[winId1] < fWinPos)
 		{
 			winId0++;
 			winId1 = winId0 + 1;
@@ -179,7 +204,7 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 
 		if (in_transition)
 		{
-			while (winId1_next < windows_next.size() && windows_next[winId1_next].m_pos < fWinPos)
+			while (winId1_next < windows_next.size() && windowPos_next[winId1_next] < fWinPos)
 			{
 				winId0_next++;
 				winId1_next = winId0_next + 1;
@@ -187,28 +212,26 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 			if (winId1_next == windows_next.size()) winId1_next = winId0_next;
 		}
 
-		SymmetricWindowWithPosition& win0 = windows[winId0];
-		SymmetricWindowWithPosition& win1 = windows[winId1];
+		float pos0 = windowPos[winId0];
+		float pos1 = windowPos[winId1];
 
 		float k;
-		if (fWinPos >= win1.m_pos) k = 1.0f;
-		else if (fWinPos <= win0.m_pos) k = 0.0f;
+		if (fWinPos >= pos1) k = 1.0f;
+		else if (fWinPos <= pos0) k = 0.0f;
 		else
 		{
-			k = (fWinPos - win0.m_pos) / (win1.m_pos - win0.m_pos);
+			k = (fWinPos - pos0) / (pos1 - pos0);
 		}
 
 		float destSampleFreq;
 		destSampleFreq = freqMap[pos_final];
 		float destHalfWinLen = powf(2.0f, _gender) / destSampleFreq;
 
-		SymmetricWindow shiftedWin0;
-		SymmetricWindow shiftedWin1;
-
 		SymmetricWindow l_win;
-		SymmetricWindow* destWin = &l_win;
+		const SymmetricWindow* destWin = &l_win;
 
-		shiftedWin0.Repitch_FormantPreserved(win0, destHalfWinLen);
+		const SymmetricWindow& shiftedWin0 = shiftedWindows.Get(&windows, winId0, destHalfWinLen,
+			[&windows, winId0](SymmetricWindow& dst, float halfWidth) { windows.Repitch(winId0, dst, halfWidth); });
 
 		if (winId0 == winId1)
 		{
@@ -216,33 +239,32 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 		}
 		else
 		{
-			shiftedWin1.Repitch_FormantPreserved(win1, destHalfWinLen);
+			const SymmetricWindow& shiftedWin1 = shiftedWindows.Get(&windows, winId1, destHalfWinLen,
+				[&windows, winId1](SymmetricWindow& dst, float halfWidth) { windows.Repitch(winId1, dst, halfWidth); });
 			l_win.Interpolate(shiftedWin0, shiftedWin1, k, destHalfWinLen);
 		}
 
-		SymmetricWindow *win_final_dest = destWin;
+		const SymmetricWindow *win_final_dest = destWin;
 		SymmetricWindow l_win_transit;
 
 		if (in_transition)
 		{
-			SymmetricWindowWithPosition& win0_next = windows_next[winId0_next];
-			SymmetricWindowWithPosition& win1_next = windows_next[winId1_next];
+			float pos0_next = windowPos_next[winId0_next];
+			float pos1_next = windowPos_next[winId1_next];
 
 			float k;
-			if (fWinPos >= win1_next.m_pos) k = 1.0f;
-			else if (fWinPos <= win0_next.m_pos) k = 0.0f;
+			if (fWinPos >= pos1_next) k = 1.0f;
+			else if (fWinPos <= pos0_next) k = 0.0f;
 			else
 			{
-				k = (fWinPos - win0_next.m_pos) / (win1_next.m_pos - win0_next.m_pos);
+				k = (fWinPos - pos0_next) / (pos1_next - pos0_next);
 			}
 
-			SymmetricWindow shiftedWin0_next;
-			SymmetricWindow shiftedWin1_next;
-
 			SymmetricWindow l_win_next;
-			SymmetricWindow* destWin_next = &l_win_next;
+			const SymmetricWindow* destWin_next = &l_win_next;
 
-			shiftedWin0_next.Repitch_FormantPreserved(win0_next, destHalfWinLen);
+			const SymmetricWindow& shiftedWin0_next = shiftedWindows.Get(&windows_next, winId0_next, destHalfWinLen,
+				[&windows_next, winId0_next](SymmetricWindow& dst, float halfWidth) { windows_next.Repitch(winId0_next, dst, halfWidth); });
 
 			if (winId0_next == winId1_next)
 			{
@@ -250,7 +272,8 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 			}
 			else
 			{
-				shiftedWin1_next.Repitch_FormantPreserved(win1_next, destHalfWinLen);
+				const SymmetricWindow& shiftedWin1_next = shiftedWindows.Get(&windows_next, winId1_next, destHalfWinLen,
+					[&windows_next, winId1_next](SymmetricWindow& dst, float halfWidth) { windows_next.Repitch(winId1_next, dst, halfWidth); });
 				l_win_next.Interpolate(shiftedWin0_next, shiftedWin1_next, k, destHalfWinLen);
 			}
 
@@ -263,7 +286,7 @@ void SentenceGenerator_PSOLA::GeneratePiece(bool isVowel, unsigned uSumLen, cons
 		}
 
 		SymmetricWindow l_win2;
-		SymmetricWindow *winToMerge = &l_win2;
+		const SymmetricWindow *winToMerge = &l_win2;
 
 		if (destHalfWinLen == tempHalfWinLen)
 		{
@@ -15,11 +15,15 @@
 #include <ReadWav.h>
 #include <float.h>
 #include <memory.h>
+#include <unordered_set>
+#include <thread>
 
 #include "PrefixMap.h"
 #include "UtauDraft.h"
 #include "SentenceGenerator_PSOLA.h"
 #include "SentenceGenerator_HNM.h"
+#include "SentenceGenerator_MT.h"
+#include "ParallelFor.h"
 
 #ifdef HAVE_CUDA
 #include "SentenceGenerator_CUDA.h"
@@ -28,21 +32,13 @@
 bool UtauSourceFetcher::ReadWavLocToBuffer(VoiceLocation loc, Buffer& buf, float& begin, float& end)
 {
 	Buffer whole;
-	float maxV;
-	if (!ReadWavToBuffer(loc.filename.data(), whole, maxV)) return false;
-
-	float acc = 0.0f;
-	float count = 0.0f;
-	for (unsigned i = 0; i < whole.m_data.size(); i++)
-	{
-		acc += whole.m_data[i] * whole.m_data[i];
-		if (whole.m_data[i] != 0.0f)
-		{
-			count += 1.0f;
-		}
-	}
-	acc = sqrtf(count / acc)*0.3f;
+	if (!UtauSourceCache::ReadNormalizedWav(loc.filename.data(), whole)) return false;
+	CutWavLoc(whole, loc, buf, begin, end);
+	return true;
+}
 
+void UtauSourceFetcher::CutWavLoc(const Buffer& whole, VoiceLocation loc, Buffer& buf, float& begin, float& end)
+{
 	begin = loc.offset*(float)whole.m_sampleRate*0.001f;
 	if (loc.cutoff > 0.0f)
 		end = (float)whole.m_data.size() - loc.cutoff*(float)whole.m_sampleRate*0.001f;
@@ -56,13 +52,45 @@ bool UtauSourceFetcher::ReadWavLocToBuffer(VoiceLocation loc, Buffer& buf, float
 	buf.m_data.resize(uEnd - uBegin);
 
 	for (unsigned i = uBegin; i < uEnd; i++)
-		buf.m_data[i - uBegin] = (i<whole.m_data.size())? (whole.m_data[i] * acc) : 0.0f;
+		buf.m_data[i - uBegin] = (i<whole.m_data.size())? whole.m_data[i] : 0.0f;
+}
+
+bool UtauSourceFetcher::FetchPackedSourceInfo(const char* lyric, SourceInfo& srcInfo, float constVC) const
+{
+	int id = m_PackedBank->Find(lyric);
+	if (id < 0)
+	{
+		printf("missied lyic: %s\n", lyric);
+		id = m_PackedBank->Find(m_defaultLyric.data());
+		if (id < 0) return false;
+	}
+
+	const PackedBankEntry& entry = m_PackedBank->Entry((unsigned)id);
+
+	VoiceLocation& loc = srcInfo.loc;
+	m_PackedBank->GetLocation((unsigned)id, loc);
+	if (constVC > 0.0f && loc.consonant - loc.preutterance > constVC)
+		loc.consonant = loc.preutterance + constVC;
+
+	m_PackedBank->GetFrq((unsigned)id, srcInfo.frq);
+
+	const float* samples = m_PackedBank->Samples((unsigned)id);
+	srcInfo.source.m_sampleRate = entry.sampleRate;
+	srcInfo.source.m_data.assign(samples, samples + entry.numSamples);
+	srcInfo.srcbegin = entry.srcbegin;
+	srcInfo.srcend = entry.srcend;
+
+	if (m_SourceCache != nullptr)
+		srcInfo.stamp = m_PackedBank->Stamp();
 
 	return true;
 }
 
 bool UtauSourceFetcher::FetchSourceInfo(const char* lyric, SourceInfo& srcInfo, float constVC) const
 {
+	if (m_PackedBank != nullptr)
+		return FetchPackedSourceInfo(lyric, srcInfo, constVC);
+
 	if (m_OtoMap->find(lyric) == m_OtoMap->end())
 	{
 		printf("missied lyic: %s\n", lyric);
@@ -86,16 +114,41 @@ bool UtauSourceFetcher::FetchSourceInfo(const char* lyric, SourceInfo& srcInfo,
 		memcpy(frq_path, loc.filename.data(), loc.filename.length() - 4);
 		memcpy(frq_path + loc.filename.length() - 4, "_wav.frq", strlen("_wav.frq") + 1);
 
-		if (!frq.ReadFromFile(frq_path))
+		if (m_SourceCache != nullptr)
 		{
-			printf("%s not found.\n", frq_path);
-			return false;
-		}
+			FrqData_deferred cachedFrq;
+			std::string frqStamp;
+			if (!m_SourceCache->GetFrq(frq_path, cachedFrq, &frqStamp))
+			{
+				printf("%s not found.\n", frq_path);
+				return false;
+			}
+			frq = *cachedFrq;
 
-		if (!ReadWavLocToBuffer(loc, source, srcbegin, srcend))
+			Buffer_deferred whole;
+			std::string wavStamp;
+			if (!m_SourceCache->GetWav(loc.filename, whole, &wavStamp))
+			{
+				printf("%s not found.\n", loc.filename.data());
+				return false;
+			}
+			CutWavLoc(*whole, loc, source, srcbegin, srcend);
+
+			srcInfo.stamp = wavStamp + "|" + frqStamp;
+		}
+		else
 		{
-			printf("%s not found.\n", loc.filename.data());
-			return false;
+			if (!frq.ReadFromFile(frq_path))
+			{
+				printf("%s not found.\n", frq_path);
+				return false;
+			}
+
+			if (!ReadWavLocToBuffer(loc, source, srcbegin, srcend))
+			{
+				printf("%s not found.\n", loc.filename.data());
+				return false;
+			}
 		}
 	}
 
@@ -154,101 +207,342 @@ void SourceDerivedInfo::DeriveInfo(bool firstNote, bool hasNext, unsigned uSumLe
 
 };
 
+bool ResolvedSentences::Reserve(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Entry& entry = m_entries[key];
+	return entry.jobs++ == 0;
+}
+
+void ResolvedSentences::Release(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::unordered_map<std::string, Entry>::iterator iter = m_entries.find(key);
+	if (iter != m_entries.end() && --iter->second.jobs == 0)
+		m_entries.erase(iter);
+}
+
+void ResolvedSentences::SetResolved(const std::string& key, const SingingPieceInternalList& pieceList)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry& entry = m_entries[key];
+		entry.singing = pieceList;
+		entry.resolved = true;
+	}
+	m_resolvedCond.notify_all();
+}
+
+void ResolvedSentences::SetResolved(const std::string& key, const RapPieceInternalList& pieceList)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry& entry = m_entries[key];
+		entry.rap = pieceList;
+		entry.resolved = true;
+	}
+	m_resolvedCond.notify_all();
+}
+
+// the entry is looked up again after each wake-up, as its jobs may have ended meanwhile
+ResolvedSentences::Entry* ResolvedSentences::_wait(std::unique_lock<std::mutex>& lock, const std::string& key)
+{
+	std::unordered_map<std::string, Entry>::iterator iter;
+	m_resolvedCond.wait(lock, [&]()
+	{
+		iter = m_entries.find(key);
+		return iter == m_entries.end() || iter->second.resolved;
+	});
+	return iter != m_entries.end() ? &iter->second : nullptr;
+}
+
+bool ResolvedSentences::Find(const std::string& key, SingingPieceInternalList& pieceList)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	Entry* entry = _wait(lock, key);
+	if (entry == nullptr) return false;
+	pieceList = entry->singing;
+	return true;
+}
+
+bool ResolvedSentences::Find(const std::string& key, RapPieceInternalList& pieceList)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	Entry* entry = _wait(lock, key);
+	if (entry == nullptr) return false;
+	pieceList = entry->rap;
+	return true;
+}
+
+// everything _resolveLyrics() depends on. The converter is identified by its address,
+// which stays unique while the state of a job keeps it alive
+static std::string SentenceKey(const SingingPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
+{
+	char buf[128];
+	sprintf(buf, "sing|%p|%d|%a", (const void*)(const UtauLyricConverter*)params.lyricConverter, params.use_prefix_map ? 1 : 0, sampleRate);
+	std::string key = buf;
+	for (size_t j = 0; j < pieceList.size(); j++)
+	{
+		const SingingPieceInternal& piece = *pieceList[j];
+		sprintf(buf, "|%u:", (unsigned)piece.lyric.length());
+		key += buf;
+		key += piece.lyric;
+		key += piece.isVowel ? ":1" : ":0";
+		for (size_t i = 0; i < piece.notes.size(); i++)
+		{
+			sprintf(buf, ":%a,%a", piece.notes[i].fNumOfSamples, piece.notes[i].sampleFreq);
+			key += buf;
+		}
+	}
+	return key;
+}
+
+static std::string SentenceKey(const RapPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
+{
+	char buf[128];
+	sprintf(buf, "rap|%p|%d|%a", (const void*)(const UtauLyricConverter*)params.lyricConverter, params.use_prefix_map ? 1 : 0, sampleRate);
+	std::string key = buf;
+	for (size_t j = 0; j < pieceList.size(); j++)
+	{
+		const RapPieceInternal& piece = *pieceList[j];
+		sprintf(buf, "|%u:", (unsigned)piece.lyric.length());
+		key += buf;
+		key += piece.lyric;
+		sprintf(buf, ":%d:%a,%a,%a", piece.isVowel ? 1 : 0, piece.fNumOfSamples, piece.sampleFreq1, piece.sampleFreq2);
+		key += buf;
+	}
+	return key;
+}
+
+// a sentence of a prefetch job
+template <class PieceList>
+struct PrefetchSentence
+{
+	PieceList pieceList;
+	TuneState state;
+	std::string key;
+	bool resolve; // whether this job resolves its lyrics
+};
+
+// the sentences of a call, resolved and loaded on a thread of their own
+class UtauDraftPrefetch : public SingerPrefetch
+{
+public:
+	ResolvedSentences* resolvedSentences;
+	float sampleRate;
+	std::vector<PrefetchSentence<SingingPieceInternalList>> singing;
+	std::vector<PrefetchSentence<RapPieceInternalList>> raps;
+	std::thread thread;
+
+	UtauDraftPrefetch() : resolvedSentences(nullptr), sampleRate(0.0f) {}
+	~UtauDraftPrefetch()
+	{
+		if (thread.joinable()) thread.join();
+		for (size_t i = 0; i < singing.size(); i++)
+			resolvedSentences->Release(singing[i].key);
+		for (size_t i = 0; i < raps.size(); i++)
+			resolvedSentences->Release(raps[i].key);
+	}
+};
+
+UtauLyricConverter::~UtauLyricConverter()
+{
+	delete native;
+	if (python != nullptr && Py_IsInitialized())
+	{
+		PyGILState_STATE gstate = PyGILState_Ensure();
+		Py_DECREF(python);
+		PyGILState_Release(gstate);
+	}
+}
+
 UtauDraft::UtauDraft(bool useCUDA)
 {
 	m_use_CUDA = useCUDA;
+	m_tuneExtension = TuneStateExtension_Deferred::Instance<UtauDraftTuneState>();
 
-	m_transition = 0.1f;
-	m_rap_distortion = 1.0f;
-	m_gender = 0.0f;
-	m_constVC = -1.0f;
-	m_LyricConverter = nullptr;
-
-	m_use_prefix_map = true;
 	m_PrefixMap = nullptr;
 
+	m_SourceCache = nullptr;
+
+	m_OtoMap = nullptr;
+	m_PackedBank = nullptr;
 }
 
 UtauDraft::~UtauDraft()
 {
-	if (m_LyricConverter) Py_DECREF(m_LyricConverter);
+
 }
 
 void UtauDraft::SetOtoMap(OtoMap* otoMap)
 {
 	m_OtoMap = otoMap;
+	m_PackedBank = nullptr;
 	m_defaultLyric = m_OtoMap->begin()->first;
 }
 
+void UtauDraft::SetPackedBank(const PackedBank* packedBank)
+{
+	m_OtoMap = nullptr;
+	m_PackedBank = packedBank;
+	m_defaultLyric = m_PackedBank->Lyric(0);
+}
+
 void UtauDraft::SetPrefixMap(PrefixMap* prefixMap)
 {
 	m_PrefixMap = prefixMap;
 }
 
+void UtauDraft::SetSourceCache(UtauSourceCache* sourceCache)
+{
+	m_SourceCache = sourceCache;
+}
+
 void UtauDraft::SetCharset(const char* charset)
 {
 	m_lyric_charset = charset;
 }
 
+const UtauDraftTuneState& UtauDraft::_tuneParams(const TuneState& state)
+{
+	static const UtauDraftTuneState s_defaults;
+	const UtauDraftTuneState* params = dynamic_cast<const UtauDraftTuneState*>((const TuneStateExtension*)state.extension);
+	return params != nullptr ? *params : s_defaults;
+}
+
+// the calls rendering with the old converter keep it until they're done
+void UtauDraft::_setLyricConverter(const UtauLyricConverter_Deferred& converter)
+{
+	TuneStateExtension_Deferred extension = TuneStateExtension_Deferred::Instance<UtauDraftTuneState>();
+	UtauDraftTuneState& params = *extension.DownCast<UtauDraftTuneState>();
+	params = _tuneParams(GetTuneState());
+	params.lyricConverter = converter;
+	m_tuneExtension = extension;
+}
+
 void UtauDraft::SetLyricConverter(PyObject* lyricConverter)
 {
-	if (m_LyricConverter != nullptr) Py_DECREF(m_LyricConverter);
-	m_LyricConverter = lyricConverter;
-	if (m_LyricConverter != nullptr) Py_INCREF(m_LyricConverter);
+	UtauLyricConverter_Deferred converter;
+	converter->python = lyricConverter;
+	if (lyricConverter != nullptr) Py_INCREF(lyricConverter);
+	_setLyricConverter(converter);
 }
 
-bool UtauDraft::Tune(const char* cmd)
+// converts the UTF-8 strings of the converter tables to the lyric charset, called with the GIL
+static std::string EncodeLyric(const char* utf8, const char* charset)
 {
-	if (!Singer::Tune(cmd))
+	std::string ret = utf8;
+	PyObject* unicode = PyUnicode_FromString(utf8);
+	PyObject* byteCode = unicode != nullptr ? PyUnicode_AsEncodedString(unicode, charset, 0) : nullptr;
+	if (byteCode != nullptr)
+		ret = PyBytes_AS_STRING(byteCode);
+	else
+		PyErr_Clear();
+	Py_XDECREF(byteCode);
+	Py_XDECREF(unicode);
+	return ret;
+}
+
+bool UtauDraft::SetNativeLyricConverter(const char* name)
+{
+	std::vector<std::string> bankLyrics;
+	if (m_PackedBank != nullptr)
+	{
+		for (unsigned i = 0; i < m_PackedBank->NumberOfEntries(); i++)
+			bankLyrics.push_back(m_PackedBank->Lyric(i));
+	}
+	else if (m_OtoMap != nullptr)
 	{
-		char command[1024];
-		sscanf(cmd, "%s", command);
+		OtoMap::const_iterator iter;
+		for (iter = m_OtoMap->begin(); iter != m_OtoMap->end(); iter++)
+			bankLyrics.push_back(iter->first);
+	}
 
-		if (strcmp(command, "rap_distortion") == 0)
-		{
-			float value;
-			if (sscanf(cmd + strlen("rap_distortion") + 1, "%f", &value))
-				m_rap_distortion = value;
-			return true;
-		}
-		else if (strcmp(command, "transition") == 0)
-		{
-			float value;
-			if (sscanf(cmd + strlen("transition") + 1, "%f", &value))
-				m_transition = value;
-		}
-		else if (strcmp(command, "prefix_map") == 0)
+	std::string charset = m_lyric_charset;
+	LyricConverter* converter = LyricConverter::Create(name, bankLyrics, [&charset](const char* utf8)
+	{
+		return EncodeLyric(utf8, charset.data());
+	});
+	if (converter == nullptr) return false;
+
+	UtauLyricConverter_Deferred holder;
+	holder->native = converter;
+	_setLyricConverter(holder);
+	return true;
+}
+
+bool UtauDraft::TuneExtension(const char* cmd, TuneState& state)
+{
+	TuneStateExtension_Deferred extension = TuneStateExtension_Deferred::Instance<UtauDraftTuneState>();
+	UtauDraftTuneState& params = *extension.DownCast<UtauDraftTuneState>();
+	params = _tuneParams(state);
+
+	char command[1024];
+	sscanf(cmd, "%s", command);
+
+	if (strcmp(command, "rap_distortion") == 0)
+	{
+		float value;
+		if (sscanf(cmd + strlen("rap_distortion") + 1, "%f", &value))
+			params.rap_distortion = value;
+	}
+	else if (strcmp(command, "transition") == 0)
+	{
+		float value;
+		if (sscanf(cmd + strlen("transition") + 1, "%f", &value))
+			params.transition = value;
+	}
+	else if (strcmp(command, "prefix_map") == 0)
+	{
+		char value[100];
+		if (sscanf(cmd + strlen("prefix_map") + 1, "%s", value))
 		{
-			char value[100];
-			if (sscanf(cmd + strlen("prefix_map") + 1, "%s", value))
+			if (strcmp(value, "on") == 0)
 			{
-				if (strcmp(value, "on") == 0)
-				{
-					m_use_prefix_map = true;
-				}
-				if (strcmp(value, "off") == 0)
-				{
-					m_use_prefix_map = false;
-				}
+				params.use_prefix_map = true;
+			}
+			if (strcmp(value, "off") == 0)
+			{
+				params.use_prefix_map = false;
 			}
 		}
-		else if (strcmp(command, "gender") == 0)
-		{
-			float value;
-			if (sscanf(cmd + strlen("gender") + 1, "%f", &value))
-				m_gender = value;
-		}
-		else if (strcmp(command, "constvc") == 0)
+	}
+	else if (strcmp(command, "gender") == 0)
+	{
+		float value;
+		if (sscanf(cmd + strlen("gender") + 1, "%f", &value))
+			params.gender = value;
+	}
+	else if (strcmp(command, "constvc") == 0)
+	{
+		float value;
+		if (sscanf(cmd + strlen("constvc") + 1, "%f", &value))
+			params.constVC = value;
+	}
+	else if (strcmp(command, "engine") == 0)
+	{
+		char value[100];
+		if (sscanf(cmd + strlen("engine") + 1, "%s", value))
 		{
-			float value;
-			if (sscanf(cmd + strlen("constvc") + 1, "%f", &value))
-				m_constVC = value;
+			if (strcmp(value, "mt") == 0)
+			{
+				params.use_MT = true;
+			}
+			if (strcmp(value, "hnm") == 0)
+			{
+				params.use_MT = false;
+			}
 		}
 	}
-	return false;
+	else
+	{
+		return false;
+	}
+	state.extension = extension;
+	return true;
 }
 
-SentenceGenerator* UtauDraft::createSentenceGenerator()
+SentenceGenerator* UtauDraft::createSentenceGenerator(const UtauDraftTuneState& params)
 {
 	SentenceGenerator* sg;
 
@@ -259,31 +553,37 @@ SentenceGenerator* UtauDraft::createSentenceGenerator()
 	}
 	else
 #endif
+	if (params.use_MT)
+	{
+		sg = new SentenceGenerator_MT;
+	}
+	else
 	{
 		sg = new SentenceGenerator_HNM;
 	}
-	sg->_gender = m_gender;
-	sg->_transition = m_transition;
-	sg->_constVC = m_constVC;
+	sg->_gender = params.gender;
+	sg->_transition = params.transition;
+	sg->_constVC = params.constVC;
+	sg->_sourceCache = m_SourceCache;
 	return sg;
 }
 
-void UtauDraft::GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf)
+void UtauDraft::GenerateWave(SingingPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf)
 {
 	SingingPieceInternal_Deferred dPiece;
 	*dPiece = piece;
 	SingingPieceInternalList pieceList;
-	pieceList.push_back(dPiece);
-	GenerateWave_SingConsecutive(pieceList, noteBuf);
+	pieceList.push_back(std::move(dPiece));
+	GenerateWave_SingConsecutive(pieceList, state, noteBuf);
 }
 
-void UtauDraft::GenerateWave_Rap(RapPieceInternal piece, NoteBuffer* noteBuf)
+void UtauDraft::GenerateWave_Rap(RapPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf)
 {
 	RapPieceInternal_Deferred dPiece;
 	*dPiece = piece;
 	RapPieceInternalList pieceList;
-	pieceList.push_back(dPiece);
-	GenerateWave_RapConsecutive(pieceList, noteBuf);
+	pieceList.push_back(std::move(dPiece));
+	GenerateWave_RapConsecutive(pieceList, state, noteBuf);
 }
 
 void UtauDraft::_floatBufSmooth(float* buf, unsigned size)
@@ -326,14 +626,15 @@ void UtauDraft::_floatBufSmooth(float* buf, unsigned size)
 	delete[] buf2;
 }
 
-void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, NoteBuffer* noteBuf)
+void UtauDraft::_resolveLyrics(SingingPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
 {
-	if (m_LyricConverter != nullptr)
+	const UtauLyricConverter& converter = *params.lyricConverter;
+	if (converter.python != nullptr || converter.native != nullptr)
 	{
-		pieceList = _convertLyric_singing(pieceList);
+		pieceList = _convertLyric_singing(converter, pieceList);
 	}	
 
-	if (m_PrefixMap != nullptr && m_use_prefix_map)
+	if (m_PrefixMap != nullptr && params.use_prefix_map)
 	{
 		for (unsigned j = 0; j < pieceList.size(); j++)
 		{
@@ -351,11 +652,11 @@ void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList,
 			if (sumLen > 0.0f)
 			{
 				aveFreq /= sumLen;
-				aveFreq *= noteBuf->m_sampleRate;
+				aveFreq *= sampleRate;
 			}
 			else
 			{
-				aveFreq = piece.notes[0].sampleFreq *noteBuf->m_sampleRate;
+				aveFreq = piece.notes[0].sampleFreq *sampleRate;
 			}
 			std::string prefix = m_PrefixMap->GetPrefixFromFreq(aveFreq);
 
@@ -364,13 +665,25 @@ void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList,
 		}
 
 	}
+}
+
+void UtauDraft::_getResolvedLyrics(SingingPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
+{
+	if (!m_resolvedSentences.Find(SentenceKey(pieceList, sampleRate, params), pieceList))
+		_resolveLyrics(pieceList, sampleRate, params);
+}
+
+void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf)
+{
+	const UtauDraftTuneState& params = _tuneParams(state);
+	_getResolvedLyrics(pieceList, noteBuf->m_sampleRate, params);
 
 	std::vector<unsigned> lens;
 	lens.resize(pieceList.size());
 	float sumAllLen=0.0f;
 	unsigned uSumAllLen;
 
-	float firstNoteHead = this->getFirstNoteHeadSamples(pieceList[0]->lyric.data());
+	float firstNoteHead = this->getFirstNoteHeadSamples(pieceList[0]->lyric.data(), state.defaultLyric);
 		
 	for (unsigned j = 0; j < pieceList.size(); j++)
 	{
@@ -440,9 +753,11 @@ void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList,
 
 	UtauSourceFetcher srcFetcher;
 	srcFetcher.m_OtoMap = m_OtoMap;
-	srcFetcher.m_defaultLyric = m_defaultLyric;
+	srcFetcher.m_PackedBank = m_PackedBank;
+	srcFetcher.m_defaultLyric = state.defaultLyric;
+	srcFetcher.m_SourceCache = m_SourceCache;
 
-	SentenceGenerator* sg = createSentenceGenerator();
+	SentenceGenerator* sg = createSentenceGenerator(params);
 	sg->GenerateSentence(srcFetcher, numPieces, lyrics.data(), isVowel.data(), lens.data(), freqAllMap, noteBuf);
 	releasSentenceGenerator(sg);
 
@@ -457,31 +772,44 @@ void UtauDraft::GenerateWave_SingConsecutive(SingingPieceInternalList pieceList,
 	}
 }
 
-void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuffer* noteBuf)
+void UtauDraft::_resolveLyrics(RapPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
 {
-	if (m_LyricConverter != nullptr)
+	const UtauLyricConverter& converter = *params.lyricConverter;
+	if (converter.python != nullptr || converter.native != nullptr)
 	{
-		pieceList = _convertLyric_rap(pieceList);
+		pieceList = _convertLyric_rap(converter, pieceList);
 	}
 
-	if (m_PrefixMap != nullptr && m_use_prefix_map)
+	if (m_PrefixMap != nullptr && params.use_prefix_map)
 	{
 		for (unsigned j = 0; j < pieceList.size(); j++)
 		{
 			RapPieceInternal& piece = *pieceList[j];
 			float aveFreq = (piece.sampleFreq1 + piece.sampleFreq2)*0.5f;
-			aveFreq *= noteBuf->m_sampleRate;
+			aveFreq *= sampleRate;
 			std::string prefix = m_PrefixMap->GetPrefixFromFreq(aveFreq);
 			piece.lyric += prefix;
 		}
 	}
+}
+
+void UtauDraft::_getResolvedLyrics(RapPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params)
+{
+	if (!m_resolvedSentences.Find(SentenceKey(pieceList, sampleRate, params), pieceList))
+		_resolveLyrics(pieceList, sampleRate, params);
+}
+
+void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf)
+{
+	const UtauDraftTuneState& params = _tuneParams(state);
+	_getResolvedLyrics(pieceList, noteBuf->m_sampleRate, params);
 
 	std::vector<unsigned> lens;
 	lens.resize(pieceList.size());
 	float sumAllLen = 0.0f;
 	unsigned uSumAllLen;
 
-	float firstNoteHead = this->getFirstNoteHeadSamples(pieceList[0]->lyric.data());
+	float firstNoteHead = this->getFirstNoteHeadSamples(pieceList[0]->lyric.data(), state.defaultLyric);
 
 	for (unsigned j = 0; j < pieceList.size(); j++)
 	{
@@ -535,9 +863,11 @@ void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, Note
 
 	UtauSourceFetcher srcFetcher;
 	srcFetcher.m_OtoMap = m_OtoMap;
-	srcFetcher.m_defaultLyric = m_defaultLyric;
+	srcFetcher.m_PackedBank = m_PackedBank;
+	srcFetcher.m_defaultLyric = state.defaultLyric;
+	srcFetcher.m_SourceCache = m_SourceCache;
 
-	SentenceGenerator* sg = createSentenceGenerator();
+	SentenceGenerator* sg = createSentenceGenerator(params);
 	sg->GenerateSentence(srcFetcher, numPieces, lyrics.data(), isVowel.data(), lens.data(), freqAllMap, noteBuf);
 	releasSentenceGenerator(sg);
 
@@ -553,7 +883,7 @@ void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, Note
 
 
 	/// Distortion 
-	if (m_rap_distortion > 1.0f)
+	if (params.rap_distortion > 1.0f)
 	{
 		float maxV = 0.0f;
 		for (unsigned pos = 0; pos < uSumAllLen; pos++)
@@ -565,7 +895,7 @@ void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, Note
 		for (unsigned pos = 0; pos < uSumAllLen; pos++)
 		{
 			float v = noteBuf->m_data[pos];
-			v *= m_rap_distortion;
+			v *= params.rap_distortion;
 			if (v > maxV) v = maxV;
 			if (v < -maxV) v = -maxV;
 			noteBuf->m_data[pos] = v;
@@ -574,50 +904,100 @@ void UtauDraft::GenerateWave_RapConsecutive(RapPieceInternalList pieceList, Note
 
 }
 
-SingingPieceInternalList UtauDraft::_convertLyric_singing(SingingPieceInternalList pieceList)
+bool UtauDraft::_convertLyrics(const UtauLyricConverter& converter, const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& syllables)
 {
-	PyObject* lyricList=PyList_New(0);
-	for (unsigned i = 0; i < (unsigned)pieceList.size(); i++)
+	if (converter.native != nullptr)
 	{
-		PyObject *byteCode = PyBytes_FromString(pieceList[i]->lyric.data());
-		PyList_Append(lyricList, PyUnicode_FromEncodedObject(byteCode, m_lyric_charset.data(), 0));
+		converter.native->Convert(lyrics, syllables);
+		return true;
 	}
-	PyObject* args = PyTuple_Pack(1, lyricList);
-	PyObject* rets = PyObject_CallObject(m_LyricConverter, args);
 
-	SingingPieceInternalList list_converted;
-	for (unsigned i = 0; i < (unsigned)pieceList.size(); i++)
+	// rendering runs without the GIL
+	PyGILState_STATE gstate = PyGILState_Ensure();
+
+	PyObject* lyricList = PyList_New(0);
+	bool ok = true;
+	for (unsigned i = 0; ok && i < (unsigned)lyrics.size(); i++)
 	{
-		PyObject* tuple = PyList_GetItem(rets, i);
-		unsigned count = (unsigned)PyTuple_Size(tuple);
+		PyObject* lyric = PyUnicode_Decode(lyrics[i].data(), (Py_ssize_t)lyrics[i].length(), m_lyric_charset.data(), 0);
+		ok = lyric != nullptr && PyList_Append(lyricList, lyric) == 0;
+		Py_XDECREF(lyric);
+	}
+	PyObject* rets = ok ? PyObject_CallFunctionObjArgs(converter.python, lyricList, nullptr) : nullptr;
+	Py_DECREF(lyricList);
+
+	if (rets == nullptr || !PyList_Check(rets) || PyList_Size(rets) < (Py_ssize_t)lyrics.size())
+	{
+		if (PyErr_Occurred()) PyErr_Print();
+		printf("Lyric conversion failed, lyrics kept unconverted.\n");
+		Py_XDECREF(rets);
+		PyGILState_Release(gstate);
+		return false;
+	}
 
-		std::vector<std::string> lyrics;
-		std::vector<float> weights;
-		std::vector<bool> isVowels;
+	syllables.resize(lyrics.size());
+	for (unsigned i = 0; i < (unsigned)lyrics.size(); i++)
+	{
+		ConvertedSyllable& syllable = syllables[i];
+		syllable.clear();
 
-		float sum_weight = 0.0f;
-		for (unsigned j = 0; j < count; j+=3)
+		PyObject* tuple = PyList_GetItem(rets, i);
+		unsigned count = PyTuple_Check(tuple) ? (unsigned)PyTuple_Size(tuple) : 0;
+		for (unsigned j = 0; j < count; j += 3)
 		{
 			PyObject *byteCode = PyUnicode_AsEncodedString(PyTuple_GetItem(tuple, j), m_lyric_charset.data(), 0);
-			std::string lyric = PyBytes_AS_STRING(byteCode);
-			lyrics.push_back(lyric);
+			if (byteCode == nullptr)
+			{
+				PyErr_Clear();
+				continue;
+			}
+
+			ConvertedLyric converted;
+			converted.lyric = PyBytes_AS_STRING(byteCode);
+			Py_DECREF(byteCode);
 
-			float weight=1.0f;
+			converted.weight = 1.0f;
 			if (j + 1 < count)
 			{
-				weight = (float)PyFloat_AsDouble(PyTuple_GetItem(tuple, j + 1));
+				converted.weight = (float)PyFloat_AsDouble(PyTuple_GetItem(tuple, j + 1));
 			}
-			weights.push_back(weight);
-				
-			sum_weight += weight;
 
-			bool isVowel = true;
+			converted.isVowel = true;
 			if (j + 2 < count)
 			{
-				isVowel = PyObject_IsTrue(PyTuple_GetItem(tuple, j + 2)) !=0 ;
+				converted.isVowel = PyObject_IsTrue(PyTuple_GetItem(tuple, j + 2)) != 0;
 			}
-			isVowels.push_back(isVowel);
-		}	
+			syllable.push_back(converted);
+		}
+	}
+	Py_DECREF(rets);
+
+	PyGILState_Release(gstate);
+	return true;
+}
+
+SingingPieceInternalList UtauDraft::_convertLyric_singing(const UtauLyricConverter& converter, SingingPieceInternalList pieceList)
+{
+	std::vector<std::string> inputLyrics(pieceList.size());
+	for (unsigned i = 0; i < (unsigned)pieceList.size(); i++)
+		inputLyrics[i] = pieceList[i]->lyric;
+
+	std::vector<ConvertedSyllable> syllables;
+	if (!_convertLyrics(converter, inputLyrics, syllables)) return pieceList;
+
+	SingingPieceInternalList list_converted;
+	for (unsigned i = 0; i < (unsigned)pieceList.size(); i++)
+	{
+		const ConvertedSyllable& syllable = syllables[i];
+		if (syllable.size() == 0)
+		{
+			list_converted.push_back(pieceList[i]);
+			continue;
+		}
+
+		float sum_weight = 0.0f;
+		for (unsigned j = 0; j < (unsigned)syllable.size(); j++)
+			sum_weight += syllable[j].weight;
 
 		SingingPieceInternal_Deferred piece = pieceList[i];
 
@@ -632,16 +1012,14 @@ SingingPieceInternalList UtauDraft::_convertLyric_singing(SingingPieceInternalLi
 		unsigned i_note = 0;
 		float noteStartPos = 0.0f;
 
-		for (unsigned j = 0; j < lyrics.size(); j++)
+		for (unsigned j = 0; j < (unsigned)syllable.size(); j++)
 		{
-			float weight = weights[j] / sum_weight;
+			float weight = syllable[j].weight / sum_weight;
 			float endPos = startPos + weight* totalNumSamples;
 
-			bool isVowel = isVowels[j];
-				
 			SingingPieceInternal_Deferred newPiece;
-			newPiece->lyric = lyrics[j];
-			newPiece->isVowel = isVowel;
+			newPiece->lyric = syllable[j].lyric;
+			newPiece->isVowel = syllable[j].isVowel;
 
 			while (endPos > noteStartPos || newPiece->notes.size()==0)
 			{
@@ -666,73 +1044,50 @@ SingingPieceInternalList UtauDraft::_convertLyric_singing(SingingPieceInternalLi
 				
 			i_note--;
 			noteStartPos -= piece->notes[i_note].fNumOfSamples;
-			list_converted.push_back(newPiece);
+			list_converted.push_back(std::move(newPiece));
 		}		
 	}
 
 	return list_converted;
 }
 
-RapPieceInternalList UtauDraft::_convertLyric_rap(const RapPieceInternalList& inputList)
+RapPieceInternalList UtauDraft::_convertLyric_rap(const UtauLyricConverter& converter, const RapPieceInternalList& inputList)
 {
-	PyObject* lyricList = PyList_New(0);
+	std::vector<std::string> inputLyrics(inputList.size());
 	for (unsigned i = 0; i < (unsigned)inputList.size(); i++)
-	{
-		PyObject *byteCode = PyBytes_FromString(inputList[i]->lyric.data());
-		PyList_Append(lyricList, PyUnicode_FromEncodedObject(byteCode, m_lyric_charset.data(), 0));
-	}
-	PyObject* args = PyTuple_Pack(1, lyricList);
-	PyObject* rets = PyObject_CallObject(m_LyricConverter, args);
+		inputLyrics[i] = inputList[i]->lyric;
+
+	std::vector<ConvertedSyllable> syllables;
+	if (!_convertLyrics(converter, inputLyrics, syllables)) return inputList;
 
 	RapPieceInternalList outputList;
 	for (unsigned i = 0; i < (unsigned)inputList.size(); i++)
 	{
-		PyObject* tuple = PyList_GetItem(rets, i);
-		unsigned count = (unsigned)PyTuple_Size(tuple);
-
-		std::vector<std::string> lyrics;
-		std::vector<float> weights;
-		std::vector<bool> isVowels;
-
-		float sum_weight = 0.0f;
-		for (unsigned j = 0; j < count; j +=3)
+		const ConvertedSyllable& syllable = syllables[i];
+		if (syllable.size() == 0)
 		{
-			PyObject *byteCode = PyUnicode_AsEncodedString(PyTuple_GetItem(tuple, j), m_lyric_charset.data(), 0);
-			std::string lyric = PyBytes_AS_STRING(byteCode);
-			lyrics.push_back(lyric);
-
-			float weight = 1.0f;
-			if (j + 1 < count)
-			{
-				weight = (float)PyFloat_AsDouble(PyTuple_GetItem(tuple, j + 1));
-			}
-			weights.push_back(weight);
-
-			sum_weight += weight;
-
-			bool isVowel = true;
-			if (j + 2 < count)
-			{
-				isVowel = PyObject_IsTrue(PyTuple_GetItem(tuple, j + 2)) != 0;
-			}
-			isVowels.push_back(isVowel);
+			outputList.push_back(inputList[i]);
+			continue;
 		}
 
+		float sum_weight = 0.0f;
+		for (unsigned j = 0; j < (unsigned)syllable.size(); j++)
+			sum_weight += syllable[j].weight;
+
 		const RapPieceInternal& inputPiece = *inputList[i];
 		float k = 0.0f;
-		for (unsigned j = 0; j < lyrics.size(); j++)
+		for (unsigned j = 0; j < (unsigned)syllable.size(); j++)
 		{
-			float weight = weights[j] / sum_weight;
-			bool isVowel = isVowels[j];
+			float weight = syllable[j].weight / sum_weight;
 
 			RapPieceInternal_Deferred outputPiece;
 			outputPiece->fNumOfSamples = weight* inputPiece.fNumOfSamples;
-			outputPiece->lyric = lyrics[j];
-			outputPiece->isVowel = isVowel;
+			outputPiece->lyric = syllable[j].lyric;
+			outputPiece->isVowel = syllable[j].isVowel;
 			outputPiece->sampleFreq1 = (1.0f - k)*inputPiece.sampleFreq1 + k*inputPiece.sampleFreq2;
 			k += weight;
 			outputPiece->sampleFreq2 = (1.0f - k)*inputPiece.sampleFreq1 + k*inputPiece.sampleFreq2;
-			outputList.push_back(outputPiece);
+			outputList.push_back(std::move(outputPiece));
 		}
 
 	}
@@ -740,11 +1095,169 @@ RapPieceInternalList UtauDraft::_convertLyric_rap(const RapPieceInternalList& in
 	return outputList;
 }
 
-float UtauDraft::getFirstNoteHeadSamples(const char* lyric)
+SingerPrefetch_Deferred UtauDraft::PrefetchSentences(const std::vector<SingingPieceInternalList>& singing, const std::vector<TuneState>& singingStates,
+	const std::vector<RapPieceInternalList>& raps, const std::vector<TuneState>& rapStates, float sampleRate)
+{
+	// without the cache there's nowhere to keep what is loaded
+	if (m_SourceCache == nullptr || m_SourceCache->Budget() == 0) return SingerPrefetch_Deferred();
+
+	SingerPrefetch_Deferred prefetch = SingerPrefetch_Deferred::Instance<UtauDraftPrefetch>();
+	UtauDraftPrefetch* job = prefetch.DownCast<UtauDraftPrefetch>();
+	job->resolvedSentences = &m_resolvedSentences;
+	job->sampleRate = sampleRate;
+
+	// registered before returning, so the generation finds the sentences the thread hasn't reached yet
+	job->singing.resize(singing.size());
+	for (size_t i = 0; i < singing.size(); i++)
+	{
+		PrefetchSentence<SingingPieceInternalList>& sentence = job->singing[i];
+		sentence.pieceList = singing[i];
+		sentence.state = singingStates[i];
+		sentence.key = SentenceKey(singing[i], sampleRate, _tuneParams(singingStates[i]));
+		sentence.resolve = m_resolvedSentences.Reserve(sentence.key);
+	}
+	job->raps.resize(raps.size());
+	for (size_t i = 0; i < raps.size(); i++)
+	{
+		PrefetchSentence<RapPieceInternalList>& sentence = job->raps[i];
+		sentence.pieceList = raps[i];
+		sentence.state = rapStates[i];
+		sentence.key = SentenceKey(raps[i], sampleRate, _tuneParams(rapStates[i]));
+		sentence.resolve = m_resolvedSentences.Reserve(sentence.key);
+	}
+
+	job->thread = std::thread(&UtauDraft::_prefetch, this, job);
+	return prefetch;
+}
+
+void UtauDraft::_prefetch(UtauDraftPrefetch* job)
+{
+	// lyrics first, in order, as the generation waits for them
+	for (size_t i = 0; i < job->singing.size(); i++)
+	{
+		PrefetchSentence<SingingPieceInternalList>& sentence = job->singing[i];
+		if (!sentence.resolve) continue;
+		SingingPieceInternalList pieceList = sentence.pieceList;
+		_resolveLyrics(pieceList, job->sampleRate, _tuneParams(sentence.state));
+		m_resolvedSentences.SetResolved(sentence.key, pieceList);
+	}
+	for (size_t i = 0; i < job->raps.size(); i++)
+	{
+		PrefetchSentence<RapPieceInternalList>& sentence = job->raps[i];
+		if (!sentence.resolve) continue;
+		RapPieceInternalList pieceList = sentence.pieceList;
+		_resolveLyrics(pieceList, job->sampleRate, _tuneParams(sentence.state));
+		m_resolvedSentences.SetResolved(sentence.key, pieceList);
+	}
+
+	// resolved lyrics of each sentence, by this job or another one, with the default lyric for
+	// those missing from the voice-bank, as UtauSourceFetcher uses it
+	std::vector<std::vector<std::string>> lyrics;
+	std::vector<std::vector<unsigned>> isVowel;
+	std::vector<const TuneState*> states;
+	for (size_t i = 0; i < job->singing.size(); i++)
+	{
+		PrefetchSentence<SingingPieceInternalList>& sentence = job->singing[i];
+		m_resolvedSentences.Find(sentence.key, sentence.pieceList);
+		lyrics.push_back(std::vector<std::string>());
+		isVowel.push_back(std::vector<unsigned>());
+		states.push_back(&sentence.state);
+		for (size_t j = 0; j < sentence.pieceList.size(); j++)
+		{
+			lyrics.back().push_back(sentence.pieceList[j]->lyric);
+			isVowel.back().push_back(sentence.pieceList[j]->isVowel ? 1 : 0);
+		}
+	}
+	for (size_t i = 0; i < job->raps.size(); i++)
+	{
+		PrefetchSentence<RapPieceInternalList>& sentence = job->raps[i];
+		m_resolvedSentences.Find(sentence.key, sentence.pieceList);
+		lyrics.push_back(std::vector<std::string>());
+		isVowel.push_back(std::vector<unsigned>());
+		states.push_back(&sentence.state);
+		for (size_t j = 0; j < sentence.pieceList.size(); j++)
+		{
+			lyrics.back().push_back(sentence.pieceList[j]->lyric);
+			isVowel.back().push_back(sentence.pieceList[j]->isVowel ? 1 : 0);
+		}
+	}
+	for (size_t i = 0; i < lyrics.size(); i++)
+	{
+		for (size_t j = 0; j < lyrics[i].size(); j++)
+		{
+			bool found = m_PackedBank != nullptr ? m_PackedBank->Find(lyrics[i][j].data()) >= 0 : m_OtoMap->find(lyrics[i][j]) != m_OtoMap->end();
+			if (!found) lyrics[i][j] = states[i]->defaultLyric;
+		}
+	}
+
+	// stops at half of the budget, so the files of the beginning aren't evicted by those of the end
+	size_t maxBytes = m_SourceCache->Budget() / 2;
+	UtauSourceCache* cache = m_SourceCache;
+
+	// packed voice-banks are mapped. Several lyrics usually cut from the same wav
+	if (m_OtoMap != nullptr)
+	{
+		std::vector<std::string> wavFiles;
+		std::unordered_set<std::string> wavSet;
+		for (size_t i = 0; i < lyrics.size(); i++)
+		{
+			for (size_t j = 0; j < lyrics[i].size(); j++)
+			{
+				OtoMap::const_iterator iter = m_OtoMap->find(lyrics[i][j]);
+				if (iter == m_OtoMap->end()) continue;
+				if (wavSet.insert(iter->second.filename).second) wavFiles.push_back(iter->second.filename);
+			}
+		}
+
+		ParallelFor((unsigned)wavFiles.size(), DefaultNumberOfThreads(), [&](unsigned i)
+		{
+			if (cache->Size() >= maxBytes) return;
+			const std::string& filename = wavFiles[i];
+			std::string frq_path = filename.substr(0, filename.length() - 4) + "_wav.frq";
+			FrqData_deferred frq;
+			cache->GetFrq(frq_path, frq);
+			Buffer_deferred wav;
+			cache->GetWav(filename, wav);
+		});
+	}
+
+	// the analyses, in the order of the sentences, with a quarter of the budget left to the generation
+	maxBytes = m_SourceCache->Budget() / 4 * 3;
+	for (size_t i = 0; i < lyrics.size(); i++)
+	{
+		if (cache->Size() >= maxBytes) break;
+		_prefetchAnalyses(lyrics[i], isVowel[i], *states[i]);
+	}
+}
+
+void UtauDraft::_prefetchAnalyses(const std::vector<std::string>& lyrics, const std::vector<unsigned>& isVowel, const TuneState& state)
+{
+	// the MT generator makes the same analyses, the threads of the pool are left to the generation
+	UtauDraftTuneState params = _tuneParams(state);
+	params.use_MT = false;
+
+	// only the HNM generators use analyses
+	SentenceGenerator* sg = createSentenceGenerator(params);
+	SentenceGenerator_HNM* hnm = dynamic_cast<SentenceGenerator_HNM*>(sg);
+	if (hnm != nullptr)
+	{
+		UtauSourceFetcher srcFetcher;
+		srcFetcher.m_OtoMap = m_OtoMap;
+		srcFetcher.m_PackedBank = m_PackedBank;
+		srcFetcher.m_defaultLyric = state.defaultLyric;
+		srcFetcher.m_SourceCache = m_SourceCache;
+		hnm->PrefetchAnalyses(srcFetcher, (unsigned)lyrics.size(), lyrics.data(), isVowel.data());
+	}
+	releasSentenceGenerator(sg);
+}
+
+float UtauDraft::getFirstNoteHeadSamples(const char* lyric, const std::string& defaultLyric)
 {
 	UtauSourceFetcher srcFetcher;
 	srcFetcher.m_OtoMap = m_OtoMap;
-	srcFetcher.m_defaultLyric = m_defaultLyric;
+	srcFetcher.m_PackedBank = m_PackedBank;
+	srcFetcher.m_defaultLyric = defaultLyric;
+	srcFetcher.m_SourceCache = m_SourceCache;
 
 	SourceInfo srcInfo;
 	srcFetcher.FetchSourceInfo(lyric, srcInfo);
@@ -854,11 +1367,22 @@ public:
 
 	virtual Singer_deferred Init()
 	{
-		if (m_OtoMap.size() == 0)
+		if (!m_loaded)
 		{
 			char rootPath[1024];
 			sprintf(rootPath, "%s/UTAUVoice/%s", m_root.data(), m_name.data());
-			BuildOtoMap(rootPath);
+
+			// the packed bank is shared with the other copies of the initializer
+			if (!m_PackedBank->IsOpen())
+			{
+				char packFn[1024];
+				sprintf(packFn, "%s/%s", rootPath, PackedBank::DefaultFileName());
+				if (m_PackedBank->Open(rootPath, packFn) && m_PackedBank->NumberOfEntries() == 0)
+					m_PackedBank->Close();
+			}
+			if (!m_PackedBank->IsOpen())
+				BuildOtoMap(rootPath);
+			m_SourceCache->SetBankPath(rootPath);
 
 			char prefixMapFn[1024];
 			sprintf(prefixMapFn, "%s/UTAUVoice/%s/prefix.map", m_root.data(), m_name.data());
@@ -880,18 +1404,41 @@ public:
 				m_charset = charsetName;
 				fclose(fp_charset);
 			}
+			m_loaded = true;
 		}
 		UtauDraftDeferred singer(m_use_cuda);
-		singer.DownCast<UtauDraft>()->SetOtoMap(&m_OtoMap);
+		if (m_PackedBank->IsOpen())
+			singer.DownCast<UtauDraft>()->SetPackedBank(m_PackedBank);
+		else
+			singer.DownCast<UtauDraft>()->SetOtoMap(&m_OtoMap);
 		singer.DownCast<UtauDraft>()->SetCharset(m_charset.data());
 		if (m_PrefixMap.size() > 0)
 			singer.DownCast<UtauDraft>()->SetPrefixMap(&m_PrefixMap);
+		singer.DownCast<UtauDraft>()->SetSourceCache(m_SourceCache);
 		return singer;
 	}
 
+	// writes the voice-bank as a single packed file, which Init() then uses instead of the folder
+	bool PackVoiceBank()
+	{
+		char rootPath[1024];
+		sprintf(rootPath, "%s/UTAUVoice/%s", m_root.data(), m_name.data());
+		BuildOtoMap(rootPath);
+		if (m_OtoMap.size() == 0)
+		{
+			printf("No oto.ini found in %s\n", rootPath);
+			return false;
+		}
+
+		char packFn[1024];
+		sprintf(packFn, "%s/%s", rootPath, PackedBank::DefaultFileName());
+		return PackedBank::Build(m_OtoMap, rootPath, packFn);
+	}
+
 	UtauDraftInitializer()
 	{
 		m_use_cuda = false;
+		m_loaded = false;
 	}
 
 	void setUseCuda(bool use = true)
@@ -902,6 +1449,9 @@ public:
 private:
 	OtoMap m_OtoMap;
 	PrefixMap m_PrefixMap;
+	Deferred<UtauSourceCache> m_SourceCache; // shared by the copies of the initializer
+	Deferred<PackedBank> m_PackedBank; // shared by the copies of the initializer
+	bool m_loaded;
 	std::string m_charset;
 	std::string m_name;
 	std::string m_root;
@@ -911,6 +1461,7 @@ private:
 };
 
 static PyScoreDraft* s_PyScoreDraft;
+static std::string s_root;
 
 
 PyObject* UtauDraftSetLyricConverter(PyObject *args)
@@ -919,11 +1470,58 @@ PyObject* UtauDraftSetLyricConverter(PyObject *args)
 	PyObject* LyricConverter = PyTuple_GetItem(args, 1);
 
 	Singer_deferred singer = s_PyScoreDraft->GetSinger(SingerId);
-	singer.DownCast<UtauDraft>()->SetLyricConverter(LyricConverter);
+	if (PyUnicode_Check(LyricConverter))
+	{
+		const char* name = PyUnicode_AsUTF8(LyricConverter);
+		if (!singer.DownCast<UtauDraft>()->SetNativeLyricConverter(name))
+		{
+			PyErr_Format(PyExc_RuntimeError, "Unknown lyric converter or invalid rule-table file: %s", name);
+			return NULL;
+		}
+	}
+	else
+	{
+		singer.DownCast<UtauDraft>()->SetLyricConverter(LyricConverter != Py_None ? LyricConverter : nullptr);
+	}
+
+	return PyLong_FromUnsignedLong(0);
+}
+
+PyObject* UtauDraftSetSourceCacheSize(PyObject *args)
+{
+	unsigned SingerId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
+	unsigned megabytes = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 1));
+
+	Singer_deferred singer = s_PyScoreDraft->GetSinger(SingerId);
+	UtauSourceCache* cache = singer.DownCast<UtauDraft>()->GetSourceCache();
+	if (cache != nullptr)
+		cache->SetBudget((size_t)megabytes * 1024 * 1024);
 
 	return PyLong_FromUnsignedLong(0);
 }
 
+PyObject* UtauDraftSetHNMCacheFiles(PyObject *args)
+{
+	unsigned SingerId = (unsigned)PyLong_AsUnsignedLong(PyTuple_GetItem(args, 0));
+	bool enable = PyObject_IsTrue(PyTuple_GetItem(args, 1)) != 0;
+
+	Singer_deferred singer = s_PyScoreDraft->GetSinger(SingerId);
+	UtauSourceCache* cache = singer.DownCast<UtauDraft>()->GetSourceCache();
+	if (cache != nullptr)
+		cache->EnableHNMFiles(enable);
+
+	return PyLong_FromUnsignedLong(0);
+}
+
+PyObject* UtauDraftPackVoiceBank(PyObject *args)
+{
+	const char* name = _PyUnicode_AsString(args);
+
+	UtauDraftInitializer initializer;
+	initializer.SetName(s_root.data(), name);
+	return PyBool_FromLong(initializer.PackVoiceBank() ? 1 : 0);
+}
+
 #if HAVE_CUDA
 #include <cuda_runtime.h>
 #endif
@@ -931,6 +1529,7 @@ PyObject* UtauDraftSetLyricConverter(PyObject *args)
 PY_SCOREDRAFT_EXTENSION_INTERFACE void Initialize(PyScoreDraft* pyScoreDraft, const char* root)
 {
 	s_PyScoreDraft = pyScoreDraft;
+	s_root = root;
 
 	static std::vector<UtauDraftInitializer> s_initializers;
 	static std::vector<UtauDraftInitializer> s_initializers_cuda;
@@ -1020,5 +1619,29 @@ PY_SCOREDRAFT_EXTENSION_INTERFACE void Initialize(PyScoreDraft* pyScoreDraft, co
 		"\tThe argument 'LyricForEachSyllable' has the form [lyric1, lyric2, ...], where each lyric is a string\n"
 		"\tIn the return value, each lyric is a converted lyric as a string and each weight a float indicating the ratio taken within the syllable,\n"
 		"\tplus a bool value indicating whether it is the vowel part of the syllable.\n"
+		"\tInstead of a function, the name of a built-in converter can be given: 'jp_vcv', 'tsuro_vcv', 'cvvc_chinese',\n"
+		"\t'xiayy', 'tt_english' or 'vccv_english'. They convert like the scripts of the same names, without the GIL.\n"
+		"\tThe English ones segment the lyrics using the voice-bank of the singer. Any other string is the path of\n"
+		"\ta rule-table file for one of these converter types, see UtauDraft/LyricConverter.h for the format.\n"
+		"\tAn unknown name raises RuntimeError. None removes the converter.\n"
+		"\t'''\n");
+
+	pyScoreDraft->RegisterInterfaceExtension("UtauDraftSetSourceCacheSize", UtauDraftSetSourceCacheSize, "singer, megabytes", "singer.id, megabytes",
+		"\t'''\n"
+		"\tSet the size of the cache of decoded voice-bank files, shared by all the singers of the same voice-bank.\n"
+		"\tThe default is 256 megabytes. 0 disables the caching.\n"
+		"\t'''\n");
+
+	pyScoreDraft->RegisterInterfaceExtension("UtauDraftSetHNMCacheFiles", UtauDraftSetHNMCacheFiles, "singer, enable", "singer.id, enable",
+		"\t'''\n"
+		"\tStore the HNM analyses of the voice-bank in its 'hnm_cache' sub-directory, and reuse them in later sessions.\n"
+		"\tThe files are rebuilt when the .wav or .frq files change. Disabled by default.\n"
+		"\t'''\n");
+
+	pyScoreDraft->RegisterInterfaceExtension("UtauDraftPackVoiceBank", UtauDraftPackVoiceBank, "name", "name",
+		"\t'''\n"
+		"\tPack the voice-bank in the directory UTAUVoice/name into a single file, voicebank.sdpack,\n"
+		"\twith the samples already cut and normalized, and the .frq data. Singers created in later sessions\n"
+		"\tload the packed file instead of the folder. Pack again after editing the voice-bank.\n"
 		"\t'''\n");
 }
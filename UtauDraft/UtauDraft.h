@@ -7,11 +7,18 @@ struct _object;
 typedef struct _object PyObject;
 class PrefixMap;
 
+// standard headers like <mutex> (from UtauSourceCache.h) must come before the min/max macros of VoiceUtil.h
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+#include "UtauSourceCache.h"
 #include "fft.h"
 #include "VoiceUtil.h"
 using namespace VoiceUtil;
 #include "FrqData.h"
 #include "OtoMap.h"
+#include "PackedBank.h"
+#include "LyricConverter.h"
 
 struct SourceInfo
 {
@@ -20,16 +27,24 @@ struct SourceInfo
 	Buffer source;
 	float srcbegin;
 	float srcend;
+	std::string stamp; // identifies the source files, for cache keys, only set when caching
 };
 
 class UtauSourceFetcher
 {
 public:
 	OtoMap* m_OtoMap;
+	const PackedBank* m_PackedBank; // used instead of m_OtoMap when set
 	std::string m_defaultLyric;
+	UtauSourceCache* m_SourceCache; // optional
+
+	UtauSourceFetcher() : m_OtoMap(nullptr), m_PackedBank(nullptr), m_SourceCache(nullptr) {}
 
 	bool FetchSourceInfo(const char* lyric, SourceInfo& srcInfo, float constVC=-1.0f) const;
+	bool FetchPackedSourceInfo(const char* lyric, SourceInfo& srcInfo, float constVC) const;
 	static bool ReadWavLocToBuffer(VoiceLocation loc, Buffer& buf, float& begin, float& end);
+	// cuts the part of a whole (normalized) wav given by "loc"
+	static void CutWavLoc(const Buffer& whole, VoiceLocation loc, Buffer& buf, float& begin, float& end);
 
 };
 
@@ -53,11 +68,86 @@ public:
 	float _transition;
 	float _gender;
 	float _constVC;
+	UtauSourceCache* _sourceCache; // optional, keeps the analyses of the sources
 
 	virtual void GenerateSentence(const UtauSourceFetcher& srcFetcher, unsigned numPieces, const std::string* lyrics, const unsigned* isVowel, const unsigned* lengths, const float *freqAllMap, NoteBuffer* noteBuf) = 0;
 
 };
 
+// a Python function or a built-in converter, released when the last state using it is gone
+class UtauLyricConverter
+{
+public:
+	PyObject* python;
+	LyricConverter* native; // used instead of "python" when set
+
+	UtauLyricConverter() : python(nullptr), native(nullptr) {}
+	~UtauLyricConverter(); // takes the GIL to release the Python function
+
+private:
+	UtauLyricConverter(const UtauLyricConverter&);
+	UtauLyricConverter& operator=(const UtauLyricConverter&);
+};
+
+typedef Deferred<UtauLyricConverter> UtauLyricConverter_Deferred;
+
+// settings of the tuning commands of UtauDraft, and the lyric converter
+class UtauDraftTuneState : public TuneStateExtension
+{
+public:
+	float transition;
+	float rap_distortion;
+	float gender;
+	float constVC;
+	bool use_prefix_map;
+	bool use_MT; // SentenceGenerator_MT instead of SentenceGenerator_HNM, for the CPU
+
+	UtauLyricConverter_Deferred lyricConverter;
+
+	UtauDraftTuneState() : transition(0.1f), rap_distortion(1.0f), gender(0.0f), constVC(-1.0f), use_prefix_map(true), use_MT(false) {}
+};
+
+/*
+	Sentences whose lyrics a prefetch job resolves (converts, then prefixes) ahead of their generation,
+	so the lyric converter runs once for each. Generating a sentence a job hasn't resolved yet waits
+	for it. Entries are identified by SentenceKey(), and kept until the jobs having them end. Thread safe.
+*/
+class ResolvedSentences
+{
+public:
+	// registers a sentence of a job, returns true when the job is the one to resolve it
+	bool Reserve(const std::string& key);
+	// called when the job ends, for each sentence it registered
+	void Release(const std::string& key);
+
+	void SetResolved(const std::string& key, const SingingPieceInternalList& pieceList);
+	void SetResolved(const std::string& key, const RapPieceInternalList& pieceList);
+
+	// false when no job has the sentence
+	bool Find(const std::string& key, SingingPieceInternalList& pieceList);
+	bool Find(const std::string& key, RapPieceInternalList& pieceList);
+
+private:
+	struct Entry
+	{
+		unsigned jobs;
+		bool resolved;
+		SingingPieceInternalList singing;
+		RapPieceInternalList rap;
+
+		Entry() : jobs(0), resolved(false) {}
+	};
+
+	// waits for the entry to be resolved, nullptr if there's none
+	Entry* _wait(std::unique_lock<std::mutex>& lock, const std::string& key);
+
+	std::mutex m_mutex;
+	std::condition_variable m_resolvedCond;
+	std::unordered_map<std::string, Entry> m_entries;
+};
+
+class UtauDraftPrefetch;
+
 class UtauDraft : public Singer
 {
 public:
@@ -65,39 +155,65 @@ public:
 	~UtauDraft();
 
 	void SetOtoMap(OtoMap* otoMap);
+	void SetPackedBank(const PackedBank* packedBank);
 	void SetPrefixMap(PrefixMap* prefixMap);
 	void SetCharset(const char* charset);
 	void SetLyricConverter(PyObject* lyricConverter);
+	// selects a built-in converter by name, called with the GIL
+	bool SetNativeLyricConverter(const char* name);
+	void SetSourceCache(UtauSourceCache* sourceCache);
+	UtauSourceCache* GetSourceCache() { return m_SourceCache; }
 
-	virtual bool Tune(const char* cmd);
+	virtual bool TuneExtension(const char* cmd, TuneState& state);
 
-	virtual void GenerateWave(SingingPieceInternal piece, NoteBuffer* noteBuf);
-	virtual void GenerateWave_Rap(RapPieceInternal piece, NoteBuffer* noteBuf);
-	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, NoteBuffer* noteBuf);
-	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, NoteBuffer* noteBuf);
+	virtual void GenerateWave(SingingPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf);
+	virtual void GenerateWave_Rap(RapPieceInternal piece, const TuneState& state, NoteBuffer* noteBuf);
+	virtual void GenerateWave_SingConsecutive(SingingPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf);
+	virtual void GenerateWave_RapConsecutive(RapPieceInternalList pieceList, const TuneState& state, NoteBuffer* noteBuf);
+
+	// the source cache is locked, and Python lyric converters take the GIL.
+	// Only for the HNM generator: the MT generator already runs its own threads for each
+	// sentence, and the CUDA generator isn't meant to be driven by several threads at once
+	virtual bool CanGenerateConcurrently(const TuneState& state) const { return !m_use_CUDA && !_tuneParams(state).use_MT; }
+
+	// resolves the lyrics, then loads the wav and .frq files and the HNM analyses they use into the
+	// source cache, on a thread of its own, so the first sentences can be generated meanwhile
+	virtual SingerPrefetch_Deferred PrefetchSentences(const std::vector<SingingPieceInternalList>& singing, const std::vector<TuneState>& singingStates,
+		const std::vector<RapPieceInternalList>& raps, const std::vector<TuneState>& rapStates, float sampleRate);
 
 
 private:
-	static void _floatBufSmooth(float* buf, unsigned size);
-	SingingPieceInternalList _convertLyric_singing(SingingPieceInternalList pieceList);
-	RapPieceInternalList _convertLyric_rap(const RapPieceInternalList& inputList);
-	float getFirstNoteHeadSamples(const char* lyric);
+	// states not made by this singer have the default settings
+	static const UtauDraftTuneState& _tuneParams(const TuneState& state);
+	// replaces the converter of the singer's own state, called with the GIL
+	void _setLyricConverter(const UtauLyricConverter_Deferred& converter);
 
-	SentenceGenerator* createSentenceGenerator();
+	static void _floatBufSmooth(float* buf, unsigned size);
+	bool _convertLyrics(const UtauLyricConverter& converter, const std::vector<std::string>& lyrics, std::vector<ConvertedSyllable>& syllables);
+	SingingPieceInternalList _convertLyric_singing(const UtauLyricConverter& converter, SingingPieceInternalList pieceList);
+	RapPieceInternalList _convertLyric_rap(const UtauLyricConverter& converter, const RapPieceInternalList& inputList);
+	// lyric converter, then prefix map
+	void _resolveLyrics(SingingPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params);
+	void _resolveLyrics(RapPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params);
+	// same, taken from m_resolvedSentences when a prefetch job has the sentence
+	void _getResolvedLyrics(SingingPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params);
+	void _getResolvedLyrics(RapPieceInternalList& pieceList, float sampleRate, const UtauDraftTuneState& params);
+	// runs on the thread of the job
+	void _prefetch(UtauDraftPrefetch* job);
+	void _prefetchAnalyses(const std::vector<std::string>& lyrics, const std::vector<unsigned>& isVowel, const TuneState& state);
+	float getFirstNoteHeadSamples(const char* lyric, const std::string& defaultLyric);
+
+	SentenceGenerator* createSentenceGenerator(const UtauDraftTuneState& params);
 	void releasSentenceGenerator(SentenceGenerator* sg) { delete sg; }
 
 	OtoMap* m_OtoMap;
+	const PackedBank* m_PackedBank;
 
-	float m_transition;
-	float m_rap_distortion;
-	float m_gender;
-	float m_constVC;
-
-	PyObject* m_LyricConverter;
-
-	bool m_use_prefix_map;
 	PrefixMap* m_PrefixMap;
 
+	UtauSourceCache* m_SourceCache;
+	ResolvedSentences m_resolvedSentences;
+
 	bool m_use_CUDA;
 
 };
@@ -0,0 +1,270 @@
+#include "UtauSourceCache.h"
+#include <FileStamp.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+static const size_t s_defaultBudget = (size_t)256 * 1024 * 1024;
+
+// bump when the analysis or the file layout changes, older files are then ignored
+static const char s_hnmMagic[4] = { 'S', 'D', 'H', 'N' };
+static const uint32_t s_hnmVersion = 1;
+
+UtauSourceCache::UtauSourceCache() : m_bytes(0), m_budget(s_defaultBudget), m_useHNMFiles(false)
+{
+}
+
+void UtauSourceCache::SetBankPath(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bankPath = path;
+}
+
+void UtauSourceCache::EnableHNMFiles(bool enable)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_useHNMFiles = enable && m_bankPath.length() > 0;
+	if (m_useHNMFiles)
+	{
+		std::string dir = m_bankPath + "/hnm_cache";
+#ifdef _WIN32
+		_mkdir(dir.data());
+#else
+		mkdir(dir.data(), 0755);
+#endif
+	}
+}
+
+void UtauSourceCache::SetBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budget = bytes;
+	_evict();
+}
+
+size_t UtauSourceCache::Budget()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_budget;
+}
+
+size_t UtauSourceCache::Size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_bytes;
+}
+
+void UtauSourceCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_index.clear();
+	m_bytes = 0;
+}
+
+bool UtauSourceCache::ReadNormalizedWav(const char* filename, VoiceUtil::Buffer& buf)
+{
+	float maxV;
+	if (!ReadWavToBuffer(filename, buf, maxV)) return false;
+
+	float acc = 0.0f;
+	float count = 0.0f;
+	for (unsigned i = 0; i < buf.m_data.size(); i++)
+	{
+		acc += buf.m_data[i] * buf.m_data[i];
+		if (buf.m_data[i] != 0.0f)
+		{
+			count += 1.0f;
+		}
+	}
+	acc = sqrtf(count / acc)*0.3f;
+
+	for (unsigned i = 0; i < buf.m_data.size(); i++)
+		buf.m_data[i] *= acc;
+
+	return true;
+}
+
+bool UtauSourceCache::GetWav(const std::string& filename, Buffer_deferred& wav, std::string* stamp)
+{
+	Entry entry;
+	entry.key = "wav:" + filename;
+	if (!_find(entry.key, entry))
+	{
+		// loaded without holding the lock, so other threads can go on with cached files
+		// stamped before reading: if the file changes meanwhile, what is derived from it is only computed again later
+		entry.stamp = FileStamp(filename.data());
+		if (!ReadNormalizedWav(filename.data(), *entry.wav)) return false;
+		entry.bytes = entry.wav->m_data.size()*sizeof(float);
+		_insert(entry);
+	}
+	wav = entry.wav;
+	if (stamp != nullptr) *stamp = entry.stamp;
+	return true;
+}
+
+bool UtauSourceCache::GetFrq(const std::string& filename, FrqData_deferred& frq, std::string* stamp)
+{
+	Entry entry;
+	entry.key = "frq:" + filename;
+	if (!_find(entry.key, entry))
+	{
+		entry.stamp = FileStamp(filename.data());
+		if (!entry.frq->ReadFromFile(filename.data())) return false;
+		entry.bytes = entry.frq->size()*sizeof(FrqDataPoint);
+		_insert(entry);
+	}
+	frq = entry.frq;
+	if (stamp != nullptr) *stamp = entry.stamp;
+	return true;
+}
+
+std::string UtauSourceCache::_hnmFilePath(const std::string& key)
+{
+	// FNV-1a, the full key is stored in the file to rule out collisions
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < key.length(); i++)
+	{
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ULL;
+	}
+	char name[32];
+	sprintf(name, "/%016llx.hnm", (unsigned long long)hash);
+	return m_bankPath + "/hnm_cache" + name;
+}
+
+bool UtauSourceCache::GetHNMAnalysis(const std::string& key, HNMAnalysis_deferred& analysis)
+{
+	Entry entry;
+	entry.key = "hnm:" + key;
+
+	// an analysis being made by another thread is waited for, then found in memory,
+	// unless it was evicted already, in which case this thread makes it again
+	std::string path;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_hnmMade.wait(lock, [&]() { return m_hnmInProgress.find(key) == m_hnmInProgress.end(); });
+		if (_findLocked(entry.key, entry))
+		{
+			analysis = entry.hnm;
+			return true;
+		}
+		m_hnmInProgress.insert(key);
+		if (!m_useHNMFiles) return false;
+		path = _hnmFilePath(key);
+	}
+
+	FILE* fp = fopen(path.data(), "rb");
+	if (!fp) return false;
+
+	bool ok = false;
+	char magic[4];
+	uint32_t version, keyLen;
+	if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, s_hnmMagic, 4) == 0 &&
+		fread(&version, sizeof(uint32_t), 1, fp) == 1 && version == s_hnmVersion &&
+		fread(&keyLen, sizeof(uint32_t), 1, fp) == 1 && keyLen == (uint32_t)key.length())
+	{
+		std::string fileKey(keyLen, ' ');
+		if (fread(&fileKey[0], 1, keyLen, fp) == keyLen && fileKey == key)
+			ok = entry.hnm->Load(fp);
+	}
+	fclose(fp);
+	if (!ok) return false;
+
+	entry.bytes = entry.hnm->Bytes();
+	_insert(entry);
+	_endHNMAnalysis(key);
+	analysis = entry.hnm;
+	return true;
+}
+
+void UtauSourceCache::AddHNMAnalysis(const std::string& key, const HNMAnalysis_deferred& analysis)
+{
+	Entry entry;
+	entry.key = "hnm:" + key;
+	entry.hnm = analysis;
+	entry.bytes = analysis->Bytes();
+	_insert(entry);
+	_endHNMAnalysis(key);
+
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_useHNMFiles) return;
+		path = _hnmFilePath(key);
+	}
+
+	// written to a temporary file first, so a reader never sees a partial file
+	char suffix[64];
+	sprintf(suffix, ".%d.%p.tmp", (int)getpid(), (const void*)(const HNMAnalysis*)analysis);
+	std::string tmpPath = path + suffix;
+
+	FILE* fp = fopen(tmpPath.data(), "wb");
+	if (!fp) return;
+	uint32_t keyLen = (uint32_t)key.length();
+	bool ok = fwrite(s_hnmMagic, 1, 4, fp) == 4 &&
+		fwrite(&s_hnmVersion, sizeof(uint32_t), 1, fp) == 1 &&
+		fwrite(&keyLen, sizeof(uint32_t), 1, fp) == 1 &&
+		fwrite(key.data(), 1, keyLen, fp) == keyLen &&
+		analysis->Save(fp);
+	ok = fclose(fp) == 0 && ok;
+
+#ifdef _WIN32
+	if (ok) remove(path.data());
+#endif
+	if (!ok || rename(tmpPath.data(), path.data()) != 0)
+		remove(tmpPath.data());
+}
+
+void UtauSourceCache::_endHNMAnalysis(const std::string& key)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_hnmInProgress.erase(key);
+	}
+	m_hnmMade.notify_all();
+}
+
+bool UtauSourceCache::_find(const std::string& key, Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return _findLocked(key, entry);
+}
+
+bool UtauSourceCache::_findLocked(const std::string& key, Entry& entry)
+{
+	std::unordered_map<std::string, EntryList::iterator>::iterator iter = m_index.find(key);
+	if (iter == m_index.end()) return false;
+	m_entries.splice(m_entries.begin(), m_entries, iter->second);
+	entry = *iter->second;
+	return true;
+}
+
+void UtauSourceCache::_insert(const Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_index.find(entry.key) != m_index.end()) return; // loaded by another thread meanwhile
+	m_entries.push_front(entry);
+	m_index[entry.key] = m_entries.begin();
+	m_bytes += entry.bytes;
+	_evict();
+}
+
+void UtauSourceCache::_evict()
+{
+	while (m_bytes > m_budget && m_entries.size() > 0)
+	{
+		Entry& last = m_entries.back();
+		m_bytes -= last.bytes;
+		m_index.erase(last.key);
+		m_entries.pop_back();
+	}
+}
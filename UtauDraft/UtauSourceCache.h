@@ -0,0 +1,88 @@
+#ifndef _UtauSourceCache_h
+#define _UtauSourceCache_h
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <Deferred.h>
+
+#include "VoiceUtil.h"
+#include "FrqData.h"
+#include "HNMAnalysis.h"
+
+typedef Deferred<VoiceUtil::Buffer> Buffer_deferred;
+typedef Deferred<FrqData> FrqData_deferred;
+
+/*
+	LRU cache of decoded voice-bank files, shared by all singers of a voice-bank.
+	Wavs are kept whole and already normalized, .frq files already parsed, so a syllable
+	used again (or looked ahead at) doesn't go back to the disk.
+	It also keeps HNM analyses, which can be stored in .hnm files as well.
+	Entries are reference counted, an entry evicted while in use stays valid for its user.
+	All methods are thread safe.
+*/
+class UtauSourceCache
+{
+public:
+	UtauSourceCache();
+
+	// total size of the cached data, least recently used entries are dropped beyond it
+	void SetBudget(size_t bytes);
+	size_t Budget();
+	size_t Size(); // bytes currently cached
+	void Clear();
+
+	// 'stamp' receives the FileStamp() of the file taken when it was loaded, so it always
+	// matches the cached data and a fetch doesn't stat the file again
+	bool GetWav(const std::string& filename, Buffer_deferred& wav, std::string* stamp = nullptr);
+	bool GetFrq(const std::string& filename, FrqData_deferred& frq, std::string* stamp = nullptr);
+
+	// the key must identify everything the analysis depends on, including the source files (see FileStamp())
+	// looks in memory first, then in the .hnm files if enabled. When it returns false, the caller makes
+	// the analysis and must pass it to AddHNMAnalysis(), other threads asking for it wait meanwhile
+	bool GetHNMAnalysis(const std::string& key, HNMAnalysis_deferred& analysis);
+	void AddHNMAnalysis(const std::string& key, const HNMAnalysis_deferred& analysis);
+
+	// .hnm files go to the "hnm_cache" sub-directory of the voice-bank
+	void SetBankPath(const std::string& path);
+	void EnableHNMFiles(bool enable);
+
+	// reads a mono wav, scaled to the RMS level used by UtauDraft
+	static bool ReadNormalizedWav(const char* filename, VoiceUtil::Buffer& buf);
+
+private:
+	struct Entry
+	{
+		std::string key;
+		Buffer_deferred wav;
+		FrqData_deferred frq;
+		HNMAnalysis_deferred hnm;
+		std::string stamp;
+		size_t bytes;
+	};
+	typedef std::list<Entry> EntryList;
+
+	bool _find(const std::string& key, Entry& entry);
+	bool _findLocked(const std::string& key, Entry& entry); // m_mutex held by the caller
+	void _endHNMAnalysis(const std::string& key);
+	void _insert(const Entry& entry);
+	void _evict();
+	std::string _hnmFilePath(const std::string& key);
+
+	std::mutex m_mutex;
+	EntryList m_entries; // most recently used first
+	std::unordered_map<std::string, EntryList::iterator> m_index;
+	size_t m_bytes;
+	size_t m_budget;
+
+	std::unordered_set<std::string> m_hnmInProgress; // keys of the analyses being made
+	std::condition_variable m_hnmMade;
+
+	std::string m_bankPath;
+	bool m_useHNMFiles;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "ReadWav.h"
 #include <cmath>
+#include <string.h>
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -65,7 +66,7 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 	fread(&buf32, 4, 1, m_fp);
 	if (buf32 != u_riff)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
@@ -75,14 +76,14 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 	fread(&buf32, 4, 1, m_fp);
 	if (buf32 != u_wave)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
 	fread(&buf32, 4, 1, m_fp);
 	if (buf32 != u_fmt)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
@@ -93,14 +94,14 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 	fread(&headerSize, 4, 1, m_fp);
 	if (headerSize < sizeof(WavHeader))
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 	else if (headerSize > sizeof(WavHeader))
 	{
 		if (headerSize - sizeof(WavHeader) > 4)
 		{
-			fclose(m_fp);
+			CloseFile();
 			return false;
 		}
 		skipSize = headerSize - sizeof(WavHeader);
@@ -116,14 +117,14 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 
 	if (header.wFormatTag != 1)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
 	chn = header.wChannels;
 	if (chn<1 || chn>2)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
@@ -131,14 +132,14 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 
 	if (header.wBitsPerSample != 16)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
 	fread(&buf32, 4, 1, m_fp);
 	if (buf32 != u_data)
 	{
-		fclose(m_fp);
+		CloseFile();
 		return false;
 	}
 
@@ -150,6 +151,7 @@ bool ReadWav::ReadHeader(unsigned& sampleRate, unsigned& numSamples, unsigned& c
 	m_totalSamples = numSamples;
 	m_num_channels = chn;
 	m_readSamples = 0;
+	m_dataOffset = (unsigned)ftell(m_fp);
 
 	return true;
 }
@@ -160,20 +162,31 @@ bool ReadWav::ReadSamples(float* samples, unsigned count, float& max_v)
 	if (!m_fp) return false;
 	count = min(count, m_totalSamples - m_readSamples);
 
-	if (count > 0)
-	{
-		short* data = new short[m_totalSamples*m_num_channels];
-		fread(data, sizeof(short), m_totalSamples*m_num_channels, m_fp);
+	max_v = 0.0f;
+
+	// converted through a small buffer, instead of reading the whole file at once
+	static const unsigned s_blockSamples = 4096;
+	short data[s_blockSamples];
 
-		max_v = 0.0f;
-		for (unsigned i = 0; i < m_totalSamples*m_num_channels; i++)
-		{	
+	unsigned total = count*m_num_channels;
+	for (unsigned pos = 0; pos < total; pos += s_blockSamples)
+	{
+		unsigned n = min(s_blockSamples, total - pos);
+		// files shorter than their header are read as silence after the end
+		size_t read = m_fp ? fread(data, sizeof(short), n, m_fp) : 0;
+		if (read < n)
+		{
+			memset(data + read, 0, sizeof(short)*(n - read));
+			CloseFile();
+		}
+		for (unsigned i = 0; i < n; i++)
+		{
 			float v = (float)data[i] / 32767.0f;
-			samples[i] = v;
+			samples[pos + i] = v;
 			max_v = max(max_v, fabsf(v));
 		}
-		delete[] data;
 	}
+	m_readSamples += count;
 
 	if (m_totalSamples - m_readSamples <= 0) CloseFile();
 
@@ -14,11 +14,15 @@ public:
 	bool ReadHeader(unsigned &sampleRate, unsigned &numSamples, unsigned& chn);
 	bool ReadSamples(float* samples, unsigned count, float& maxv);
 
+	// position of the 16-bit samples in the file, valid after ReadHeader()
+	unsigned DataOffset() const { return m_dataOffset; }
+
 private:
 	FILE* m_fp;
 	unsigned m_totalSamples;
 	unsigned m_num_channels;
 	unsigned m_readSamples;
+	unsigned m_dataOffset;
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include "WriteWav.h"
+#include <memory.h>
 
 #ifndef max
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
@@ -124,3 +125,19 @@ void WriteWav::WriteSamples(const float* samples, unsigned count, float volume,
 	if (m_totalSamples - m_writenSamples<=0) CloseFile();
 }
 
+
+void WriteWav::WriteSilence(unsigned count)
+{
+	if (!m_fp) return;
+	count = min(count, m_totalSamples - m_writenSamples);
+	if (count > 0)
+	{
+		short* data = new short[count*m_num_channels];
+		memset(data, 0, sizeof(short)*count*m_num_channels);
+		fwrite(data, sizeof(short), count*m_num_channels, m_fp);
+		delete[] data;
+
+		m_writenSamples += count;
+	}
+	if (m_totalSamples - m_writenSamples <= 0) CloseFile();
+}
@@ -13,6 +13,7 @@ public:
 
 	void WriteHeader(unsigned sampleRate, unsigned numSamples, unsigned chn=1);
 	void WriteSamples(const float* samples, unsigned count, float volume=1.0f, float pan=0.0f);
+	void WriteSilence(unsigned count);
 
 private:
 	FILE* m_fp;
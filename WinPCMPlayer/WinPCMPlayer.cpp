@@ -63,7 +63,7 @@ public:
 		float volume = track.Volume();
 		float pan = track.Pan();
 		Buffer* newBuffer=new Buffer;
-		newBuffer->m_size=track.NumberOfSamples();
+		newBuffer->m_size=(unsigned)track.NumberOfSamples();
 		newBuffer->m_chn = track.NumberOfChannels();
 		newBuffer->Allocate();
 